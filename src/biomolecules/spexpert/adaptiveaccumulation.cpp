@@ -0,0 +1,134 @@
+#include "adaptiveaccumulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+/*!
+   \class AdaptiveAccumulation
+   \brief Decides when the accumulation reached the target signal-to-noise
+   ratio.
+
+   WinSpec reads out the running sum of the accumulations, so the noise is
+   estimated from the differences of the consecutive readouts, which are
+   independent. The signal of a difference is the sum over the region of
+   interest above its minimum. A difference of k accumulations has the mean
+   k * mu and the variance k * sigma^2, so mu is estimated as the sum of the
+   signals over the sum of the accumulations and sigma^2 from the squared
+   residuals weighted by 1 / k. The signal-to-noise ratio of the sum of n
+   accumulations is mu * sqrt(n) / sigma.
+ */
+
+AdaptiveAccumulation::AdaptiveAccumulation(const AdaptiveAccumulationParams& params)
+    : params_(params),
+      previous_accums_{0},
+      count_{0},
+      signal_sum_{0.0},
+      accums_sum_{0.0},
+      weighted_squares_{0.0}
+{}
+
+
+/*!
+   \brief The number of accumulations the acquisition is started with, the
+   upper limit of the adaptive one.
+ */
+int AdaptiveAccumulation::maxAccums(const AdaptiveAccumulationParams& params, double exposure, int accums)
+{
+    if (params.maxTime <= 0.0 || exposure <= 0.0) {
+        return accums;
+    }
+    return std::max(1, static_cast<int>(std::ceil(params.maxTime / exposure - 1e-6)));
+}
+
+
+void AdaptiveAccumulation::reset()
+{
+    previous_.clear();
+    previous_accums_ = 0;
+    count_ = 0;
+    signal_sum_ = 0.0;
+    accums_sum_ = 0.0;
+    weighted_squares_ = 0.0;
+}
+
+
+/*!
+   \brief Adds the readout \a frame of \a x pixels and \a y rows in the WinSpec
+   order, where the rows of the pixel are neighbours. The readout holds the sum
+   of the first \a accums accumulations.
+   \return false if the frame does not fit the region of interest or holds no
+   accumulation more than the last added one.
+ */
+bool AdaptiveAccumulation::add(const QVariantList& frame, int x, int y, int accums)
+{
+    if (x < 1 || y < 1 || frame.size() != x * y) {
+        return false;
+    }
+    const int from = std::max(0, params_.regionFrom);
+    const int to = (params_.regionTo < 0) ? x - 1 : std::min(x - 1, params_.regionTo);
+    if (from > to) {
+        return false;
+    }
+    const int k = accums - previous_accums_;
+    if (k < 1) {
+        return false;
+    }
+    if (previous_.size() != to - from + 1) {
+        previous_.fill(0.0, to - from + 1);
+    }
+
+    double sum = 0.0;
+    double min = std::numeric_limits<double>::infinity();
+    for (int ii = from; ii <= to; ++ii) {
+        double pixel = 0.0;
+        for (int row = 0; row < y; ++row) {
+            pixel += frame.at(ii * y + row).toDouble();
+        }
+        double& previous = previous_[ii - from];
+        const double difference = pixel - previous;
+        previous = pixel;
+        sum += difference;
+        min = std::min(min, difference);
+    }
+    const double signal = sum - min * (to - from + 1);
+
+    previous_accums_ = accums;
+    ++count_;
+    signal_sum_ += signal;
+    accums_sum_ += k;
+    weighted_squares_ += signal * signal / k;
+    return true;
+}
+
+
+/*!
+   \brief The signal-to-noise ratio of the sum of \a accums accumulations,
+   zero if it can not be estimated yet.
+ */
+double AdaptiveAccumulation::snr(int accums) const
+{
+    if (count_ < 2 || accums < 1) {
+        return 0.0;
+    }
+    const double mean = signal_sum_ / accums_sum_;
+    const double variance = (weighted_squares_ - signal_sum_ * mean) / (count_ - 1);
+    if (variance <= 0.0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return mean * std::sqrt(static_cast<double>(accums) / variance);
+}
+
+
+bool AdaptiveAccumulation::targetReached(int accums) const
+{
+    return accums >= std::max(2, params_.minAccums) && snr(accums) >= params_.targetSnr;
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
@@ -0,0 +1,49 @@
+#ifndef BIOMOLECULES_SPEXPERT_ADAPTIVEACCUMULATION_H_
+#define BIOMOLECULES_SPEXPERT_ADAPTIVEACCUMULATION_H_
+
+#include <QVariantList>
+#include <QVector>
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+struct AdaptiveAccumulationParams
+{
+    bool enabled;
+    double targetSnr;
+    double maxTime;    // total exposure time in seconds, non-positive means the requested one
+    int minAccums;
+    int regionFrom;    // first pixel of the region of interest
+    int regionTo;      // last pixel of the region, negative means the end
+};
+
+class AdaptiveAccumulation
+{
+public:
+    explicit AdaptiveAccumulation(const AdaptiveAccumulationParams& params);
+
+    static int maxAccums(const AdaptiveAccumulationParams& params, double exposure, int accums);
+
+    void reset();
+    bool add(const QVariantList& frame, int x, int y, int accums);
+    bool targetReached(int accums) const;
+    double snr(int accums) const;
+    int count() const { return count_; }
+
+private:
+    AdaptiveAccumulationParams params_;
+    QVector<double> previous_;  // region of interest of the last readout
+    int previous_accums_;
+    int count_;
+    double signal_sum_;
+    double accums_sum_;
+    double weighted_squares_;
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_ADAPTIVEACCUMULATION_H_
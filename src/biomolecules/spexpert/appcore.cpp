@@ -17,6 +17,9 @@
 #include "waittasks.h"
 #include "waittasklist.h"
 #include "relay.h"
+#include "darklibrary.h"
+#include "driftmonitor.h"
+#include "spectrumpipeline.h"
 #include "timespan.h"
 
 #include <QTimer>
@@ -27,6 +30,24 @@
 
 #include <QDir>
 
+namespace {
+
+// setting the same text or style sheet relayouts the label and reparses the
+// style sheet, so they are set only when they differ
+void setLabelText(QLabel *label, const QString &text)
+{
+    if (label->text() != text)
+        label->setText(text);
+}
+
+void setLabelStyle(QLabel *label, const QString &style)
+{
+    if (label->styleSheet() != style)
+        label->setStyleSheet(style);
+}
+
+} // namespace
+
 //AppCore::AppCore(QObject *parent) :
 //    AppCore(parent, nullptr)
 //{
@@ -85,13 +106,20 @@ AppCore::AppCore(CentralWidget *centralWidget, QStatusBar* sb, MainWindow *mainW
     connect(appState_, &AppState::measTAdded, this, &AppCore::updateMeasPlot);
     connect(appState_, &AppState::readTAdded, this, &AppCore::updateReadPlot);
     connect(appState_, &AppState::plotTypeChanged, this, &AppCore::plotTypeChanged);
+    connect(appState_->spectrumPipeline(), &biomolecules::spexpert::core::SpectrumPipeline::spectrumProcessed,
+            this, &AppCore::onSpectrumProcessed);
     connect(taskScheduler, &ExpTaskList::finished, this, &AppCore::onTaskSchedulerFinished);
     connect(appState_->neslab(), &Neslab::readSetpointFinished, this, &AppCore::onReadTSetpoint);
 
+    // the status bar is redrawn only after the status changes, at most once
+    // per the timer interval
     appTimer = new QTimer(this);
+    appTimer->setSingleShot(true);
+    appTimer->setInterval(300);
 
     connect(appTimer, &QTimer::timeout, this, &AppCore::updateApp);
-    appTimer->start(300);
+    connect(appState_, &AppState::statusChanged, this, &AppCore::onStatusChanged);
+    appTimer->start();
 }
 
 AppState *AppCore::appState()
@@ -341,6 +369,7 @@ void AppCore::startExperiment()
                 appState_, &AppState::setT);
         emit startReadingTemperature();
     }
+    centralWidget_->plotProxy->clearWaterfall();
     if (appState_->initWinSpecParams()->tExp.tExp) {
         appState_->startMeasT();
         centralWidget_->plotProxy->onPlotTemperatures();
@@ -355,6 +384,14 @@ void AppCore::startExperiment()
     appState_->measurementLog()->saveHeader();
     appState_->setCurrExpNumber(0);
     appState_->waitingStartedTime(); // nastavim cas, od ktereho se odpocitava.
+    appState_->spectrumPipeline()->rebuildStages();
+    appState_->spectrumPipeline()->driftMonitor()->reset();
+    if (appState_->spectrumPipeline()->processingParams().archive) {
+        appState_->spectrumPipeline()->setArchiveFileName(params->expe.at(0).directory % QDir::separator()
+                                                          % params->expe.at(0).fileNameBase % ".spa");
+    } else {
+        appState_->spectrumPipeline()->setArchiveFileName(QString());
+    }
 
     ExpTaskListTraits::TaskItem taskItem;
     WaitTaskList *waitTaskList = new WaitTaskList(this);
@@ -537,53 +574,57 @@ void AppCore::plotTypeChanged()
 
 void AppCore::updateApp()
 {
+    // one snapshot per tick, read without waiting for the device threads
+    std::shared_ptr<const AppStateTraits::Status> st = appState_->takeStatus();
     QString status;
     status.append(tr("WinSpec: "));
-    switch (appState_->winSpecState())
+    switch (st->winSpecState)
     {
     case AppStateTraits::WinSpecState::Ready :
         status.append(tr("Ready"));
-        winSpecStatusBarLabel->setText("Winspec: Ready");
-        winSpecStatusBarLabel->setStyleSheet("color: green");
+        setLabelText(winSpecStatusBarLabel, "Winspec: Ready");
+        setLabelStyle(winSpecStatusBarLabel, "color: green");
         break;
     case AppStateTraits::WinSpecState::Running :
         status.append(tr("Running, Accum %1/%2, Frame %3/%4")
-                      .arg(appState_->getCurrAccum())
-                      .arg(appState_->expParamsAt(appState_->getCurrExpNumber())->getLastAccums())
-                      .arg(appState_->getCurrFrame())
-                      .arg(appState_->expParamsAt(appState_->getCurrExpNumber())->getLastFrames()));
-        winSpecStatusBarLabel->setText(status);
-        winSpecStatusBarLabel->setStyleSheet("color: red");
+                      .arg(st->currAccum)
+                      .arg(st->accums)
+                      .arg(st->currFrame)
+                      .arg(st->frames));
+        setLabelText(winSpecStatusBarLabel, status);
+        setLabelStyle(winSpecStatusBarLabel, "color: red");
         break;
 //    case AppState::WinSpecState::Waiting :
 //        status.append(tr("Waiting: %1").arg(appState->getRemainingWait().toString()));
     }
-    WaitTaskListTraits::WaitFor ws = appState_->waitingState();
+    WaitTaskListTraits::WaitFor ws = st->waitingState;
     if (ws != WaitTaskListTraits::WaitFor::None) {
 //        status.append(tr(" : waiting %1").arg(appState->getRemainingWait().toString()));
         if (static_cast<bool>(ws & WaitTaskListTraits::WaitFor::Delay))
         {
             TimeSpan rw = appState_->getRemainingWait();
             if (rw.toMSec() > 0) {
-                waitingStatusBarLabel->setStyleSheet("color: green");
+                setLabelStyle(waitingStatusBarLabel, "color: green");
             } else {
-                waitingStatusBarLabel->setStyleSheet("color: red");
+                setLabelStyle(waitingStatusBarLabel, "color: red");
             }
-            waitingStatusBarLabel->setText(tr("waiting %1").arg(rw.toString()));
+            setLabelText(waitingStatusBarLabel, tr("waiting %1").arg(rw.toString()));
             waitingStatusBarLabel->show();
+            // the remaining time counts down without any status change
+            appTimer->start();
         } else {
             waitingStatusBarLabel->hide();
         }
         if (static_cast<bool>(ws & WaitTaskListTraits::WaitFor::Motor))
         {
-            stagePosStatusBarLabel->setText(tr("stage: %1").arg(appState_->getCurrStagePos()));
+            setLabelText(stagePosStatusBarLabel, tr("stage: %1").arg(st->currStagePos));
             stagePosStatusBarLabel->show();
         } else {
             stagePosStatusBarLabel->hide();
         }
         if (static_cast<bool>(ws & WaitTaskListTraits::WaitFor::Grating))
         {
-            gratingPosStatusBarLabel->setText(tr("grating: %1").arg(0));
+            setLabelText(gratingPosStatusBarLabel, tr("grating: %1").arg(0));
             gratingPosStatusBarLabel->show();
         } else {
             gratingPosStatusBarLabel->hide();
@@ -593,8 +634,8 @@ void AppCore::updateApp()
         stagePosStatusBarLabel->hide();
         gratingPosStatusBarLabel->hide();
     }
-    if (appState_->tState() == AppStateTraits::TState::Reading) {
-        temperatureStatusBarLabel -> setText(tr("%1 °C").arg(appState_->lastT(), 0, 'f', 2));
+    if (st->tState == AppStateTraits::TState::Reading) {
+        setLabelText(temperatureStatusBarLabel, tr("%1 °C").arg(st->lastT, 0, 'f', 2));
     }
     if (static_cast<bool>(ws & WaitTaskListTraits::WaitFor::WinSpec))
         status.append(tr(" : !!!WinSpec bezi, zastavte ho!!!"));
@@ -602,6 +643,24 @@ void AppCore::updateApp()
     //    mainStatusBar->showMessage(status);
 }
 
+void AppCore::setWaterfallView(bool on)
+{
+    centralWidget_->plotProxy->setWaterfallView(on, appState_);
+}
+
+void AppCore::onSpectrumProcessed(bool processed, const QVector<QVector<double> > &waterfallRows,
+                                  const QVector<double> &axis)
+{
+    Q_UNUSED(processed);
+    centralWidget_->plotProxy->appendWaterfall(waterfallRows, axis);
+}
+
+void AppCore::onStatusChanged()
+{
+    if (!appTimer->isActive())
+        appTimer->start();
+}
+
 void AppCore::onTaskSchedulerFinished()
 {
     qDebug() << "AppCore::onTaskSchedulerFinished()";
@@ -614,6 +673,17 @@ void AppCore::onTaskSchedulerFinished()
     temperatureStatusBarLabel->hide();
     messageStatusBarLabel->setText("Ready");
     messageStatusBarLabel->setStyleSheet("color: green");
+    QVector<biomolecules::spexpert::core::StageTiming> timings = appState_->spectrumPipeline()->stageTimings();
+    for (const biomolecules::spexpert::core::StageTiming &timing : timings) {
+        if (timing.calls) {
+            qDebug() << "AppCore::onTaskSchedulerFinished(): stage" << timing.name << ":" << timing.calls
+                     << "calls, mean" << timing.totalNSec / timing.calls / 1000 << "us, max"
+                     << timing.maxNSec / 1000 << "us";
+        }
+    }
+    if (appState_->measurementLog()) {
+        appState_->measurementLog()->saveStageTimings(timings);
+    }
     appState_->clearMeasurementLog();
     appState_->removeWaitingState(~WaitTaskListTraits::WaitFor::None);
     emit experimentFinished();
@@ -656,6 +726,12 @@ void AppCore::onRelayConnectionFailed()
     QMessageBox::critical(centralWidget_, tr("Connection failed!"), tr("Relay connection failed!"), QMessageBox::Ok);
 }
 
+// shows the error of a task, which may come from another thread
+void AppCore::showCritical(const QString &title, const QString &text)
+{
+    QMessageBox::critical(mainWindow_, title, text, QMessageBox::Ok);
+}
+
 bool AppCore::expAutoCal()
 {
     if (appState()->initWinSpecParams()->extRan.extendedRange) {
@@ -979,6 +1055,13 @@ void AppCore::buildInitialExpTaks(WaitTaskList *waitTaskList)
     if (params->tExp.tExp) {
         WaitTaskListTraits::TaskItem waitTaskItem;
         ForkJoinTask * forkJoinTask;
+        // missing darks are acquired while the bath settles
+        biomolecules::spexpert::core::DarkLibraryParams darkParams =
+                appState_->spectrumPipeline()->darkLibrary()->params();
+        bool idleDarks = WinSpecTasks::DarkExpList::idleAcquisition(appState_);
+        if (darkParams.enabled && darkParams.idleAcquisition && !idleDarks) {
+            qWarning() << "AppCore::buildInitialExpTaks(): the idle darks need the dark shutter relay, skipping them.";
+        }
         if (params->cal.at(0).autoCal && params->tExp.initDelayMeas) {
             taskItem.task = new StartWaitingTask(
                         appState_, &params->tExp.initDelay, this);
@@ -1023,6 +1106,12 @@ void AppCore::buildInitialExpTaks(WaitTaskList *waitTaskList)
                     ExpTaskListTraits::TaskType::StageControlSendToPos;
             forkJoinTask->addTask(taskItem, 1);
 
+            if (idleDarks) {
+                taskItem.task = new WinSpecTasks::DarkExpList(appState_, 0, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecDarkExpList;
+                forkJoinTask->addTask(taskItem, 1);
+            }
+
             taskItem.task = forkJoinTask;
             taskItem.taskType = ExpTaskListTraits::TaskType::ForkJoin;
             waitTaskList->addTask(taskItem);
@@ -1094,20 +1183,49 @@ void AppCore::buildInitialExpTaks(WaitTaskList *waitTaskList)
                 waitTaskList->addTask(taskItem);
             }
 
-            waitTaskItem.task = new DelayWaitTask(
-                        appState_, &params->tExp.initDelay, this);
-            waitTaskItem.waitFor = WaitTaskListTraits::WaitFor::Delay;
-            taskItem.task = new WaitExpTask(waitTaskItem, this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::WaitExp;
-            waitTaskList->addTask(taskItem);
+            if (idleDarks) {
+                taskItem.task = new NeslabTasks::SetT(appState_, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::NeslabSetT;
+                waitTaskList->addTask(taskItem);
 
-            taskItem.task = new NeslabTasks::SetT(appState_, this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::NeslabSetT;
-            waitTaskList->addTask(taskItem);
+                forkJoinTask = new ForkJoinTask(2, this);
 
-            taskItem.task = new WaitingTask(this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::Waiting;
-            waitTaskList->addTask(taskItem);
+                // thread no. 0
+                waitTaskItem.task = new DelayWaitTask(
+                            appState_, &params->tExp.initDelay, this);
+                waitTaskItem.waitFor = WaitTaskListTraits::WaitFor::Delay;
+                taskItem.task = new WaitExpTask(waitTaskItem, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::WaitExp;
+                forkJoinTask->addTask(taskItem, 0);
+
+                taskItem.task = new WaitingTask(this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::Waiting;
+                forkJoinTask->addTask(taskItem, 0);
+
+                // thread no. 1
+                taskItem.task = new WinSpecTasks::DarkExpList(appState_, 0, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecDarkExpList;
+                forkJoinTask->addTask(taskItem, 1);
+
+                taskItem.task = forkJoinTask;
+                taskItem.taskType = ExpTaskListTraits::TaskType::ForkJoin;
+                waitTaskList->addTask(taskItem);
+            } else {
+                waitTaskItem.task = new DelayWaitTask(
+                            appState_, &params->tExp.initDelay, this);
+                waitTaskItem.waitFor = WaitTaskListTraits::WaitFor::Delay;
+                taskItem.task = new WaitExpTask(waitTaskItem, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::WaitExp;
+                waitTaskList->addTask(taskItem);
+
+                taskItem.task = new NeslabTasks::SetT(appState_, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::NeslabSetT;
+                waitTaskList->addTask(taskItem);
+
+                taskItem.task = new WaitingTask(this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::Waiting;
+                waitTaskList->addTask(taskItem);
+            }
 
             taskItem.task = new FinishWaitingTask(appState_, this);
             taskItem.taskType = ExpTaskListTraits::TaskType::FinishWaiting;
@@ -1237,14 +1355,8 @@ void AppCore::buildBodyExpTasks(WaitTaskList *waitTaskList)
             taskItem.taskType = ExpTaskListTraits::TaskType::StartWaiting;
             waitTaskList->addTask(taskItem);
 
-            taskItem.task = new StageTasks::GoToPosExpList(appState_,
-                        StageControlTraits::PosType::Calibration, this);
-            taskItem.taskType =
-                    ExpTaskListTraits::TaskType::StageControlGoToPosExpList;
-            waitTaskList->addTask(taskItem);
-
-            taskItem.task = new WinSpecTasks::ExpList(appState_, true, 0, this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
+            taskItem.task = new WinSpecTasks::CalExpList(appState_, 0, this);
+            taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecCalExpList;
             waitTaskList->addTask(taskItem);
 
             taskItem.task = new StageTasks::GoToPosExpList(appState_,
@@ -3,6 +3,7 @@
 
 #include <QObject>
 #include <QDebug>
+#include <QVector>
 
 // forward declarations
 class ExpTaskList;
@@ -74,11 +75,16 @@ public slots:
     void updateReadPlot();
     void plotTypeChanged();
     void updateApp();
+    void onStatusChanged();
     void onTaskSchedulerFinished();
     void onReadTSetpoint(double t);
     void onReadExpT(double t);
     void onNeslabConnectionFailed();
     void onRelayConnectionFailed();
+    void showCritical(const QString &title, const QString &text);
+    void setWaterfallView(bool on);
+    void onSpectrumProcessed(bool processed, const QVector<QVector<double> > &waterfallRows,
+                             const QVector<double> &axis);
 
 private:
     bool expAutoCal();
@@ -11,6 +11,11 @@
 #include "timespan.h"
 #include "exptasks.h"
 #include "relay.h"
+#include "adaptiveaccumulation.h"
+#include "autoexposure.h"
+#include "framecheck.h"
+#include "spefile.h"
+#include "spectrumpipeline.h"
 #include <QDebug>
 #include <QMutex>
 #include <QFile>
@@ -28,7 +33,11 @@ AppState::AppState(AppCore *appCore, QObject *parent)
     relaySettings_{new biomolecules::spexpert::relay::Settings{
         biomolecules::sprelay::core::k8090::RelayID::One,  // calibration lamp_switch_id
         true,                                              // calibration_lamp_switch_on
-        1000                                               // calibration_lamp_switch_delay_msec
+        1000,                                              // calibration_lamp_switch_delay_msec
+        false,                                             // dark_shutter_switch_enabled
+        biomolecules::sprelay::core::k8090::RelayID::Two,  // dark_shutter_switch_id
+        true,                                              // dark_shutter_switch_on
+        500                                                // dark_shutter_switch_delay_msec
     }}
 {
     qDebug() << "Startuji AppState...";
@@ -37,6 +46,28 @@ AppState::AppState(AppCore *appCore, QObject *parent)
     stageControl_ = new StageControl;
     neslab_ = new Neslab;
     measurementLog_ = nullptr;
+    spectrumPipeline_ = new biomolecules::spexpert::core::SpectrumPipeline(this);
+    connect(spectrumPipeline_, &biomolecules::spexpert::core::SpectrumPipeline::spectrumProcessed,
+            this, &AppState::setSpectrumChanged);
+    autoExposure_ = new biomolecules::spexpert::core::AutoExposure;
+    speWriter_ = new biomolecules::spexpert::core::SpeWriter;
+    frameCheckParams_ = new biomolecules::spexpert::core::FrameCheckParams{
+        false,                                                   // enabled
+        65535,                                                   // fullScale
+        0,                                                       // maxSaturated
+        0.2,                                                     // collapseFraction
+        biomolecules::spexpert::core::FrameCheckAction::Flag,    // action
+        1                                                        // maxRetries
+    };
+    adaptiveAccumulationParams_ = new biomolecules::spexpert::core::AdaptiveAccumulationParams{
+        false,  // enabled
+        100.0,  // targetSnr
+        0.0,    // maxTime
+        2,      // minAccums
+        0,      // regionFrom
+        -1      // regionTo
+    };
+    nativeSpe_ = false;
 
     lastFrame = new LockableFrame;
     blLastFrameChanged = false;
@@ -58,14 +89,9 @@ AppState::AppState(AppCore *appCore, QObject *parent)
 
     lastGrPosMutex = new QMutex;
 
-    currAccum = 0;
-    currFrame = 0;
-    currExpParamMutex = new QMutex;
-
-    tStateMutex = new QMutex;
-
-    currStagePos_ = 0;
-    stageStateMutex = new QMutex;
+    status_ = std::make_shared<const AppStateTraits::Status>();
+    statusMutex_ = new QMutex;
+    statusChangePending_ = false;
 
     measStartedTime = new QDateTime;
     measStartedMutex = new QMutex;
@@ -79,9 +105,6 @@ AppState::AppState(AppCore *appCore, QObject *parent)
     waitFinishTime = new QDateTime;
     waitFinishMutex = new QMutex;
 
-    waitingState_ = WaitTaskListTraits::WaitFor::None;
-    waitingStateMutex_ = new QMutex;
-
     xSpectrumShift = 50;
     ySpectrumShift = 1000;
 
@@ -120,7 +143,7 @@ void AppState::startMeasT()
     tReadTs_.clear();
     measTs_.clear();
     tMeasTs_.clear();
-    tYMax_ = std::numeric_limits<double>::min();
+    tYMax_ = std::numeric_limits<double>::lowest();
     tYMin_ = std::numeric_limits<double>::max();
     qDebug() << "AppState::startMeasT(): finished";
 }
@@ -325,6 +348,31 @@ biomolecules::sprelay::core::k8090::K8090* AppState::k8090()
     return k8090_;
 }
 
+biomolecules::spexpert::core::SpectrumPipeline* AppState::spectrumPipeline()
+{
+    return spectrumPipeline_;
+}
+
+biomolecules::spexpert::core::AutoExposure* AppState::autoExposure()
+{
+    return autoExposure_;
+}
+
+biomolecules::spexpert::core::SpeWriter* AppState::speWriter()
+{
+    return speWriter_;
+}
+
+biomolecules::spexpert::core::FrameCheckParams* AppState::frameCheckParams()
+{
+    return frameCheckParams_;
+}
+
+biomolecules::spexpert::core::AdaptiveAccumulationParams* AppState::adaptiveAccumulationParams()
+{
+    return adaptiveAccumulationParams_;
+}
+
 MeasurementLog *AppState::measurementLog()
 {
     return measurementLog_;
@@ -345,6 +393,20 @@ int AppState::lastGrPos()
     return lastGrPos_;
 }
 
+// window of the extended range experiment at the last grating position, -1
+// if the experiment has a single window
+int AppState::lastWindow()
+{
+    if (!initWinSpecParams_.extRan.extendedRange || initWinSpecParams_.expe.size() < 2)
+        return -1;
+    int grPos = lastGrPos();
+    for (int ii = 0; ii < initWinSpecParams_.expe.size(); ++ii) {
+        if (initWinSpecParams_.expe.at(ii).grPos == grPos)
+            return ii;
+    }
+    return -1;
+}
+
 AppStateTraits::InitWinSpecParams *AppState::initWinSpecParams()
 {
     return &initWinSpecParams_;
@@ -415,61 +477,76 @@ bool AppState::spectrumChanged() const
 
 void AppState::addWaitingState(WaitTaskListTraits::WaitFor ws)
 {
-    QMutexLocker locker(waitingStateMutex_);
-    waitingState_ |= ws;
+    QMutexLocker locker(statusMutex_);
+    AppStateTraits::Status st = *status_;
+    st.waitingState |= ws;
+    publishStatus(st);
 }
 
 void AppState::removeWaitingState(WaitTaskListTraits::WaitFor ws)
 {
-    QMutexLocker locker(waitingStateMutex_);
-    waitingState_ &= ~ws;
+    QMutexLocker locker(statusMutex_);
+    AppStateTraits::Status st = *status_;
+    st.waitingState &= ~ws;
+    publishStatus(st);
+}
+
+// The status is kept in an immutable AppStateTraits::Status, which the setters
+// copy, modify and publish as a whole under statusMutex_. The readers, above
+// all AppCore::updateApp(), only load the current snapshot, so they never
+// wait for the device threads and see the fields consistent with each other.
+std::shared_ptr<const AppStateTraits::Status> AppState::status() const
+{
+    return std::atomic_load(&status_);
+}
+
+// Like status(), but the next change emits statusChanged() again. The changes
+// published meanwhile are coalesced into the single pending notification.
+std::shared_ptr<const AppStateTraits::Status> AppState::takeStatus()
+{
+    statusChangePending_ = false;
+    return std::atomic_load(&status_);
 }
 
 int AppState::getCurrAccum() const
 {
-    QMutexLocker locker(currExpParamMutex);
-    return currAccum;
+    return status()->currAccum;
 }
 
 int AppState::getCurrFrame() const
 {
-    QMutexLocker locker(currExpParamMutex);
-    return currFrame;
+    return status()->currFrame;
 }
 
 int AppState::getCurrExpNumber() const
 {
-    QMutexLocker locker(currExpParamMutex);
-    return currExpNumber;
+    return status()->currExpNumber;
 }
 
 int AppState::getCurrStagePos() const
 {
-    QMutexLocker locker(stageStateMutex);
-    return currStagePos_;
+    return status()->currStagePos;
 }
 
 TimeSpan AppState::getRemainingWait() const
 {
-    return getWaitingFinishTime() - QDateTime::currentDateTime();
+    TimeSpan timeSpan;
+    return timeSpan.fromMSec(int(status()->waitFinishMSecs - QDateTime::currentMSecsSinceEpoch()));
 }
 
 AppStateTraits::WinSpecState AppState::winSpecState() const
 {
-    QMutexLocker locker(currExpParamMutex);
-    return enumWinSpecState;
+    return status()->winSpecState;
 }
 
 AppStateTraits::TState AppState::tState() const
 {
-    QMutexLocker locker(tStateMutex);
-    return tState_;
+    return status()->tState;
 }
 
 WaitTaskListTraits::WaitFor AppState::waitingState() const
 {
-    QMutexLocker locker(waitingStateMutex_);
-    return waitingState_;
+    return status()->waitingState;
 }
 
 QDateTime AppState::getMeasurementStartedTime() const
@@ -513,7 +590,12 @@ NeslabusWidgets::AutoReadT::Settings *AppState::autoReadTSettings() const
 
 double AppState::lastT() const
 {
-    return lastT_;
+    return status()->lastT;
+}
+
+bool AppState::nativeSpe() const
+{
+    return nativeSpe_;
 }
 
 void AppState::setLastExpParams(double expo, int acc, int frm, const QString &fn)
@@ -525,6 +607,13 @@ void AppState::setLastExpParams(double expo, int acc, int frm, const QString &fn
     lastAcc_ = acc;
     lastFrm_ = frm;
     lastFN_ = fn;
+    locker.unlock();
+
+    QMutexLocker statusLocker(statusMutex_);
+    AppStateTraits::Status st = *status_;
+    st.accums = acc;
+    st.frames = frm;
+    publishStatus(st);
 }
 
 void AppState::setLastGrPos(int gp)
@@ -577,34 +666,49 @@ void AppState::setCurrExpParams(int currAccum_, int currFrame_, AppStateTraits::
 //        qDebug() << "AppState::setCurrExpParams(): Nastavuji WinSpecState na neco divneho";
     }
 
-    QMutexLocker locker(currExpParamMutex);
-    currAccum = currAccum_;
-    currFrame = currFrame_;
-    enumWinSpecState = enumWinSpecState_;
+    QMutexLocker locker(statusMutex_);
+    AppStateTraits::Status st = *status_;
+    // polled by the wait tasks, unchanged progress wakes no one
+    if (st.currAccum == currAccum_ && st.currFrame == currFrame_ && st.winSpecState == enumWinSpecState_)
+        return;
+    st.currAccum = currAccum_;
+    st.currFrame = currFrame_;
+    st.winSpecState = enumWinSpecState_;
+    publishStatus(st);
 }
 
 void AppState::setCurrStageState(int currPos)
 {
-    QMutexLocker locker(stageStateMutex);
-    currStagePos_ = currPos;
+    QMutexLocker locker(statusMutex_);
+    AppStateTraits::Status st = *status_;
+    if (st.currStagePos == currPos)
+        return;
+    st.currStagePos = currPos;
+    publishStatus(st);
 }
 
 void AppState::setCurrAccum(int currAccum_)
 {
-    QMutexLocker locker(currExpParamMutex);
-    currAccum = currAccum_;
+    QMutexLocker locker(statusMutex_);
+    AppStateTraits::Status st = *status_;
+    st.currAccum = currAccum_;
+    publishStatus(st);
 }
 
 void AppState::setCurrFrame(int currFrame_)
 {
-    QMutexLocker locker(currExpParamMutex);
-    currFrame = currFrame_;
+    QMutexLocker locker(statusMutex_);
+    AppStateTraits::Status st = *status_;
+    st.currFrame = currFrame_;
+    publishStatus(st);
 }
 
 void AppState::setCurrExpNumber(int currExpNumber_)
 {
-    QMutexLocker locker(currExpParamMutex);
-    currExpNumber = currExpNumber_;
+    QMutexLocker locker(statusMutex_);
+    AppStateTraits::Status st = *status_;
+    st.currExpNumber = currExpNumber_;
+    publishStatus(st);
 }
 
 void AppState::setWinSpecState(AppStateTraits::WinSpecState enumWinSpecState_)
@@ -617,20 +721,26 @@ void AppState::setWinSpecState(AppStateTraits::WinSpecState enumWinSpecState_)
         break;
     }
 
-    QMutexLocker locker(currExpParamMutex);
-    enumWinSpecState = enumWinSpecState_;
+    QMutexLocker locker(statusMutex_);
+    AppStateTraits::Status st = *status_;
+    st.winSpecState = enumWinSpecState_;
+    publishStatus(st);
 }
 
 void AppState::setTState(AppStateTraits::TState ts)
 {
-    QMutexLocker locker(tStateMutex);
-    tState_ = ts;
+    QMutexLocker locker(statusMutex_);
+    AppStateTraits::Status st = *status_;
+    st.tState = ts;
+    publishStatus(st);
 }
 
 void AppState::setWaitingState(WaitTaskListTraits::WaitFor ws)
 {
-    QMutexLocker locker(waitingStateMutex_);
-    waitingState_ = ws;
+    QMutexLocker locker(statusMutex_);
+    AppStateTraits::Status st = *status_;
+    st.waitingState = ws;
+    publishStatus(st);
 }
 
 void AppState::measurementStartedTime()
@@ -655,7 +765,13 @@ void AppState::setWaitingFinishTime(const TimeSpan & delay)
 {
     QMutexLocker locker(waitFinishMutex);
     *waitFinishTime = getWaitingStartedTime().addMSecs(delay.toMSec());
+    qint64 waitFinishMSecs = waitFinishTime->toMSecsSinceEpoch();
+    locker.unlock();
 
+    QMutexLocker statusLocker(statusMutex_);
+    AppStateTraits::Status st = *status_;
+    st.waitFinishMSecs = waitFinishMSecs;
+    publishStatus(st);
 }
 
 void AppState::setAutoReadTSettings(const NeslabusWidgets::AutoReadT::Settings &s)
@@ -670,6 +786,11 @@ void AppState::setStageParamsToStage()
     stageControl_->setMeasPos(stageParams_->calPos, stageParams_->calRefType);
 }
 
+void AppState::setNativeSpe(bool native)
+{
+    nativeSpe_ = native;
+}
+
 void AppState::setLastFrameChanged(bool blLastFrameChanged_)
 {
 //    qDebug() << "Nastavuji LastFrameChanged v AppState...";
@@ -702,14 +823,37 @@ void AppState::setSpectrumChanged(bool blSpectrumChanged_)
 
 void AppState::setT(double t)
 {
-    lastT_ = t;
+    QMutexLocker locker(statusMutex_);
+    AppStateTraits::Status st = *status_;
+    st.lastT = t;
+    publishStatus(st);
+    locker.unlock();
+
     if (plotStyle_ == AppStateTraits::PlotStyle::Temperatures) {
         addReadT(t);
     }
 }
 
+// called with statusMutex_ locked
+void AppState::publishStatus(const AppStateTraits::Status &st)
+{
+    std::atomic_store(&status_, std::shared_ptr<const AppStateTraits::Status>(
+                          std::make_shared<const AppStateTraits::Status>(st)));
+    if (!statusChangePending_.exchange(true))
+        emit statusChanged();
+}
+
 AppState::~AppState()
 {
+    // the worker publishes into the spectra below, so stop it first
+    delete spectrumPipeline_;
+
+    // writes the spectra still in the queue
+    delete speWriter_;
+
+    delete autoExposure_;
+    delete frameCheckParams_;
+    delete adaptiveAccumulationParams_;
     delete lastFrame;
     delete mutexLastFrameChanged;
 
@@ -725,11 +869,7 @@ AppState::~AppState()
 
     delete lastGrPosMutex;
 
-    delete currExpParamMutex;
-
-    delete tStateMutex;
-
-    delete stageStateMutex;
+    delete statusMutex_;
 
     delete measStartedTime;
     delete measStartedMutex;
@@ -743,8 +883,6 @@ AppState::~AppState()
     delete waitFinishTime;
     delete waitFinishMutex;
 
-    delete waitingStateMutex_;
-
     while (!expParamList_.isEmpty()) {
         delete expParamList_.takeFirst();
     }
@@ -797,6 +935,33 @@ void MeasurementLog::saveHeader()
     logFile_->close();
 }
 
+/*!
+   \brief Appends the time spent in the processing stages of the pipeline, it
+   is saved at the end of the experiment.
+ */
+void MeasurementLog::saveStageTimings(const QVector<biomolecules::spexpert::core::StageTiming> &timings)
+{
+    bool used = false;
+    for (const biomolecules::spexpert::core::StageTiming &timing : timings) {
+        used = used || timing.calls;
+    }
+    if (!used || !logFile_->open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Append))
+        return;
+    *logTextStream << tr("Processing stages:\n%1 %2 %3 %4\n")
+                      .arg("stage", 20).arg("calls", 8)
+                      .arg("mean(us)", 10).arg("max(us)", 10);
+    for (const biomolecules::spexpert::core::StageTiming &timing : timings) {
+        if (timing.calls) {
+            *logTextStream << tr("%1 %2 %3 %4\n")
+                              .arg(timing.name, 20).arg(timing.calls, 8)
+                              .arg(timing.totalNSec / timing.calls / 1000, 10)
+                              .arg(timing.maxNSec / 1000, 10);
+        }
+    }
+    logTextStream->flush();
+    logFile_->close();
+}
+
 void MeasurementLog::saveMeasurement()
 {
     if (saveExpParams_ && ((saveTs_ && saveT_) || !saveTs_) &&
@@ -843,15 +1008,35 @@ void MeasurementLog::setSaveGrPos(double grPos)
     }
 }
 
+/*!
+   \brief Sets the note appended to the next saved measurement, e.g. the
+   problems found during its acquisition, which is logged after it finishes.
+ */
+void MeasurementLog::setNote(const QString &note)
+{
+    note_ = note;
+}
+
+/*!
+   \brief Sets the start of the next saved measurement, which is logged after
+   the acquisition.
+ */
+void MeasurementLog::setMeasTime(const QDateTime &time)
+{
+    *dateTime_ = time;
+}
+
 void MeasurementLog::saveToFile()
 {
     if (!logFile_->open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Append))
         return;
     *logTextStream << tr("%1 %2 %3 %4 %5")
-                      .arg(QDateTime::currentDateTime().toString(tr("dd.MM.yyyy' 'hh:mm:ss")))
+                      .arg((dateTime_->isValid() ? *dateTime_ : QDateTime::currentDateTime())
+                           .toString(tr("dd.MM.yyyy' 'hh:mm:ss")))
                       .arg(measFile_->fileName(), 20)
                       .arg(exp_, 10, 'f', 3).arg(acc_, 5).arg(frm_, 5);
     saveExpParams_ = false;
+    *dateTime_ = QDateTime();
     if (saveTs_) {
         *logTextStream << tr(" %1").arg(t_, 5);
         saveT_ = false;
@@ -860,6 +1045,10 @@ void MeasurementLog::saveToFile()
         *logTextStream << tr(" %1").arg(grPos_, 10);
         saveGrPos_ = false;
     }
+    if (!note_.isEmpty()) {
+        *logTextStream << " " << note_;
+        note_.clear();
+    }
     *logTextStream << "\n";
     logTextStream->flush();
     logFile_->close();
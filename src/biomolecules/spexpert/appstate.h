@@ -1,6 +1,9 @@
 #ifndef APPSTATE_H
 #define APPSTATE_H
 
+#include <atomic>
+#include <memory>
+
 #include <QObject>
 
 #include "waittasklist.h"
@@ -47,6 +50,14 @@ namespace spexpert {
 namespace relay {
 struct Settings;
 }
+namespace core {
+struct AdaptiveAccumulationParams;
+class AutoExposure;
+struct FrameCheckParams;
+class SpectrumPipeline;
+class SpeWriter;
+struct StageTiming;
+}
 }
 }
 
@@ -147,6 +158,7 @@ struct ExtendedRangeParams
     bool autoFileNames;
     QString fileNameBase;
     QString directory;
+    bool serpentine;
 };
 
 struct InitWinSpecParams
@@ -158,6 +170,22 @@ struct InitWinSpecParams
     ExtendedRangeParams extRan;
 };
 
+// immutable snapshot of the experiment status, see AppState::status()
+struct Status
+{
+    WinSpecState winSpecState = WinSpecState::Ready;
+    int currAccum = 0;
+    int currFrame = 0;
+    int accums = 0;  // of the last started acquisition
+    int frames = 0;  // of the last started acquisition
+    int currExpNumber = 0;
+    WaitTaskListTraits::WaitFor waitingState = WaitTaskListTraits::WaitFor::None;
+    int currStagePos = 0;
+    TState tState = TState::None;
+    double lastT = 0.0;
+    qint64 waitFinishMSecs = 0;  // since epoch
+};
+
 }
 
 
@@ -202,8 +230,14 @@ public:
     Neslab *neslab();
     MeasurementLog *measurementLog();
     biomolecules::sprelay::core::k8090::K8090* k8090();
+    biomolecules::spexpert::core::SpectrumPipeline* spectrumPipeline();
+    biomolecules::spexpert::core::AutoExposure* autoExposure();
+    biomolecules::spexpert::core::SpeWriter* speWriter();
+    biomolecules::spexpert::core::FrameCheckParams* frameCheckParams();
+    biomolecules::spexpert::core::AdaptiveAccumulationParams* adaptiveAccumulationParams();
     void lastExpParams(double *expo, int *acc, int *frm, QString *fn);
     int lastGrPos();
+    int lastWindow();
 
     AppStateTraits::InitWinSpecParams *initWinSpecParams();
 
@@ -220,6 +254,8 @@ public:
     AppStateTraits::PlotStyle plotStyle() const;
     bool lastFrameChanged() const;
     bool spectrumChanged() const;
+    std::shared_ptr<const AppStateTraits::Status> status() const;
+    std::shared_ptr<const AppStateTraits::Status> takeStatus();
     void addWaitingState(WaitTaskListTraits::WaitFor ws);
     void removeWaitingState(WaitTaskListTraits::WaitFor ws);
     int getCurrAccum() const;
@@ -238,6 +274,7 @@ public:
     biomolecules::spexpert::relay::Settings* relaySettings();
     NeslabusWidgets::AutoReadT::Settings* autoReadTSettings() const;
     double lastT() const;
+    bool nativeSpe() const;
 
     // setters
     void setLastExpParams(double expo, int acc, int frm, const QString &fn);
@@ -259,6 +296,7 @@ public:
     void setWaitingFinishTime(const TimeSpan &delay);
     void setAutoReadTSettings(const NeslabusWidgets::AutoReadT::Settings &s);
     void setStageParamsToStage();
+    void setNativeSpe(bool native);
 
 signals:
     void plotTypeChanged();
@@ -266,6 +304,7 @@ signals:
     void spectrumChangedSignal();
     void readTAdded();
     void measTAdded();
+    void statusChanged();
 
 public slots:
     void setLastFrameChanged(bool blLastFrameChanged_);
@@ -273,12 +312,20 @@ public slots:
     void setT(double t);
 
 private:
+    void publishStatus(const AppStateTraits::Status &st);
+
     AppCore *appCore_;
     WinSpec *winSpec_;
     StageControl *stageControl_;
     Neslab *neslab_;
     MeasurementLog *measurementLog_;
     biomolecules::sprelay::core::k8090::K8090* k8090_;
+    biomolecules::spexpert::core::SpectrumPipeline* spectrumPipeline_;
+    biomolecules::spexpert::core::AutoExposure* autoExposure_;
+    biomolecules::spexpert::core::SpeWriter* speWriter_;
+    biomolecules::spexpert::core::FrameCheckParams* frameCheckParams_;
+    biomolecules::spexpert::core::AdaptiveAccumulationParams* adaptiveAccumulationParams_;
+    bool nativeSpe_;
 
     double xSpectrumShift; // shift in xscale between frames, when spectrum is ploted.
     double ySpectrumShift; // shift in yscale between frames, when spectrum is ploted.
@@ -305,19 +352,10 @@ private:
     int lastGrPos_;
     QMutex *lastGrPosMutex;
 
-    int currAccum;
-    int currFrame;
-    int currExpNumber;
-    AppStateTraits::WinSpecState enumWinSpecState;
-    QMutex * currExpParamMutex;
-
-    AppStateTraits::TState tState_;
-    QMutex * tStateMutex;
-
-    double lastT_;
-
-    int currStagePos_;
-    QMutex *stageStateMutex;
+    // written under statusMutex_ and published as a whole, read without locking
+    std::shared_ptr<const AppStateTraits::Status> status_;
+    QMutex *statusMutex_;
+    std::atomic<bool> statusChangePending_;  // statusChanged() emitted, not taken yet
 
     QDateTime * measStartedTime;
     QMutex * measStartedMutex;
@@ -331,9 +369,6 @@ private:
     QDateTime * waitFinishTime;
     QMutex * waitFinishMutex;
 
-    WaitTaskListTraits::WaitFor waitingState_;
-    QMutex *waitingStateMutex_;
-
     QList<WinSpecTasks::Params*> expParamList_;
     QMutex *expParamListMutex_;
 
@@ -375,11 +410,14 @@ public:
 
     void saveHeader();
     void saveMeasurement();
+    void saveStageTimings(const QVector<biomolecules::spexpert::core::StageTiming> &timings);
 
 public slots:
     void setExpParams(double expo, int acc, int frm, const QString &measFile);
     void setSaveT(double t);
     void setSaveGrPos(double grPos);
+    void setNote(const QString &note);
+    void setMeasTime(const QDateTime &time);
 
 private:
     void saveToFile();
@@ -399,6 +437,7 @@ private:
     double grPos_;
     bool saveGrPositions_;
     bool saveGrPos_;
+    QString note_;
 };
 
 #endif // APPSTATE_H
@@ -0,0 +1,139 @@
+#include "autoexposure.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+/*!
+   \class AutoExposure
+   \brief Chooses the exposure and the number of accumulations from a short
+   probe exposure.
+
+   The peak and the offset of the probe are the maximum and the minimum of the
+   three point median of every detector row, so a single cosmic ray hit does
+   not shorten the exposure. The signal above the offset is assumed to grow
+   linearly with the exposure, which is then chosen so the peak reaches
+   AutoExposureParams::targetFraction of AutoExposureParams::fullScale. The
+   rest of the time budget is filled by the accumulations.
+
+   The peak of a saturated probe only bounds the signal from below, so it can
+   not be extrapolated. Such a probe is rejected and lastSaturated() tells the
+   caller to repeat it with the shorterProbe() exposure. If even the shortest
+   probe saturates, AutoExposureParams::minExposure is used.
+ */
+
+AutoExposure::AutoExposure()
+    : params_{false, 0.1, 0.7, 65535, 0.01, 60.0, 0.0},
+      last_peak_{0.0},
+      last_offset_{0.0},
+      last_saturated_{false}
+{}
+
+
+/*!
+   \brief Computes the \a exposure and \a accums from the \a probe spectrum
+   acquired with the \a probeExposure.
+
+   The requested \a exposure and \a accums are used as the time budget if
+   AutoExposureParams::timeBudget is not positive.
+   \return false and leaves the parameters untouched if the probe is not
+   usable, e.g. if it contains no signal or if it is saturated and a shorter
+   probe is possible, see lastSaturated().
+ */
+bool AutoExposure::plan(const QVariantList& probe, int frames, int x, int y, double probeExposure,
+                        double* exposure, int* accums)
+{
+    last_saturated_ = false;
+    if (frames < 1 || x < 3 || y < 1 || probe.size() < x * y || probeExposure <= 0.0) {
+        return false;
+    }
+    double peak_counts;
+    double offset;
+    if (!peak(probe, x, y, &peak_counts, &offset)) {
+        return false;
+    }
+    last_peak_ = peak_counts;
+    last_offset_ = offset;
+    last_saturated_ = peak_counts >= params_.fullScale;
+    if (last_saturated_ && probeExposure > shortestProbe()) {
+        return false;
+    }
+
+    const double signal = peak_counts - offset;
+    const double target = params_.targetFraction * params_.fullScale - offset;
+    if (!last_saturated_ && (signal <= 0.0 || target <= 0.0)) {
+        return false;
+    }
+
+    double budget = params_.timeBudget;
+    if (budget <= 0.0) {
+        budget = *exposure * *accums;
+    }
+    double new_exposure = last_saturated_ ? params_.minExposure : probeExposure * target / signal;
+    new_exposure = std::max(params_.minExposure, std::min(params_.maxExposure, new_exposure));
+    if (budget > 0.0) {
+        new_exposure = std::min(new_exposure, budget);
+    }
+    // WinSpec takes the exposure in milliseconds
+    new_exposure = std::max(0.001, std::floor(new_exposure * 1000.0) / 1000.0);
+    int new_accums = 1;
+    if (budget > new_exposure) {
+        new_accums = std::max(1, static_cast<int>(budget / new_exposure + 1e-6));
+    }
+
+    *exposure = new_exposure;
+    *accums = new_accums;
+    return true;
+}
+
+
+/*!
+   \brief Returns the exposure of the probe repeated after the saturated
+   \a probeExposure, a tenth of it, but at least the shortest probe.
+ */
+double AutoExposure::shorterProbe(double probeExposure) const
+{
+    return std::max(shortestProbe(), std::floor(probeExposure * 100.0) / 1000.0);
+}
+
+
+// WinSpec takes the exposure in milliseconds
+double AutoExposure::shortestProbe() const
+{
+    return std::max(0.001, params_.minExposure);
+}
+
+
+/*!
+   \brief The WinSpec data are ordered by the pixels, the rows of the pixel
+   are neighbours.
+ */
+bool AutoExposure::peak(const QVariantList& probe, int x, int y, double* peak, double* offset)
+{
+    double max = -std::numeric_limits<double>::infinity();
+    double min = std::numeric_limits<double>::infinity();
+    for (int row = 0; row < y; ++row) {
+        for (int ii = 1; ii < x - 1; ++ii) {
+            double a = probe.at((ii - 1) * y + row).toDouble();
+            double b = probe.at(ii * y + row).toDouble();
+            double c = probe.at((ii + 1) * y + row).toDouble();
+            double median = std::max(std::min(a, b), std::min(std::max(a, b), c));
+            max = std::max(max, median);
+            min = std::min(min, median);
+        }
+    }
+    if (max < min) {
+        return false;
+    }
+    *peak = max;
+    *offset = min;
+    return true;
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
@@ -0,0 +1,51 @@
+#ifndef BIOMOLECULES_SPEXPERT_AUTOEXPOSURE_H_
+#define BIOMOLECULES_SPEXPERT_AUTOEXPOSURE_H_
+
+#include <QVariantList>
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+struct AutoExposureParams
+{
+    bool enabled;
+    double probeExposure;   // seconds
+    double targetFraction;  // peak height as a fraction of the full scale
+    int fullScale;          // saturation counts of one readout
+    double minExposure;     // seconds
+    double maxExposure;     // seconds
+    double timeBudget;      // total exposure time of one frame, non-positive means the requested one
+};
+
+class AutoExposure
+{
+public:
+    AutoExposure();
+
+    AutoExposureParams params() const { return params_; }
+    void setParams(const AutoExposureParams& params) { params_ = params; }
+
+    bool plan(const QVariantList& probe, int frames, int x, int y, double probeExposure,
+              double* exposure, int* accums);
+    double shorterProbe(double probeExposure) const;
+    double lastPeak() const { return last_peak_; }
+    double lastOffset() const { return last_offset_; }
+    bool lastSaturated() const { return last_saturated_; }
+
+private:
+    bool peak(const QVariantList& probe, int x, int y, double* peak, double* offset);
+    double shortestProbe() const;
+
+    AutoExposureParams params_;
+    double last_peak_;
+    double last_offset_;
+    bool last_saturated_;
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_AUTOEXPOSURE_H_
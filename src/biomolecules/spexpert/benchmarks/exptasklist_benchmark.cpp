@@ -0,0 +1,84 @@
+// Measures the overhead of ExpTaskList per executed task. The list is filled
+// with tasks, which finish synchronously inside their start(), so the measured
+// time is the bookkeeping of the list only.
+//
+// usage: exptasklist_benchmark [tasks count] [runs count]
+
+#include "exptasklist.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+
+namespace {
+
+class NoOpTask : public ExpTask
+{
+public:
+    explicit NoOpTask(QObject *parent = 0) : ExpTask(parent) {}
+    void start() override { emit finished(); }
+};
+
+int intArgument(const QStringList &arguments, int index, int defaultValue)
+{
+    if (arguments.size() <= index)
+        return defaultValue;
+    bool ok;
+    int value = arguments.at(index).toInt(&ok);
+    return (ok && value > 0) ? value : defaultValue;
+}
+
+double median(QVector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values.at(values.size() / 2);
+}
+
+} // unnamed namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    const int tasksN = intArgument(app.arguments(), 1, 4000);
+    const int runsN = intArgument(app.arguments(), 2, 25);
+
+    QVector<double> buildTimes;
+    QVector<double> runTimes;
+    QElapsedTimer timer;
+    for (int run = 0; run < runsN; ++run) {
+        ExpTaskList taskList;
+        bool finished = false;
+        QObject::connect(&taskList, &ExpTask::finished, [&finished] { finished = true; });
+
+        timer.start();
+        for (int ii = 0; ii < tasksN; ++ii)
+            taskList.addTask(ExpTaskListTraits::TaskItem(ExpTaskListTraits::TaskType::None, new NoOpTask));
+        buildTimes.append(static_cast<double>(timer.nsecsElapsed()) / tasksN);
+
+        timer.start();
+        taskList.start();
+        runTimes.append(static_cast<double>(timer.nsecsElapsed()) / tasksN);
+
+        if (!finished) {
+            out << "the task list did not finish synchronously\n";
+            out.flush();
+            return 1;
+        }
+    }
+
+    out << "tasks: " << tasksN << ", runs: " << runsN << '\n';
+    out << "addTask: median " << median(buildTimes) << " ns/task, min "
+        << *std::min_element(buildTimes.begin(), buildTimes.end()) << " ns/task\n";
+    out << "run:     median " << median(runTimes) << " ns/task, min "
+        << *std::min_element(runTimes.begin(), runTimes.end()) << " ns/task\n";
+
+    out.flush();
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "cosmicrayfilter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+/*!
+   \class CosmicRayFilter
+   \brief Removes cosmic ray spikes from acquired spectra.
+
+   If more frames are acquired, combine() compares every pixel across the frames
+   with their median and drops the values which exceed it by more than
+   CosmicRayParams::threshold times the expected noise. The remaining values are
+   averaged. A single frame is cleaned by removeSpikes(), which replaces narrow
+   spikes by the median of their neighbourhood. The cosmic rays only add counts
+   so only positive deviations are rejected.
+
+   The working buffers are kept between calls, so once the filter has seen the
+   detector size it does not allocate any more. The medians are selected by
+   std::nth_element in these buffers, in linear time of the frames or the
+   window.
+ */
+
+CosmicRayFilter::CosmicRayFilter(const CosmicRayParams& params)
+    : params_(params)
+{}
+
+
+/*!
+   \brief Combines \a frames into the cleaned spectrum \a out.
+   \return Number of rejected values.
+ */
+int CosmicRayFilter::combine(const QVector<QVector<double> >& frames, QVector<double>& out)
+{
+    const int frames_n = frames.size();
+    if (frames_n < 1) {
+        out.clear();
+        return 0;
+    }
+    if (frames_n == 1) {
+        return removeSpikes(frames.first(), out);
+    }
+
+    const int pixels_n = frames.first().size();
+    out.resize(pixels_n);
+    column_.resize(static_cast<std::size_t>(frames_n));
+    // lower median, for two frames it is the smaller value, which is the safe one
+    const int median_index = (frames_n - 1) / 2;
+    int rejected = 0;
+    for (int jj = 0; jj < pixels_n; ++jj) {
+        for (int ii = 0; ii < frames_n; ++ii) {
+            column_[static_cast<std::size_t>(ii)] = frames.at(ii).at(jj);
+        }
+        std::nth_element(column_.begin(), column_.begin() + median_index, column_.end());
+        const double median = column_[static_cast<std::size_t>(median_index)];
+        const double limit = median + params_.threshold * noise(median);
+
+        double sum = 0.0;
+        int accepted = 0;
+        for (int ii = 0; ii < frames_n; ++ii) {
+            const double value = frames.at(ii).at(jj);
+            if (value <= limit) {
+                sum += value;
+                ++accepted;
+            }
+        }
+        rejected += frames_n - accepted;
+        out[jj] = sum / accepted;  // the median itself is always accepted
+    }
+    return rejected;
+}
+
+
+/*!
+   \brief Replaces the spikes in single \a frame by the local median.
+   \return Number of replaced pixels.
+ */
+int CosmicRayFilter::removeSpikes(const QVector<double>& frame, QVector<double>& out)
+{
+    const int pixels_n = frame.size();
+    const int half_width = std::max(1, params_.spikeHalfWidth);
+    out.resize(pixels_n);
+    window_.resize(static_cast<std::size_t>(2 * half_width));
+    int replaced = 0;
+    for (int ii = 0; ii < pixels_n; ++ii) {
+        const int from = std::max(0, ii - half_width);
+        const int to = std::min(pixels_n - 1, ii + half_width);
+        std::size_t window_n = 0;
+        for (int jj = from; jj <= to; ++jj) {
+            if (jj != ii) {
+                window_[window_n++] = frame.at(jj);
+            }
+        }
+        const double value = frame.at(ii);
+        if (window_n == 0) {
+            out[ii] = value;
+            continue;
+        }
+        std::nth_element(window_.begin(), window_.begin() + window_n / 2, window_.begin() + window_n);
+        const double median = window_[window_n / 2];
+        const double deviation = value - median;
+        if (deviation > params_.threshold * noise(median)) {
+            // real lines are broader than the spikes, so the spike rises steeply even
+            // above its nearest neighbours
+            const double left = (ii > 0) ? frame.at(ii - 1) : median;
+            const double right = (ii < pixels_n - 1) ? frame.at(ii + 1) : median;
+            if (value - 0.5 * (left + right) > 0.3 * deviation) {
+                out[ii] = median;
+                ++replaced;
+                continue;
+            }
+        }
+        out[ii] = value;
+    }
+    return replaced;
+}
+
+
+double CosmicRayFilter::noise(double level) const
+{
+    return std::sqrt(std::max(level, 0.0) + params_.readNoise * params_.readNoise);
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
@@ -0,0 +1,43 @@
+#ifndef BIOMOLECULES_SPEXPERT_COSMICRAYFILTER_H_
+#define BIOMOLECULES_SPEXPERT_COSMICRAYFILTER_H_
+
+#include <vector>
+
+#include <QVector>
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+struct CosmicRayParams
+{
+    bool enabled;
+    double threshold;     // rejection threshold in units of the estimated noise
+    int spikeHalfWidth;   // half width of the local median window for single frames
+    double readNoise;     // detector read noise in counts
+};
+
+class CosmicRayFilter
+{
+public:
+    explicit CosmicRayFilter(const CosmicRayParams& params);
+
+    const CosmicRayParams& params() const { return params_; }
+    void setParams(const CosmicRayParams& params) { params_ = params; }
+
+    int combine(const QVector<QVector<double> >& frames, QVector<double>& out);
+    int removeSpikes(const QVector<double>& frame, QVector<double>& out);
+
+private:
+    double noise(double level) const;
+
+    CosmicRayParams params_;
+    std::vector<double> column_;
+    std::vector<double> window_;
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_COSMICRAYFILTER_H_
@@ -0,0 +1,179 @@
+#include "countspectrum.h"
+
+#include <limits>
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+/*!
+   \class CountSpectrum
+   \brief Keeps the detector counts of the acquired frames as unsigned
+   integers.
+
+   The counts of the detector rows of every pixel are summed, as by
+   WinSpec::convertSpectrum(), and stored in 16 bits if all the sums fit, in
+   32 bits otherwise. The spectrum then takes a quarter (or a half) of the
+   memory of the double precision one and it is converted only when it is
+   processed or plotted. The acquisition parameters are kept in info.
+ */
+
+CountSpectrum::CountSpectrum()
+    : info{QString{}, 0.0, 0, -1},
+      frames_{0},
+      x_{0},
+      wide_{false}
+{}
+
+
+/*!
+   \brief Sums the rows of the \a raw WinSpec data of \a frames frames of \a x
+   pixels and \a y rows, where the rows of the pixel are neighbours.
+   \return false and leaves the spectrum empty if the data do not match the
+   dimensions or a sum is not a 32 bit unsigned count.
+ */
+bool CountSpectrum::fromRaw(const QVariantList& raw, int frames, int x, int y)
+{
+    clear();
+    if (frames < 1 || x < 1 || y < 1 || raw.size() != frames * x * y) {
+        return false;
+    }
+    const int n = frames * x;
+    wide_counts_.resize(n);
+    std::uint32_t max = 0;
+    QVariantList::const_iterator it = raw.constBegin();
+    for (int ii = 0; ii < n; ++ii) {
+        qint64 sum = 0;
+        for (int row = 0; row < y; ++row, ++it) {
+            sum += it->toLongLong();
+        }
+        if (sum < 0 || sum > std::numeric_limits<std::uint32_t>::max()) {
+            wide_counts_.clear();
+            return false;
+        }
+        wide_counts_[ii] = static_cast<std::uint32_t>(sum);
+        if (wide_counts_.at(ii) > max) {
+            max = wide_counts_.at(ii);
+        }
+    }
+    frames_ = frames;
+    x_ = x;
+    narrow(max);
+    return true;
+}
+
+
+/*!
+   \brief Takes the \a counts of \a frames frames of \a x pixels, e.g. read
+   from the SpectrumArchive.
+ */
+bool CountSpectrum::fromCounts(const QVector<std::uint32_t>& counts, int frames, int x)
+{
+    clear();
+    if (frames < 1 || x < 1 || counts.size() != frames * x) {
+        return false;
+    }
+    wide_counts_ = counts;
+    frames_ = frames;
+    x_ = x;
+    std::uint32_t max = 0;
+    for (std::uint32_t count : counts) {
+        if (count > max) {
+            max = count;
+        }
+    }
+    narrow(max);
+    return true;
+}
+
+
+/*!
+   \brief Moves the counts to 16 bits if their maximum \a max fits.
+ */
+void CountSpectrum::narrow(std::uint32_t max)
+{
+    if (max > std::numeric_limits<std::uint16_t>::max()) {
+        wide_ = true;
+        return;
+    }
+    const int n = wide_counts_.size();
+    narrow_counts_.resize(n);
+    for (int ii = 0; ii < n; ++ii) {
+        narrow_counts_[ii] = static_cast<std::uint16_t>(wide_counts_.at(ii));
+    }
+    wide_counts_ = QVector<std::uint32_t>{};
+    wide_ = false;
+}
+
+
+/*!
+   \brief Converts the counts to the layout of LockableSpectrum, one vector
+   per frame.
+ */
+void CountSpectrum::toSpectrum(QVector<QVector<double> >& spectrum) const
+{
+    spectrum.resize(frames_);
+    for (int ii = 0; ii < frames_; ++ii) {
+        frame(ii, spectrum[ii]);
+    }
+}
+
+
+void CountSpectrum::frame(int index, QVector<double>& out) const
+{
+    if (index < 0 || index >= frames_) {
+        out.clear();
+        return;
+    }
+    out.resize(x_);
+    double* dst = out.data();
+    const int offset = index * x_;
+    if (wide_) {
+        const std::uint32_t* src = wide_counts_.constData() + offset;
+        for (int ii = 0; ii < x_; ++ii) {
+            dst[ii] = src[ii];
+        }
+    } else {
+        const std::uint16_t* src = narrow_counts_.constData() + offset;
+        for (int ii = 0; ii < x_; ++ii) {
+            dst[ii] = src[ii];
+        }
+    }
+}
+
+
+double CountSpectrum::at(int frame, int pixel) const
+{
+    return count(frame, pixel);
+}
+
+
+std::uint32_t CountSpectrum::count(int frame, int pixel) const
+{
+    const int index = frame * x_ + pixel;
+    return wide_ ? wide_counts_.at(index) : narrow_counts_.at(index);
+}
+
+
+void CountSpectrum::clear()
+{
+    frames_ = 0;
+    x_ = 0;
+    wide_ = false;
+    narrow_counts_ = QVector<std::uint16_t>{};
+    wide_counts_ = QVector<std::uint32_t>{};
+}
+
+
+/*!
+   \brief Memory taken by the counts.
+ */
+int CountSpectrum::bytes() const
+{
+    return narrow_counts_.size() * static_cast<int>(sizeof(std::uint16_t))
+            + wide_counts_.size() * static_cast<int>(sizeof(std::uint32_t));
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
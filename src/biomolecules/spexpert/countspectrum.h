@@ -0,0 +1,58 @@
+#ifndef BIOMOLECULES_SPEXPERT_COUNTSPECTRUM_H_
+#define BIOMOLECULES_SPEXPERT_COUNTSPECTRUM_H_
+
+#include <cstdint>
+
+#include <QString>
+#include <QVariantList>
+#include <QVector>
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+struct CountSpectrumInfo
+{
+    QString fileName;
+    double exposure;
+    int accumulations;
+    int window;       // window of the extended range experiment, -1 if none
+};
+
+class CountSpectrum
+{
+public:
+    CountSpectrum();
+
+    bool fromRaw(const QVariantList& raw, int frames, int x, int y);
+    bool fromCounts(const QVector<std::uint32_t>& counts, int frames, int x);
+    void toSpectrum(QVector<QVector<double> >& spectrum) const;
+    void frame(int index, QVector<double>& out) const;
+    double at(int frame, int pixel) const;
+    std::uint32_t count(int frame, int pixel) const;
+    void clear();
+
+    int frames() const { return frames_; }
+    int size() const { return x_; }
+    bool isEmpty() const { return frames_ == 0; }
+    bool wide() const { return wide_; }
+    int bytes() const;
+
+    CountSpectrumInfo info;
+
+private:
+    void narrow(std::uint32_t max);
+
+    int frames_;
+    int x_;
+    bool wide_;
+    QVector<std::uint16_t> narrow_counts_;
+    QVector<std::uint32_t> wide_counts_;
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_COUNTSPECTRUM_H_
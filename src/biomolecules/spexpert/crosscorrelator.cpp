@@ -0,0 +1,186 @@
+#include "crosscorrelator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+/*!
+   \class CrossCorrelator
+   \brief Estimates the shift between two spectra from the maximum of their
+   cross-correlation computed by FFT.
+
+   Both mean subtracted spectra are packed into the real and imaginary part of
+   one complex sequence zero padded to the power of two at least twice as long,
+   so a single forward and a single inverse transform give the linear
+   correlation. Its maximum is refined by the parabola or the Gaussian (the
+   parabola through the logarithms) through its neighbours.
+
+   The FFT plans (bit reversal tables and twiddle factors) are cached for every
+   transform size and the working buffers are kept between calls, so once the
+   correlator has seen the detector size it does not allocate any more. The
+   correlator is not thread safe, every thread needs its own instance.
+ */
+
+/*!
+   \brief Estimates the \a shift of \a y against \a reference, both \a n pixels
+   long, searching the lags up to \a maxLag.
+
+   The shift is positive if \a y is shifted to the higher pixels.
+   \return false if the spectra are too short or uncorrelated.
+ */
+bool CrossCorrelator::shift(const double* reference, const double* y, int n, int maxLag, PeakFit fit,
+                            double* shift)
+{
+    maxLag = std::min(maxLag, n / 2);
+    if (n < 4 || maxLag < 1) {
+        return false;
+    }
+
+    int size = 1;
+    while (size < 2 * n) {
+        size *= 2;
+    }
+    const Plan& p = plan(size);
+    packed_.resize(static_cast<std::size_t>(size));
+    product_.resize(static_cast<std::size_t>(size));
+
+    double reference_mean = 0.0;
+    double y_mean = 0.0;
+    for (int ii = 0; ii < n; ++ii) {
+        reference_mean += reference[ii];
+        y_mean += y[ii];
+    }
+    reference_mean /= n;
+    y_mean /= n;
+
+    std::complex<double>* z = packed_.data();
+    for (int ii = 0; ii < n; ++ii) {
+        z[ii] = std::complex<double>(reference[ii] - reference_mean, y[ii] - y_mean);
+    }
+    std::fill(z + n, z + size, std::complex<double>(0.0, 0.0));
+    fft(p, z, false);
+
+    // separates the transforms of both spectra, R[k] = (Z[k] + Z*[-k]) / 2,
+    // Y[k] = (Z[k] - Z*[-k]) / 2i, and multiplies conj(R) by Y
+    std::complex<double>* c = product_.data();
+    for (int kk = 0; kk < size; ++kk) {
+        const std::complex<double> zk = z[kk];
+        const std::complex<double> zm = z[(size - kk) & (size - 1)];
+        const double rr = 0.5 * (zk.real() + zm.real());
+        const double ri = 0.5 * (zk.imag() - zm.imag());
+        const double yr = 0.5 * (zk.imag() + zm.imag());
+        const double yi = -0.5 * (zk.real() - zm.real());
+        c[kk] = std::complex<double>(rr * yr + ri * yi, rr * yi - ri * yr);
+    }
+    fft(p, c, true);
+
+    correlation_.resize(static_cast<std::size_t>(2 * maxLag + 1));
+    for (int lag = -maxLag; lag <= maxLag; ++lag) {
+        correlation_[static_cast<std::size_t>(lag + maxLag)] = c[lag & (size - 1)].real() / size;
+    }
+
+    const std::size_t best = static_cast<std::size_t>(
+                std::max_element(correlation_.begin(), correlation_.end()) - correlation_.begin());
+    if (correlation_[best] <= 0.0) {
+        return false;
+    }
+    double offset = 0.0;
+    if (best > 0 && best + 1 < correlation_.size()) {
+        offset = refine(correlation_[best - 1], correlation_[best], correlation_[best + 1], fit);
+    }
+    *shift = static_cast<double>(best) - maxLag + offset;
+    return true;
+}
+
+
+const CrossCorrelator::Plan& CrossCorrelator::plan(int size)
+{
+    for (const Plan& p : plans_) {
+        if (p.size == size) {
+            return p;
+        }
+    }
+
+    Plan p;
+    p.size = size;
+    p.bitReverse.resize(static_cast<std::size_t>(size));
+    int bits = 0;
+    while ((1 << bits) < size) {
+        ++bits;
+    }
+    for (int ii = 0; ii < size; ++ii) {
+        int reversed = 0;
+        for (int bb = 0; bb < bits; ++bb) {
+            reversed |= ((ii >> bb) & 1) << (bits - 1 - bb);
+        }
+        p.bitReverse[static_cast<std::size_t>(ii)] = reversed;
+    }
+    p.twiddles.resize(static_cast<std::size_t>(size / 2));
+    const double pi = std::acos(-1.0);
+    for (int ii = 0; ii < size / 2; ++ii) {
+        p.twiddles[static_cast<std::size_t>(ii)] = std::polar(1.0, -2.0 * pi * ii / size);
+    }
+    plans_.push_back(std::move(p));
+    return plans_.back();
+}
+
+
+/*!
+   \brief In place iterative radix-2 transform, the inverse one is not scaled.
+ */
+void CrossCorrelator::fft(const Plan& plan, std::complex<double>* data, bool inverse)
+{
+    const int size = plan.size;
+    for (int ii = 0; ii < size; ++ii) {
+        const int jj = plan.bitReverse[static_cast<std::size_t>(ii)];
+        if (ii < jj) {
+            std::swap(data[ii], data[jj]);
+        }
+    }
+    // explicit real arithmetic, the std::complex product checks for infinities
+    // and does not vectorize
+    const std::complex<double>* twiddles = plan.twiddles.data();
+    const double sign = inverse ? -1.0 : 1.0;
+    for (int half = 1; half < size; half *= 2) {
+        const int step = size / (2 * half);
+        for (int start = 0; start < size; start += 2 * half) {
+            std::complex<double>* lo = data + start;
+            std::complex<double>* hi = lo + half;
+            for (int kk = 0; kk < half; ++kk) {
+                const double wr = twiddles[kk * step].real();
+                const double wi = sign * twiddles[kk * step].imag();
+                const double hr = hi[kk].real();
+                const double hi_im = hi[kk].imag();
+                const double tr = wr * hr - wi * hi_im;
+                const double ti = wr * hi_im + wi * hr;
+                const double lr = lo[kk].real();
+                const double li = lo[kk].imag();
+                hi[kk] = std::complex<double>(lr - tr, li - ti);
+                lo[kk] = std::complex<double>(lr + tr, li + ti);
+            }
+        }
+    }
+}
+
+
+double CrossCorrelator::refine(double left, double center, double right, PeakFit fit)
+{
+    if (fit == PeakFit::Gaussian && left > 0.0 && center > 0.0 && right > 0.0) {
+        left = std::log(left);
+        center = std::log(center);
+        right = std::log(right);
+    }
+    const double denominator = left - 2.0 * center + right;
+    if (denominator >= 0.0) {
+        return 0.0;
+    }
+    return 0.5 * (left - right) / denominator;
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
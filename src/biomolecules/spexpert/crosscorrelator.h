@@ -0,0 +1,49 @@
+#ifndef BIOMOLECULES_SPEXPERT_CROSSCORRELATOR_H_
+#define BIOMOLECULES_SPEXPERT_CROSSCORRELATOR_H_
+
+#include <complex>
+#include <vector>
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+enum class PeakFit {
+    Parabolic,
+    Gaussian
+};
+
+class CrossCorrelator
+{
+public:
+    CrossCorrelator() = default;
+    CrossCorrelator(const CrossCorrelator&) = delete;
+    CrossCorrelator& operator=(const CrossCorrelator&) = delete;
+
+    bool shift(const double* reference, const double* y, int n, int maxLag, PeakFit fit, double* shift);
+    const std::vector<double>& correlation() const { return correlation_; }
+
+private:
+    struct Plan
+    {
+        int size;
+        std::vector<int> bitReverse;
+        std::vector<std::complex<double> > twiddles;
+    };
+
+    const Plan& plan(int size);
+    static void fft(const Plan& plan, std::complex<double>* data, bool inverse);
+    static double refine(double left, double center, double right, PeakFit fit);
+
+    std::vector<Plan> plans_;
+    std::vector<std::complex<double> > packed_;
+    std::vector<std::complex<double> > product_;
+    std::vector<double> correlation_;  // lags from -maxLag to maxLag
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_CROSSCORRELATOR_H_
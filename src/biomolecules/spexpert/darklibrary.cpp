@@ -0,0 +1,242 @@
+#include "darklibrary.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QDataStream>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+#include <QDebug>
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+namespace {
+
+const quint32 kDarkLibraryMagic = 0x44524b4c;  // "DRKL"
+const quint32 kDarkLibraryVersion = 1;
+
+}  // namespace
+
+/*!
+   \class DarkLibrary
+   \brief Persistent cache of the dark spectra.
+
+   The darks are keyed by the exposure, the number of accumulations and the
+   detector temperature and readout mode. WinSpec does not report the last two,
+   so they are taken from params() and the user has to keep them in sync with
+   the detector setup. The temperatures are compared with the tolerance of half
+   a degree. Entries older than DarkLibraryParams::expiryHours are not returned
+   by lookup() and are removed by purgeExpired().
+
+   The library is shared by the GUI and the SpectrumPipeline worker, all the
+   methods are thread safe.
+ */
+
+DarkLibrary::DarkLibrary()
+    : params_{false, 24, -70.0, QString{}, true},
+      mutex_{new QMutex}
+{}
+
+
+DarkLibrary::~DarkLibrary()
+{}
+
+
+DarkLibraryParams DarkLibrary::params() const
+{
+    QMutexLocker locker{mutex_.get()};
+    return params_;
+}
+
+
+void DarkLibrary::setParams(const DarkLibraryParams& params)
+{
+    QMutexLocker locker{mutex_.get()};
+    params_ = params;
+}
+
+
+/*!
+   \brief Builds the key of the dark for the current detector settings.
+ */
+DarkKey DarkLibrary::key(double exposure, int accumulations) const
+{
+    QMutexLocker locker{mutex_.get()};
+    return DarkKey{exposure, accumulations, params_.ccdTemperature, params_.readout};
+}
+
+
+bool DarkLibrary::contains(const DarkKey& key) const
+{
+    QMutexLocker locker{mutex_.get()};
+    int idx = find(key);
+    return idx >= 0 && !expired(entries_.at(idx), QDateTime::currentDateTime());
+}
+
+
+/*!
+   \brief Copies the matching unexpired dark to \a dark.
+   \return false if there is no such dark.
+ */
+bool DarkLibrary::lookup(const DarkKey& key, QVector<double>& dark) const
+{
+    QMutexLocker locker{mutex_.get()};
+    int idx = find(key);
+    if (idx < 0 || expired(entries_.at(idx), QDateTime::currentDateTime())) {
+        return false;
+    }
+    dark = entries_.at(idx).dark;
+    return true;
+}
+
+
+/*!
+   \brief Stores the \a dark, an older dark with the matching key is replaced.
+ */
+void DarkLibrary::insert(const DarkKey& key, const QVector<double>& dark)
+{
+    QMutexLocker locker{mutex_.get()};
+    Entry entry{key, QDateTime::currentDateTime(), dark};
+    int idx = find(key);
+    if (idx >= 0) {
+        entries_[idx] = entry;
+    } else {
+        entries_.append(entry);
+    }
+}
+
+
+/*!
+   \brief Removes the expired darks.
+   \return Number of removed darks.
+ */
+int DarkLibrary::purgeExpired()
+{
+    QMutexLocker locker{mutex_.get()};
+    const QDateTime now = QDateTime::currentDateTime();
+    int removed = 0;
+    for (int ii = entries_.size() - 1; ii >= 0; --ii) {
+        if (expired(entries_.at(ii), now)) {
+            entries_.remove(ii);
+            ++removed;
+        }
+    }
+    return removed;
+}
+
+
+int DarkLibrary::size() const
+{
+    QMutexLocker locker{mutex_.get()};
+    return entries_.size();
+}
+
+
+QString DarkLibrary::fileName() const
+{
+    QMutexLocker locker{mutex_.get()};
+    return file_name_;
+}
+
+
+void DarkLibrary::setFileName(const QString& file_name)
+{
+    QMutexLocker locker{mutex_.get()};
+    file_name_ = file_name;
+}
+
+
+/*!
+   \brief Replaces the content of the library by the content of fileName().
+ */
+bool DarkLibrary::load()
+{
+    QMutexLocker locker{mutex_.get()};
+    QFile file{file_name_};
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream in{&file};
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 magic;
+    quint32 version;
+    qint32 count;
+    in >> magic >> version >> count;
+    if (magic != kDarkLibraryMagic || version != kDarkLibraryVersion || count < 0) {
+        qDebug() << "DarkLibrary::load():" << file_name_ << "is not a dark library";
+        return false;
+    }
+    QVector<Entry> entries;
+    entries.reserve(count);
+    for (qint32 ii = 0; ii < count; ++ii) {
+        Entry entry;
+        qint32 accumulations;
+        in >> entry.key.exposure >> accumulations >> entry.key.ccdTemperature >> entry.key.readout
+           >> entry.acquired >> entry.dark;
+        entry.key.accumulations = accumulations;
+        entries.append(entry);
+    }
+    if (in.status() != QDataStream::Ok) {
+        qDebug() << "DarkLibrary::load():" << file_name_ << "is corrupted";
+        return false;
+    }
+    entries_.swap(entries);
+    return true;
+}
+
+
+bool DarkLibrary::save() const
+{
+    QMutexLocker locker{mutex_.get()};
+    if (file_name_.isEmpty()) {
+        return false;
+    }
+    QSaveFile file{file_name_};
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "DarkLibrary::save(): can not open" << file_name_;
+        return false;
+    }
+    QDataStream out{&file};
+    out.setVersion(QDataStream::Qt_5_0);
+    out << kDarkLibraryMagic << kDarkLibraryVersion << static_cast<qint32>(entries_.size());
+    for (const Entry& entry : entries_) {
+        out << entry.key.exposure << static_cast<qint32>(entry.key.accumulations) << entry.key.ccdTemperature
+            << entry.key.readout << entry.acquired << entry.dark;
+    }
+    return file.commit();
+}
+
+
+bool DarkLibrary::matches(const DarkKey& lhs, const DarkKey& rhs)
+{
+    return std::abs(lhs.exposure - rhs.exposure) <= 1e-6 * std::max(1.0, std::abs(lhs.exposure))
+            && lhs.accumulations == rhs.accumulations
+            && std::abs(lhs.ccdTemperature - rhs.ccdTemperature) <= 0.5
+            && lhs.readout == rhs.readout;
+}
+
+
+bool DarkLibrary::expired(const Entry& entry, const QDateTime& now) const
+{
+    return params_.expiryHours > 0 && entry.acquired.secsTo(now) > 3600ll * params_.expiryHours;
+}
+
+
+int DarkLibrary::find(const DarkKey& key) const
+{
+    for (int ii = 0; ii < entries_.size(); ++ii) {
+        if (matches(entries_.at(ii).key, key)) {
+            return ii;
+        }
+    }
+    return -1;
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
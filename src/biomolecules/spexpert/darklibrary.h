@@ -0,0 +1,81 @@
+#ifndef BIOMOLECULES_SPEXPERT_DARKLIBRARY_H_
+#define BIOMOLECULES_SPEXPERT_DARKLIBRARY_H_
+
+#include <memory>
+
+#include <QDateTime>
+#include <QString>
+#include <QVector>
+
+
+// forward declarations
+class QMutex;
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+struct DarkKey
+{
+    double exposure;
+    int accumulations;
+    double ccdTemperature;
+    QString readout;
+};
+
+struct DarkLibraryParams
+{
+    bool enabled;
+    int expiryHours;          // 0 means the darks never expire
+    double ccdTemperature;    // detector setpoint, WinSpec does not report it
+    QString readout;          // readout mode label, WinSpec does not report it
+    bool idleAcquisition;     // acquire the missing darks during equilibration waits
+};
+
+class DarkLibrary
+{
+public:
+    DarkLibrary();
+    DarkLibrary(const DarkLibrary&) = delete;
+    DarkLibrary& operator=(const DarkLibrary&) = delete;
+    ~DarkLibrary();
+
+    DarkLibraryParams params() const;
+    void setParams(const DarkLibraryParams& params);
+    DarkKey key(double exposure, int accumulations) const;
+
+    bool contains(const DarkKey& key) const;
+    bool lookup(const DarkKey& key, QVector<double>& dark) const;
+    void insert(const DarkKey& key, const QVector<double>& dark);
+    int purgeExpired();
+    int size() const;
+
+    QString fileName() const;
+    void setFileName(const QString& file_name);
+    bool load();
+    bool save() const;
+
+private:
+    struct Entry
+    {
+        DarkKey key;
+        QDateTime acquired;
+        QVector<double> dark;
+    };
+
+    static bool matches(const DarkKey& lhs, const DarkKey& rhs);
+    bool expired(const Entry& entry, const QDateTime& now) const;
+    int find(const DarkKey& key) const;
+
+    DarkLibraryParams params_;
+    QString file_name_;
+    QVector<Entry> entries_;
+    std::unique_ptr<QMutex> mutex_;
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_DARKLIBRARY_H_
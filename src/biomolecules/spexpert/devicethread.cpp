@@ -0,0 +1,156 @@
+#include "devicethread.h"
+
+#include <utility>
+
+#include <QCoreApplication>
+#include <QEvent>
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+
+#ifdef Q_OS_WIN
+#include <objbase.h>
+#endif
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+namespace {
+
+class CommandEvent : public QEvent
+{
+public:
+    static QEvent::Type type()
+    {
+        static const QEvent::Type event_type = static_cast<QEvent::Type>(QEvent::registerEventType());
+        return event_type;
+    }
+
+    explicit CommandEvent(std::function<void()> command)
+        : QEvent{type()},
+          command_{std::move(command)}
+    {}
+
+    void run() { command_(); }
+
+private:
+    std::function<void()> command_;
+};
+
+}  // namespace
+
+
+class DeviceThread::Receiver : public QObject
+{
+public:
+    Receiver() : poll_timer_{nullptr} {}
+
+    void setPoll(std::function<void()> poll, int msec)
+    {
+        if (!poll_timer_) {
+            poll_timer_ = new QTimer{this};
+            QObject::connect(poll_timer_, &QTimer::timeout, [this] { poll_(); });
+        }
+        poll_ = std::move(poll);
+        if (poll_ && msec > 0) {
+            poll_timer_->start(msec);
+        } else {
+            poll_timer_->stop();
+        }
+    }
+
+    void stopPoll()
+    {
+        if (poll_timer_) {
+            poll_timer_->stop();
+        }
+    }
+
+protected:
+    bool event(QEvent* e) override
+    {
+        if (e->type() == CommandEvent::type()) {
+            static_cast<CommandEvent*>(e)->run();
+            return true;
+        }
+        return QObject::event(e);
+    }
+
+private:
+    QTimer* poll_timer_;
+    std::function<void()> poll_;
+};
+
+
+/*!
+   \class DeviceThread
+   \brief Runs the calls of one device on its own thread, one after another.
+
+   The device object should be created, used and destroyed only through the
+   commands, so it lives in the device thread, e.g. the COM object in its own
+   apartment or the QTimer of a mock device. The commands are delivered as
+   events to the thread's event loop in the order they were posted, which
+   replaces the mutex serializing the device calls. post() does not wait,
+   call() returns the future of the result and invoke() waits for it.
+
+   The optional poll set by setPoll() runs in the device thread periodically
+   between the commands, it is meant to refresh the status snapshot of the
+   device, so the readers never wait for the device.
+ */
+
+DeviceThread::DeviceThread(const QString& name)
+    : thread_{new QThread},
+      receiver_{new Receiver}
+{
+    thread_->setObjectName(name);
+#ifdef Q_OS_WIN
+    QObject::connect(thread_.get(), &QThread::started, [] { CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED); });
+    QObject::connect(thread_.get(), &QThread::finished, [] { CoUninitialize(); });
+#endif
+    receiver_->moveToThread(thread_.get());
+    thread_->start();
+}
+
+
+/*!
+   \brief Runs the already posted commands and stops the thread.
+ */
+DeviceThread::~DeviceThread()
+{
+    Receiver* receiver = receiver_;
+    QThread* thread = thread_.get();
+    post([receiver, thread] {
+        receiver->stopPoll();
+        thread->quit();
+    });
+    thread_->wait();
+    delete receiver_;
+}
+
+
+void DeviceThread::post(std::function<void()> command)
+{
+    QCoreApplication::postEvent(receiver_, new CommandEvent{std::move(command)});
+}
+
+
+/*!
+   \brief Runs \a poll every \a msec milliseconds in the device thread, the
+   empty \a poll or non-positive \a msec stops polling.
+ */
+void DeviceThread::setPoll(std::function<void()> poll, int msec)
+{
+    Receiver* receiver = receiver_;
+    post([receiver, poll, msec] { receiver->setPoll(poll, msec); });
+}
+
+
+bool DeviceThread::isCurrent() const
+{
+    return QThread::currentThread() == thread_.get();
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
@@ -0,0 +1,74 @@
+#ifndef BIOMOLECULES_SPEXPERT_DEVICETHREAD_H_
+#define BIOMOLECULES_SPEXPERT_DEVICETHREAD_H_
+
+#include <functional>
+#include <future>
+#include <memory>
+
+#include <QString>
+
+
+// forward declarations
+class QThread;
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+class DeviceThread
+{
+public:
+    explicit DeviceThread(const QString& name);
+    DeviceThread(const DeviceThread&) = delete;
+    DeviceThread& operator=(const DeviceThread&) = delete;
+    ~DeviceThread();
+
+    void post(std::function<void()> command);
+    template<typename F>
+    auto call(F f) -> std::future<decltype(f())>;
+    template<typename F>
+    auto invoke(F f) -> decltype(f());
+    void setPoll(std::function<void()> poll, int msec);
+    bool isCurrent() const;
+
+private:
+    class Receiver;
+
+    std::unique_ptr<QThread> thread_;
+    Receiver* receiver_;  // lives in thread_
+};
+
+
+/*!
+   \brief Enqueues \a f and returns the future of its result.
+ */
+template<typename F>
+auto DeviceThread::call(F f) -> std::future<decltype(f())>
+{
+    typedef decltype(f()) Result;
+    std::shared_ptr<std::packaged_task<Result()> > task{new std::packaged_task<Result()>{f}};
+    std::future<Result> result = task->get_future();
+    post([task] { (*task)(); });
+    return result;
+}
+
+
+/*!
+   \brief Runs \a f in the device thread and waits for its result, \a f is
+   run directly if called from the device thread.
+ */
+template<typename F>
+auto DeviceThread::invoke(F f) -> decltype(f())
+{
+    if (isCurrent()) {
+        return f();
+    }
+    return call(f).get();
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_DEVICETHREAD_H_
@@ -0,0 +1,141 @@
+#include "driftmonitor.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+/*!
+   \class DriftMonitor
+   \brief Estimates the spectral drift since the last calibration and decides
+   if the next calibration is needed.
+
+   The first measured spectrum after the calibration becomes the reference,
+   the following spectra are cross-correlated with it in the region given by
+   DriftParams by the CrossCorrelator. As the measured sample itself changes
+   during the experiment, the region should contain a stable band, e.g. of the
+   solvent.
+
+   The windows of the extended range experiment cover different regions of
+   the grating and are calibrated separately, so each window has its own
+   reference, shift and count. The experiments with a single window use the
+   default window -1.
+
+   The calibration is needed if the monitor is disabled, if there was no
+   calibration of the window yet, if its absolute shift exceeds
+   DriftParams::threshold or if DriftParams::maxInterval spectra were measured
+   in it since its last calibration.
+
+   The spectra are added from the SpectrumPipeline worker and the decisions are
+   made in the GUI thread, all the methods are thread safe.
+ */
+
+DriftMonitor::DriftMonitor()
+    : params_{false, 0.5, 10, 20, 0, -1, PeakFit::Parabolic},
+      mutex_{new QMutex}
+{}
+
+
+DriftMonitor::~DriftMonitor()
+{}
+
+
+DriftParams DriftMonitor::params() const
+{
+    QMutexLocker locker{mutex_.get()};
+    return params_;
+}
+
+
+void DriftMonitor::setParams(const DriftParams& params)
+{
+    QMutexLocker locker{mutex_.get()};
+    params_ = params;
+}
+
+
+/*!
+   \brief Forgets the calibrations of all the windows, e.g. at the start of the
+   experiment.
+ */
+void DriftMonitor::reset()
+{
+    QMutexLocker locker{mutex_.get()};
+    windows_.clear();
+}
+
+
+/*!
+   \brief Marks the calibration of the \a window, its next spectrum becomes the
+   new reference.
+ */
+void DriftMonitor::calibrated(int window)
+{
+    QMutexLocker locker{mutex_.get()};
+    Window& state = windows_[window];
+    state.reference.clear();
+    state.calibrated = true;
+    state.count = 0;
+    state.last_shift = 0.0;
+}
+
+
+void DriftMonitor::addSpectrum(const QVector<double>& y, int window)
+{
+    QMutexLocker locker{mutex_.get()};
+    auto it = windows_.find(window);
+    if (it == windows_.end() || !it->calibrated) {
+        return;
+    }
+    Window& state = *it;
+    ++state.count;
+    if (y.isEmpty()) {
+        // the spectrum was not read out, it only counts
+        return;
+    }
+    if (state.reference.size() != y.size()) {
+        state.reference = y;
+        state.last_shift = 0.0;
+        return;
+    }
+    const int from = std::min(std::max(0, params_.regionFrom), y.size() - 1);
+    const int to = (params_.regionTo < from || params_.regionTo >= y.size()) ? y.size() - 1 : params_.regionTo;
+    double shift;
+    if (correlator_.shift(state.reference.constData() + from, y.constData() + from, to - from + 1,
+                          params_.maxLag, params_.peakFit, &shift)) {
+        state.last_shift = shift;
+    }
+}
+
+
+bool DriftMonitor::calibrationNeeded(int window) const
+{
+    QMutexLocker locker{mutex_.get()};
+    auto it = windows_.constFind(window);
+    return !params_.enabled || it == windows_.constEnd() || !it->calibrated
+            || it->count >= params_.maxInterval || std::abs(it->last_shift) >= params_.threshold;
+}
+
+
+double DriftMonitor::lastShift(int window) const
+{
+    QMutexLocker locker{mutex_.get()};
+    return windows_.value(window).last_shift;
+}
+
+
+int DriftMonitor::sinceCalibration(int window) const
+{
+    QMutexLocker locker{mutex_.get()};
+    return windows_.value(window).count;
+}
+
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
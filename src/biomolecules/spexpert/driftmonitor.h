@@ -0,0 +1,68 @@
+#ifndef BIOMOLECULES_SPEXPERT_DRIFTMONITOR_H_
+#define BIOMOLECULES_SPEXPERT_DRIFTMONITOR_H_
+
+#include <memory>
+
+#include <QMap>
+#include <QVector>
+
+#include "crosscorrelator.h"
+
+
+// forward declarations
+class QMutex;
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+struct DriftParams
+{
+    bool enabled;         // false means calibration after every measurement
+    double threshold;     // shift in pixels which triggers the calibration
+    int maxInterval;      // measurements after which the calibration is forced
+    int maxLag;           // largest shift searched for, in pixels
+    int regionFrom;       // first pixel of the reference peak region
+    int regionTo;         // last pixel of the region, negative means the end
+    PeakFit peakFit;
+};
+
+class DriftMonitor
+{
+public:
+    DriftMonitor();
+    DriftMonitor(const DriftMonitor&) = delete;
+    DriftMonitor& operator=(const DriftMonitor&) = delete;
+    ~DriftMonitor();
+
+    DriftParams params() const;
+    void setParams(const DriftParams& params);
+
+    void reset();
+    void calibrated(int window = -1);
+    void addSpectrum(const QVector<double>& y, int window = -1);
+    bool calibrationNeeded(int window = -1) const;
+    double lastShift(int window = -1) const;
+    int sinceCalibration(int window = -1) const;
+
+private:
+    struct Window
+    {
+        QVector<double> reference;
+        bool calibrated = false;
+        int count = 0;
+        double last_shift = 0.0;
+    };
+
+    DriftParams params_;
+    QMap<int, Window> windows_;  // by the window of the extended range experiment
+    CrossCorrelator correlator_;
+    std::unique_ptr<QMutex> mutex_;
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_DRIFTMONITOR_H_
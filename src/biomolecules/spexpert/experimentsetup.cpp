@@ -1229,6 +1229,9 @@ ExtRanTab::ExtRanTab(AppStateTraits::InitWinSpecParams &params, AppState *appSta
                                                                             filenameButton)
                                   .width());
 
+    serpentineCheckBox = new QCheckBox(tr("Walk the windows back at every other temperature"));
+    serpentineCheckBox->setChecked(params_.extRan.serpentine);
+
     model = new ExtRanTabTraits::Model(params_, this);
     if (params_.extRan.autoFileNames) {
         autorenameFilenames();
@@ -1286,6 +1289,7 @@ ExtRanTab::ExtRanTab(AppStateTraits::InitWinSpecParams &params, AppState *appSta
     extRanGroupBox->setLayout(boxVLayout);
 
     boxVLayout->addWidget(autoFilenamesGroupBox);
+    boxVLayout->addWidget(serpentineCheckBox);
     QVBoxLayout *vLayout = new QVBoxLayout;
     autoFilenamesGroupBox->setLayout(vLayout);
     vLayout->addWidget(filenameLabel, 0, Qt::AlignLeft);
@@ -1311,6 +1315,7 @@ ExtRanTab::ExtRanTab(AppStateTraits::InitWinSpecParams &params, AppState *appSta
 
 bool ExtRanTab::saveParams()
 {
+    params_.extRan.serpentine = serpentineCheckBox->isChecked();
     if (!params_.extRan.extendedRange)
         return true;
 
@@ -265,6 +265,7 @@ private:
     QGroupBox *autoFilenamesGroupBox;
     QLineEdit *filenameEdit;
     QPushButton *filenameButton;
+    QCheckBox *serpentineCheckBox;
 
     QAbstractTableModel *model;
     QTableView *view;
@@ -89,6 +89,20 @@ bool ExpTask::delayedDelete() const
     return blDelayedDelete_;
 }
 
+/*!
+   \fn ExpTask::concurrent() const
+   \brief Returns true if the start() method may be executed by the executor
+   of the ExpTaskList, i.e. in a thread different from the ExpTask's one, see
+   ExpTaskList::setExecutor(). The default is false.
+
+   Reimplement it to return true only if start() touches no GUI and no object
+   living in the ExpTask's thread except through queued signals or invoked
+   methods, and all the other objects it uses are thread safe (AppState,
+   WinSpec and StageControl are). The finished() and taskFailed() signals are
+   then queued to the ExpTaskList and stop() can be called while start() is
+   running.
+ */
+
 /*!
    \brief This method sets the initial number of repetitions of the ExpTask.
    \param timesExecuted initial number of repetitions.
@@ -12,6 +12,7 @@ public:
     virtual ~ExpTask() {}
     virtual void onceExecuted();
     virtual void restartTimesExec();
+    virtual bool concurrent() const { return false; }
 
     // getters
     int currTimesExec() const;
@@ -1,5 +1,30 @@
 #include "exptasklist.h"
 
+#include <QRunnable>
+#include <QThreadPool>
+
+namespace {
+
+// starts the concurrent task in the executor's thread and then tells the
+// ExpTaskList, that the task is no longer inside its start()
+class TaskStarter : public QRunnable
+{
+public:
+    TaskStarter(ExpTask *task, ExpTaskList *taskList) : task_(task), taskList_(taskList) {}
+
+    void run() override
+    {
+        task_->start();
+        QMetaObject::invokeMethod(taskList_, "concurrentStartReturned", Qt::QueuedConnection);
+    }
+
+private:
+    ExpTask *task_;
+    ExpTaskList *taskList_;
+};
+
+} // namespace
+
 /*!
    \namespace ExpTaskListTraits
    \brief Contains ExpTaskList traits
@@ -59,6 +84,14 @@
 /*!
    \class ExpTaskList
    \brief ExpTaskList
+
+   The tasks are executed one after another from the cursor
+   ExpTaskList::currIndex_. The tasks which finish synchronously inside their
+   start(), e.g. the bookkeeping tasks, are continued by the loop in
+   runTasks() instead of recursing through the finished() signals, so the
+   long plans neither grow the stack nor pay for the connections per step.
+   The connections to the task are made once in addTask(). The ExpTaskList
+   emits its own signals only when it finishes.
  */
 
 /*!
@@ -70,16 +103,33 @@ ExpTaskList::ExpTaskList(QObject *parent) :
 {
     blRunning = false;
     blStop = false;
+    blFailed = false;
+    currIndex_ = 0;
+    blRepeat_ = false;
+    executor_ = nullptr;
+    blStarting_ = false;
+    blFinishPending_ = false;
 }
 
 /*!
-   \brief Appends task to the task list.
+   \brief Appends task to the task list and connects its ExpTask::finished()
+   and ExpTask::taskFailed() signals, which are handled only while the task is
+   the current one.
    \param tsk appended task.
  */
 void ExpTaskList::addTask(ExpTaskListTraits::TaskItem tsk)
 {
     if (tsk.task->currTimesExec() > 0) {
         tasks.append(tsk);
+        ExpTask *task = tsk.task;
+        connect(task, &ExpTask::finished, this, [this, task] {
+            if (task == currTask())
+                taskFinished();
+        });
+        connect(task, &ExpTask::taskFailed, this, [this, task] {
+            if (task == currTask())
+                onFailed();
+        });
     }
 }
 
@@ -117,10 +167,10 @@ bool ExpTaskList::isEmpty() const
  */
 ExpTaskListTraits::TaskItem ExpTaskList::getCurrTask() const
 {
-    if (currTasks.isEmpty())
+    if (!blRunning || currIndex_ >= tasks.size())
         return ExpTaskListTraits::TaskItem(ExpTaskListTraits::TaskType::None);
     else
-        return currTasks.first();
+        return tasks.at(currIndex_);
 }
 
 /*!
@@ -131,10 +181,22 @@ ExpTaskListTraits::TaskItem ExpTaskList::getCurrTask() const
  */
 
 /*!
-   \fn ExpTaskList::stopTask()
-   \brief This signal is emited form the stop() method and is connected in the
-   nextTask() method to the ExpTask::stop() slot of the current running
-   ExpTask.
+   \fn ExpTaskList::executor() const
+   \brief Returns the thread pool executing the concurrent tasks or nullptr.
+
+   \sa setExecutor()
+ */
+
+/*!
+   \fn ExpTaskList::setExecutor(QThreadPool *executor)
+   \brief Sets the thread pool, which executes the start() of the contained
+   tasks, which are ExpTask::concurrent(), so their blocking calls do not block
+   the ExpTaskList's thread. The other tasks are started directly. The executor
+   is passed to the contained ExpTaskList objects when they are started. The
+   pool is not owned by the ExpTaskList. The default nullptr starts all the
+   tasks directly.
+
+   \sa ForkJoinTask::branchExecutor()
  */
 
 /*!
@@ -143,7 +205,8 @@ ExpTaskListTraits::TaskItem ExpTaskList::getCurrTask() const
 
    At first, this method controlls if the ExpTaskList is not already running.
    If yes, it skips the request, it the other case, it sets private variables
-   indicating ExpTaskList state and calls nexTask() method.
+   indicating ExpTaskList state, rewinds the cursor and calls runTasks()
+   method.
 
    \sa stop(), taskFinished(), taskListFinished()
  */
@@ -157,14 +220,15 @@ void ExpTaskList::start()
         blFailed = false;
         blStop = false;
         blRunning = true;
-        currTasks = tasks;
-        nextTask();
+        currIndex_ = 0;
+        blRepeat_ = false;
+        runTasks();
     }
 }
 
 /*!
    \brief This methods stops execution of the ExpTaskList and current running
-   ExpTask through the emitting the stopTask() signal.
+   ExpTask by calling its ExpTask::stop() slot.
 
    After the current running ExpTask is finished, all the contained ExpTask
    objects are deleted and all the ExpTaskListTraits::TaskItem structs are
@@ -176,7 +240,8 @@ void ExpTaskList::stop()
     if (!blStop)
     {
         blStop = true;
-        emit stopTask();
+        if (ExpTask *task = currTask())
+            task->stop();
     }
 }
 
@@ -198,64 +263,77 @@ void ExpTaskList::taskListFinished()
 }
 
 /*!
-   \brief Executes a next ExpTask. The ExpTaskListTraits::TaskItem objects
-   which contain ExpTask objects are saved in ExpTaskList::currTasks, where
-   first element is that, which will by next executed. If there is no task in
-   list, taskListFinished() method is called. The ExpTask's ExpTask::finished()
-   signal is connected to the taskFinished() slot and stopTask() signal is
-   connected to the ExpTask's ExpTask::stop() slot. If the current ExpTask has
-   not ExpTask::currTimesExec() greater than zero, the taskFinished() method is
-   called.
+   \brief Executes the tasks from the cursor until some task does not finish
+   inside its start() or the list ends, then taskListFinished() is called.
+
+   Before the first execution, the number of executions of the task is reset
+   and its delayed deletion is set. The task without planned executions is
+   skipped. The task which finishes later continues the loop from
+   taskFinished().
  */
-void ExpTaskList::nextTask()
+void ExpTaskList::runTasks()
 {
-    // controll if there is next task to be executed
-    if (currTasks.isEmpty())
-    {
-        taskListFinished();
-        return;
-    }
-    // resets the number of executions to initial value, repeating calling of
-    // the task is handled by taskFinished() method.
-    currTasks.first().task->restartTimesExec();
+    forever {
+        // controll if there is next task to be executed
+        if (currIndex_ >= tasks.size())
+        {
+            taskListFinished();
+            return;
+        }
+        ExpTask *task = tasks.at(currIndex_).task;
 
-    // control if the task may be deleted later or directly after the execution.
-    if (delayedDelete() || currTimesExec() > 1)
-        currTasks.first().task->setDelayedDelete(true);
-    else
-        currTasks.first().task->setDelayedDelete(false);
+        if (blRepeat_) {
+            blRepeat_ = false;
+        } else {
+            // resets the number of executions to initial value, repeating
+            // calling of the task is handled by stepFinished() method.
+            task->restartTimesExec();
 
-    // control, if any executions of the task are planned.
-    if (currTasks.first().task->currTimesExec() > 0)
-    {
-        connect(currTasks.first().task, &ExpTask::taskFailed, this, &ExpTaskList::onFailed);
-        connect(currTasks.first().task, &ExpTask::finished, this, &ExpTaskList::taskFinished);
-        connect(this, &ExpTaskList::stopTask, currTasks.first().task, &ExpTask::stop);
-        currTasks.first().task->start();
-    }
-    else {
-        // no execution
-        taskFinished();
+            // control if the task may be deleted later or directly after the
+            // execution.
+            task->setDelayedDelete(delayedDelete() || currTimesExec() > 1);
+        }
+
+        // control, if any executions of the task are planned.
+        if (task->currTimesExec() > 0)
+        {
+            blStarting_ = true;
+            blFinishPending_ = false;
+            if (ExpTaskList *taskList = qobject_cast<ExpTaskList *>(task)) {
+                if (executor_)
+                    taskList->setExecutor(executor_);
+            }
+            if (executor_ && task->concurrent()) {
+                // concurrentStartReturned() continues
+                executor_->start(new TaskStarter(task, this));
+                return;
+            }
+            task->start();
+            blStarting_ = false;
+            if (!blFinishPending_)
+                return;  // taskFinished() continues
+            blFinishPending_ = false;
+        }
+        if (!stepFinished())
+            return;
     }
 }
 
 /*!
-   \brief This method is connected to the ExpTask::finished() signal of the
-   current task and handles repeating of its execution until the intended
-   number of executions is reached.
+   \brief Handles the finished execution of the current task.
 
-   At first, the method controlls if the task was stopped by the
-   stop method and if so, it cleans up containing tasks and executes
-   taskListFinished().
+   At first, the method controlls if the task was stopped by the stop method
+   and if so, it cleans up containing tasks and executes taskListFinished().
 
    Then it decreases ExpTask's execution counter by the ExpTask::onceExecuted()
-   method and executes it once more if the counter is styl greater than one,
-   else it disconnects the the ExpTask::finished() signal from this method and
-   ExpTaskList::stopTask() signla from ExpTask::stop() method. If the task
-   need to be deleted later, it calls ExpTask::restartTimesExec(), else
-   it deletes task and removes it from tasks list. Then it calls nextTask().
+   method and marks it for the next execution if the counter is still greater
+   than zero, else it moves the cursor to the next task. If the task need to
+   be deleted later, it calls ExpTask::restartTimesExec(), else it deletes the
+   task and removes it from tasks list.
+
+   \return true if runTasks() should continue.
  */
-void ExpTaskList::taskFinished()
+bool ExpTaskList::stepFinished()
 {
     // it the ExpTaskList was stopped by the stop() method, the contained tasks
     // are cleaned up
@@ -267,38 +345,65 @@ void ExpTaskList::taskFinished()
             delete it->task;
         }
         tasks.clear();
-        currTasks.clear();
+        currIndex_ = 0;
         taskListFinished();
-        return;
+        return false;
     }
 
+    ExpTask *task = tasks.at(currIndex_).task;
+
     // decreases executions counter
-    currTasks.first().task->onceExecuted();
+    task->onceExecuted();
 
     // if more executions are required
-    if (currTasks.first().task->currTimesExec() > 0)
+    if (task->currTimesExec() > 0)
     {
-        currTasks.first().task->start();
+        blRepeat_ = true;
+    }
+    else if (currTimesExec() > 1 || delayedDelete())
+    {
+        // not deleted immediatelly after execution
+        task->restartTimesExec();
+        ++currIndex_;
     }
     else
     {
-        // disconnects already proccessed task.
-        disconnect(currTasks.first().task, &ExpTask::finished, this, &ExpTaskList::taskFinished);
-        disconnect(this, &ExpTaskList::stopTask, currTasks.first().task, &ExpTask::stop);
-
-        // if not deleted immediatelly after execution
-        if (currTimesExec() > 1 || delayedDelete())
-            currTasks.first().task->restartTimesExec();
-        else {
-            // deletes task
-            delete tasks.first().task;
-            tasks.pop_front();
-        }
-        // removes task from actual task list
-        currTasks.pop_front();
+        // deletes task, the cursor points to the next one
+        tasks.removeAt(currIndex_);
+        delete task;
+    }
+    return true;
+}
 
-        // invokes new task
-        nextTask();
+/*!
+   \brief This method is connected to the ExpTask::finished() signal of the
+   current task. If the task is still inside its start(), the finishing is
+   postponed to runTasks() or concurrentStartReturned(), else the execution
+   continues by the runTasks() method.
+ */
+void ExpTaskList::taskFinished()
+{
+    if (blStarting_)
+    {
+        blFinishPending_ = true;
+        return;
+    }
+    if (stepFinished())
+        runTasks();
+}
+
+/*!
+   \brief Invoked from the executor's thread after the concurrent task's start()
+   returned. The finished() signal of the task, which came meanwhile, is
+   handled now.
+ */
+void ExpTaskList::concurrentStartReturned()
+{
+    blStarting_ = false;
+    if (blFinishPending_) {
+        blFinishPending_ = false;
+        if (stepFinished())
+            runTasks();
     }
 }
 
@@ -312,12 +417,26 @@ void ExpTaskList::onFailed()
     blFailed = true;
 }
 
+/*!
+   \brief Returns the current task or nullptr if the ExpTaskList is not
+   running.
+ */
+ExpTask *ExpTaskList::currTask() const
+{
+    if (!blRunning || currIndex_ >= tasks.size())
+        return nullptr;
+    return tasks.at(currIndex_).task;
+}
+
 /*!
    \brief Destroyes ExpTaskList, deletes all ExpTaskListTraits::TaskItem
    objects from the task list.
  */
 ExpTaskList::~ExpTaskList()
 {
+    // the task can't be deleted while its start() runs in the executor
+    if (blStarting_ && executor_)
+        executor_->waitForDone();
     QList<ExpTaskListTraits::TaskItem>::Iterator it;
     for (it = tasks.begin(); it != tasks.end(); ++it)
     {
@@ -328,10 +447,13 @@ ExpTaskList::~ExpTaskList()
 /*!
     \var ExpTaskList::tasks
         \brief Private variable containing all tasks to be executed.
-    \var ExpTaskList::currTasks
-        \brief Private varibale containing current task list. It do not store
-        tasks which were already executed in current run even though they will
-        be executed in next run of the list.
+    \var ExpTaskList::currIndex_
+        \brief The cursor in ExpTaskList::tasks pointing to the current task.
+        The tasks before it were already executed in the current run and they
+        are kept only if they will be executed in the next run of the list.
+    \var ExpTaskList::blRepeat_
+        \brief true if the current task is executed once more, so its number
+        of executions is not reset.
     \var ExpTaskList::blRunning
         \brief true if ExpTaskList is running
     \var ExpTaskList::blStop
@@ -341,12 +463,27 @@ ExpTaskList::~ExpTaskList()
         \brief set to true if currently executed ExpTask emits
         ExpTask::taskFailed() signal, which causes emiting taskFailed() signal
         from this ExpTaskList.
+    \var ExpTaskList::executor_
+        \brief thread pool executing the concurrent tasks, see setExecutor().
+    \var ExpTaskList::blStarting_
+        \brief true while the start() of the current task runs, directly or in
+        the executor.
+    \var ExpTaskList::blFinishPending_
+        \brief true if the current task finished while its start() was still
+        running, see runTasks() and concurrentStartReturned().
  */
 
 /*!
    \class ForkJoinTask
    \brief This class creates inside multiple ExpTaskList objects and runs each
    of them in parallel when started, waiting for them all to finish.
+
+   The branches are signal driven chains in the ForkJoinTask's thread, but
+   their ExpTask::concurrent() tasks are started in the branchExecutor() pool,
+   so a blocking device call in one branch, e.g. starting the stage movement,
+   does not stall the other branches. The join waits for all the branches to
+   finish, also when some branch fails or the ForkJoinTask is stopped, then it
+   emits taskFailed() and finished() once.
  */
 
 /*!
@@ -363,6 +500,7 @@ ForkJoinTask::ForkJoinTask(unsigned int threadsN, QObject *parent) :
         expTaskLists.resize(threadsN_);
         for (unsigned int ii = 0; ii < threadsN_; ++ii) {
             expTaskLists[ii] = new ExpTaskList(this);
+            expTaskLists[ii]->setExecutor(branchExecutor());
             connect(expTaskLists[ii], &ExpTaskList::taskFailed, this, &ForkJoinTask::onFailed);
             connect(expTaskLists[ii], &ExpTaskList::finished, this, &ForkJoinTask::threadFinished);
             expTaskLists[ii]->setDelayedDelete(delayedDelete());
@@ -371,6 +509,7 @@ ForkJoinTask::ForkJoinTask(unsigned int threadsN, QObject *parent) :
         threadsN_ = 1;
         expTaskLists.resize(threadsN_);
         expTaskLists[0] = new ExpTaskList(this);
+        expTaskLists[0]->setExecutor(branchExecutor());
         connect(expTaskLists[0], &ExpTaskList::taskFailed, this, &ForkJoinTask::onFailed);
         connect(expTaskLists[0], &ExpTaskList::finished, this, &ForkJoinTask::threadFinished);
         expTaskLists[0]->setDelayedDelete(delayedDelete());
@@ -391,6 +530,23 @@ void ForkJoinTask::onceExecuted()
     ExpTask::onceExecuted();
 }
 
+/*!
+   \brief Returns the thread pool shared by the branches of all the
+   ForkJoinTask objects. Its threads do not expire, so no thread is created
+   per started task.
+ */
+QThreadPool *ForkJoinTask::branchExecutor()
+{
+    static QThreadPool executor;
+    static const bool configured = [] {
+        executor.setMaxThreadCount(4);
+        executor.setExpiryTimeout(-1);
+        return true;
+    }();
+    Q_UNUSED(configured);
+    return &executor;
+}
+
 /*!
    \brief Adds task to the particular thread by the ExpTaskList::addTask()
    method.
@@ -5,6 +5,9 @@
 #include <QList>
 #include <QVector>
 
+// forward declarations
+class QThreadPool;
+
 namespace ExpTaskListTraits
 {
 
@@ -32,9 +35,13 @@ enum class TaskType {
     GratingSendToPos,
     SaveLog,
     WinSpecExpList,
+    WinSpecCalExpList,
+    WinSpecAcquireDark,
+    WinSpecDarkExpList,
     WholeExtExpList,
     TExpList,
     ExtTExpList,
+    ExtTExpSeries,
     WholeTExpList,
     BatchExpList,
     WholeBatchExpList
@@ -64,10 +71,10 @@ public:
     // getters
     ExpTaskListTraits::TaskItem getCurrTask() const;
     const QList<ExpTaskListTraits::TaskItem> & getTasks() const { return tasks; }
+    QThreadPool * executor() const { return executor_; }
 
-
-signals:
-    void stopTask();
+    // setters
+    void setExecutor(QThreadPool *executor) { executor_ = executor; }
 
 public slots:
     virtual void start();
@@ -75,18 +82,27 @@ public slots:
 
 protected:
     virtual void taskListFinished();
-    virtual void nextTask();
+    void runTasks();
+    bool stepFinished();
+    ExpTask * currTask() const;
 
 protected slots:
     virtual void taskFinished();
     virtual void onFailed();
 
+private slots:
+    void concurrentStartReturned();
+
 private:
     QList<ExpTaskListTraits::TaskItem> tasks;
-    QList<ExpTaskListTraits::TaskItem> currTasks;
+    int currIndex_;
+    bool blRepeat_;
     bool blRunning;
     bool blStop;
     bool blFailed;
+    QThreadPool *executor_;
+    bool blStarting_;
+    bool blFinishPending_;
 };
 
 class ForkJoinTask : public ExpTask
@@ -97,6 +113,7 @@ public:
     explicit ForkJoinTask(unsigned int threadsN = 2, QObject *parent = 0);
     virtual ~ForkJoinTask();
     virtual void onceExecuted();
+    static QThreadPool * branchExecutor();
 
     void addTask(ExpTaskListTraits::TaskItem tsk, unsigned int threadno);
 
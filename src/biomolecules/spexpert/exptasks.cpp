@@ -12,15 +12,33 @@
 #include "mainwindow.h"
 #include "timespan.h"
 #include "relay.h"
+#include "adaptiveaccumulation.h"
+#include "autoexposure.h"
+#include "darklibrary.h"
+#include "driftmonitor.h"
+#include "spectrumpipeline.h"
 #include <QFileInfo>
 #include <QDir>
 
 #include <QMessageBox>
 
 #include <QTimer>
+#include <QDateTime>
 
 #include <QDebug>
 
+namespace {
+
+// the stage tasks are concurrent, so they may fail in the ForkJoinTask's
+// executor, where no dialog can be shown, AppCore shows it in its thread
+void criticalMessage(AppState *appState, const QString &title, const QString &text)
+{
+    QMetaObject::invokeMethod(appState->appCore(), "showCritical",
+                              Q_ARG(QString, title), Q_ARG(QString, text));
+}
+
+} // namespace
+
 StartWaitingTask::StartWaitingTask(AppState * pappState, const TimeSpan *delay, QObject *parent) :
     ExpTask(parent), pappState_(pappState)
 {
@@ -226,19 +244,21 @@ WinSpecTasks::Start::Start(AppState *pappState_, double dblExposure_,
                          int iAccums_, int iFrames_, const QString & strFileName_, QObject *parent) :
     ExpTask(parent), pwinSpec(pappState_->winSpec()), pappState(pappState_), pwinSpecParams(nullptr),
     dblExposure(dblExposure_), iAccums(iAccums_), iFrames(iFrames_), strFileName(strFileName_),
-    autoGetParams(false), cal_(false)
+    autoGetParams(false), cal_(false), probing_(false), probeExposure_(0.0)
 {
 }
 
 WinSpecTasks::Start::Start(AppState *pappState_, Params *pwinSpecParams_, QObject *parent) :
     ExpTask(parent), pwinSpec(pappState_->winSpec()), pappState(pappState_), pwinSpecParams(pwinSpecParams_),
-    dblExposure(1), iAccums(1), iFrames(1), strFileName(""), autoGetParams(false), cal_(false)
+    dblExposure(1), iAccums(1), iFrames(1), strFileName(""), autoGetParams(false), cal_(false),
+    probing_(false), probeExposure_(0.0)
 {
 }
 
 WinSpecTasks::Start::Start(AppState *pappState_, bool cal, QObject *parent) :
     ExpTask(parent), pwinSpec(pappState_->winSpec()), pappState(pappState_), pwinSpecParams(nullptr),
-    dblExposure(1), iAccums(1), iFrames(1), strFileName(""), autoGetParams(true), cal_(cal)
+    dblExposure(1), iAccums(1), iFrames(1), strFileName(""), autoGetParams(true), cal_(cal),
+    probing_(false), probeExposure_(0.0)
 {
 }
 
@@ -283,15 +303,88 @@ void WinSpecTasks::Start::start()
         if (pwinSpecParams) {
             pwinSpecParams->takeOne(&dblExposure, &iAccums, &iFrames, strFileName);
         }
-        pappState->setLastExpParams(dblExposure, iAccums, iFrames, strFileName);
-        pwinSpec->start(dblExposure, iAccums, iFrames, strFileName);
-        pappState->measurementStartedTime();
-        emit finished();
+
+        // the measurements (not the calibrations) are preceded by a short
+        // probe exposure which sets the exposure time and accumulations
+        biomolecules::spexpert::core::AutoExposureParams autoExposureParams =
+                pappState->autoExposure()->params();
+        if (!cal_ && autoExposureParams.enabled) {
+            startProbe(autoExposureParams.probeExposure);
+            return;
+        }
+        startAcquisition();
+    }
+}
+
+void WinSpecTasks::Start::startProbe(double probeExposure)
+{
+    QFileInfo fileInfo(strFileName);
+    probeExposure_ = probeExposure;
+    probing_ = true;
+    qDebug() << "WinSpecTasks::Start::startProbe(): probe exposure" << probeExposure_;
+    pwinSpec->start(probeExposure_, 1, 1,
+                    QDir::toNativeSeparators(fileInfo.path()) % QDir::separator() % "autoexposure.spe");
+    QTimer::singleShot(static_cast<int>(1000 * probeExposure_), this, SLOT(checkProbe()));
+}
+
+void WinSpecTasks::Start::checkProbe()
+{
+    if (!probing_) {
+        return;
+    }
+    if (pwinSpec->running()) {
+        QTimer::singleShot(100, this, SLOT(checkProbe()));
+        return;
+    }
+    probing_ = false;
+
+    QVariantList probe;
+    int frames;
+    int x;
+    int y;
+    if (pwinSpec->getRawSpectrum(probe, &frames, &x, &y)) {
+        biomolecules::spexpert::core::AutoExposure *autoExposure = pappState->autoExposure();
+        if (autoExposure->plan(probe, frames, x, y, probeExposure_, &dblExposure, &iAccums)) {
+            qDebug() << "WinSpecTasks::Start::checkProbe(): probe peak" << autoExposure->lastPeak()
+                     << ", offset" << autoExposure->lastOffset() << ", saturated" << autoExposure->lastSaturated()
+                     << ", exposure" << dblExposure << ", accumulations" << iAccums;
+        } else if (autoExposure->lastSaturated()) {
+            // the clipped peak says nothing about the real intensity
+            qDebug() << "WinSpecTasks::Start::checkProbe(): probe saturated, repeating it shorter";
+            startProbe(autoExposure->shorterProbe(probeExposure_));
+            return;
+        } else {
+            qDebug() << "WinSpecTasks::Start::checkProbe(): unusable probe, keeping the requested exposure";
+        }
+    } else {
+        qDebug() << "WinSpecTasks::Start::checkProbe(): probe spectrum not available, keeping the requested exposure";
+    }
+    startAcquisition();
+}
+
+/*!
+   \brief Starts the real acquisition. The parameters are logged after it by
+   LogLastExpParams from AppState::lastExpParams(), where WinSpecWaitTask
+   updates the accumulations if the adaptive accumulation stops early.
+ */
+void WinSpecTasks::Start::startAcquisition()
+{
+    // the adaptive accumulation is started with the maximum accumulations and
+    // stopped by WinSpecWaitTask when the target SNR is reached
+    biomolecules::spexpert::core::AdaptiveAccumulationParams *adaptiveParams =
+            pappState->adaptiveAccumulationParams();
+    if (!cal_ && adaptiveParams->enabled && iFrames == 1) {
+        iAccums = biomolecules::spexpert::core::AdaptiveAccumulation::maxAccums(*adaptiveParams, dblExposure, iAccums);
     }
+    pappState->setLastExpParams(dblExposure, iAccums, iFrames, strFileName);
+    pwinSpec->start(dblExposure, iAccums, iFrames, strFileName);
+    pappState->measurementStartedTime();
+    emit finished();
 }
 
 void WinSpecTasks::Start::stop()
 {
+    probing_ = false;
     pwinSpec->stop();
     ExpTask::stop();
 }
@@ -313,6 +406,7 @@ void WinSpecTasks::LogLastExpParams::start()
     int frm;
     QString fn;
     appState_->lastExpParams(&expo, &acc, &frm, &fn);
+    measurementLog_->setMeasTime(appState_->getMeasurementStartedTime());
     measurementLog_->setExpParams(expo, acc, frm, fn);
     measurementLog_->setSaveGrPos(appState_->lastGrPos());
 
@@ -371,13 +465,25 @@ WinSpecTasks::ExpList::ExpList(AppState *appState, bool cal, int expNumber, QObj
     taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecStart;
     addTask(taskItem);
 
-    if (!cal) {
-        if (appState->initWinSpecParams()->tExp.tExp) {
-            taskItem.task = new NeslabTasks::ReadT(appState, this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::NesalbReadT;
-            addTask(taskItem);
-        }
+    if (!cal && appState->initWinSpecParams()->tExp.tExp) {
+        taskItem.task = new NeslabTasks::ReadT(appState, this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::NesalbReadT;
+        addTask(taskItem);
+    }
 
+    waitTaskItem.task  = new WinSpecWaitTask(appState, appState);
+    waitTaskItem.waitFor = WaitTaskListTraits::WaitFor::WinSpec;
+    taskItem.task =  new WaitExpTask(waitTaskItem, this);
+    taskItem.taskType = ExpTaskListTraits::TaskType::WaitExp;
+    addTask(taskItem);
+
+    taskItem.task = new WaitingTask(this);
+    taskItem.taskType = ExpTaskListTraits::TaskType::Waiting;
+    addTask(taskItem);
+
+    if (!cal) {
+        // logged after the acquisition, which may change the exposure and
+        // accumulations or flag the spectrum, see WinSpecWaitTask
         taskItem.task = new WinSpecTasks::LogLastExpParams(appState, this);
         taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecLogLastExpParams;
         addTask(taskItem);
@@ -387,7 +493,81 @@ WinSpecTasks::ExpList::ExpList(AppState *appState, bool cal, int expNumber, QObj
         addTask(taskItem);
     }
 
-    waitTaskItem.task  = new WinSpecWaitTask(appState, appState);
+    if (cal && appState->initWinSpecParams()->cal.at(expNumber).enableLampSwitch) {
+        biomolecules::sprelay::core::k8090::CommandID commandId;
+        if (appState->relaySettings()->calibration_lamp_switch_on) {
+            commandId = biomolecules::sprelay::core::k8090::CommandID::RelayOff;
+        } else {
+            commandId = biomolecules::sprelay::core::k8090::CommandID::RelayOn;
+        }
+        taskItem.task = new RelayTasks::SwitchRelay{
+            appState->k8090(),
+            commandId,
+            appState->relaySettings()->calibration_lamp_switch_id};
+        taskItem.taskType = ExpTaskListTraits::TaskType::SwitchRelay;
+        addTask(taskItem);
+    }
+}
+
+WinSpecTasks::CalExpList::CalExpList(AppState *appState, int expNumber, QObject *parent) :
+    ExpTaskList(parent), appState_(appState), checkingDrift_(false)
+{
+    ExpTaskListTraits::TaskItem taskItem;
+    WaitTaskListTraits::TaskItem waitTaskItem;
+    bool lampSwitch = appState->initWinSpecParams()->cal.at(expNumber).enableLampSwitch;
+
+    if (lampSwitch) {
+        ForkJoinTask *forkJoinTask = new ForkJoinTask(2, this);
+
+        // thread no. 0
+        taskItem.task = new StageTasks::GoToPosExpList(appState, StageControlTraits::PosType::Calibration, this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::StageControlGoToPosExpList;
+        forkJoinTask->addTask(taskItem, 0);
+
+        // thread no. 1, the lamp warms up while the stage is moving
+        biomolecules::sprelay::core::k8090::CommandID commandId;
+        if (appState->relaySettings()->calibration_lamp_switch_on) {
+            commandId = biomolecules::sprelay::core::k8090::CommandID::RelayOn;
+        } else {
+            commandId = biomolecules::sprelay::core::k8090::CommandID::RelayOff;
+        }
+        taskItem.task = new RelayTasks::SwitchRelay{
+            appState->k8090(),
+            commandId,
+            appState->relaySettings()->calibration_lamp_switch_id};
+        taskItem.taskType = ExpTaskListTraits::TaskType::SwitchRelay;
+        forkJoinTask->addTask(taskItem, 1);
+
+        TimeSpan calibration_lamp_switch_delay;
+        calibration_lamp_switch_delay
+            .fromMSec(appState->relaySettings()->calibration_lamp_switch_delay_msec);
+        waitTaskItem.task = new DelayWaitTask(
+            appState, &calibration_lamp_switch_delay, this);
+        waitTaskItem.waitFor = WaitTaskListTraits::WaitFor::Lamp;
+        taskItem.task = new WaitExpTask(waitTaskItem, this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::WaitExp;
+        forkJoinTask->addTask(taskItem, 1);
+
+        taskItem.task = new WaitingTask(this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::Waiting;
+        forkJoinTask->addTask(taskItem, 1);
+
+        taskItem.task = forkJoinTask;
+        taskItem.taskType = ExpTaskListTraits::TaskType::ForkJoin;
+        addTask(taskItem);
+    } else {
+        taskItem.task = new StageTasks::GoToPosExpList(appState, StageControlTraits::PosType::Calibration, this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::StageControlGoToPosExpList;
+        addTask(taskItem);
+    }
+
+    taskItem.task = new WinSpecTasks::Start(appState, true, this);
+    taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecStart;
+    addTask(taskItem);
+
+    WinSpecWaitTask *winSpecWaitTask = new WinSpecWaitTask(appState, appState);
+    winSpecWaitTask->setCalibration(true);
+    waitTaskItem.task = winSpecWaitTask;
     waitTaskItem.waitFor = WaitTaskListTraits::WaitFor::WinSpec;
     taskItem.task =  new WaitExpTask(waitTaskItem, this);
     taskItem.taskType = ExpTaskListTraits::TaskType::WaitExp;
@@ -397,7 +577,7 @@ WinSpecTasks::ExpList::ExpList(AppState *appState, bool cal, int expNumber, QObj
     taskItem.taskType = ExpTaskListTraits::TaskType::Waiting;
     addTask(taskItem);
 
-    if (cal && appState->initWinSpecParams()->cal.at(expNumber).enableLampSwitch) {
+    if (lampSwitch) {
         biomolecules::sprelay::core::k8090::CommandID commandId;
         if (appState->relaySettings()->calibration_lamp_switch_on) {
             commandId = biomolecules::sprelay::core::k8090::CommandID::RelayOff;
@@ -413,6 +593,176 @@ WinSpecTasks::ExpList::ExpList(AppState *appState, bool cal, int expNumber, QObj
     }
 }
 
+void WinSpecTasks::CalExpList::start()
+{
+    if (running() || checkingDrift_) {
+        return;
+    }
+    if (!appState_->spectrumPipeline()->driftMonitor()->params().enabled) {
+        ExpTaskList::start();
+        return;
+    }
+    checkingDrift_ = true;
+    checkDrift();
+}
+
+void WinSpecTasks::CalExpList::stop()
+{
+    checkingDrift_ = false;
+    ExpTaskList::stop();
+}
+
+// the drift monitor has to see the last measured spectrum, the pipeline is
+// polled, so the GUI thread does not wait for the processing and saving
+void WinSpecTasks::CalExpList::checkDrift()
+{
+    if (!checkingDrift_) {
+        return;
+    }
+    biomolecules::spexpert::core::SpectrumPipeline *pipeline = appState_->spectrumPipeline();
+    if (pipeline->pending()) {
+        QTimer::singleShot(100, this, SLOT(checkDrift()));
+        return;
+    }
+    checkingDrift_ = false;
+    // the calibration is taken at the grating position of the last measurement
+    int window = appState_->lastWindow();
+    if (!pipeline->driftMonitor()->calibrationNeeded(window)) {
+        qDebug() << "WinSpecTasks::CalExpList::checkDrift(): drift" << pipeline->driftMonitor()->lastShift(window)
+                 << "px after" << pipeline->driftMonitor()->sinceCalibration(window)
+                 << "measurements in window" << window << ", skipping calibration.";
+        emit finished();
+        return;
+    }
+    ExpTaskList::start();
+}
+
+WinSpecTasks::AcquireDark::AcquireDark(AppState *appState, int expNumber, QObject *parent) :
+    ExpTask(parent), appState_(appState), winSpec_(appState->winSpec()), expNumber_(expNumber)
+{
+}
+
+void WinSpecTasks::AcquireDark::start()
+{
+    if (winSpec_->running()) {
+        qDebug() << "WinSpecTasks::AcquireDark::start(): WinSpec is running, waiting.";
+        QTimer::singleShot(300, this, SLOT(start()));
+        return;
+    }
+
+    const AppStateTraits::ExpWinSpecParams &expe = appState_->initWinSpecParams()->expe.at(expNumber_);
+    QString fileName = expe.directory % QDir::separator() % "dark_" % QString::number(expe.expo)
+            % "s_" % QString::number(expe.acc) % "acc.spe";
+    appState_->setLastExpParams(expe.expo, expe.acc, expe.frm, fileName);
+    winSpec_->start(expe.expo, expe.acc, expe.frm, fileName);
+    emit finished();
+}
+
+void WinSpecTasks::AcquireDark::stop()
+{
+    winSpec_->stop();
+    ExpTask::stop();
+}
+
+WinSpecTasks::DarkExpList::DarkExpList(AppState *appState, int expNumber, QObject *parent) :
+    ExpTaskList(parent), appState_(appState), expNumber_(expNumber)
+{
+    ExpTaskListTraits::TaskItem taskItem;
+    WaitTaskListTraits::TaskItem waitTaskItem;
+    biomolecules::spexpert::relay::Settings *relaySettings = appState->relaySettings();
+
+    if (relaySettings->dark_shutter_switch_enabled) {
+        biomolecules::sprelay::core::k8090::CommandID commandId;
+        if (relaySettings->dark_shutter_switch_on) {
+            commandId = biomolecules::sprelay::core::k8090::CommandID::RelayOn;
+        } else {
+            commandId = biomolecules::sprelay::core::k8090::CommandID::RelayOff;
+        }
+        taskItem.task = new RelayTasks::SwitchRelay{
+            appState->k8090(), commandId, relaySettings->dark_shutter_switch_id};
+        taskItem.taskType = ExpTaskListTraits::TaskType::SwitchRelay;
+        addTask(taskItem);
+
+        TimeSpan dark_shutter_switch_delay;
+        dark_shutter_switch_delay.fromMSec(relaySettings->dark_shutter_switch_delay_msec);
+        waitTaskItem.task = new DelayWaitTask(appState, &dark_shutter_switch_delay, this);
+        waitTaskItem.waitFor = WaitTaskListTraits::WaitFor::Lamp;
+        taskItem.task = new WaitExpTask(waitTaskItem, this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::WaitExp;
+        addTask(taskItem);
+
+        taskItem.task = new WaitingTask(this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::Waiting;
+        addTask(taskItem);
+    }
+
+    taskItem.task = new WinSpecTasks::AcquireDark(appState, expNumber, this);
+    taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecAcquireDark;
+    addTask(taskItem);
+
+    WinSpecWaitTask *winSpecWaitTask = new WinSpecWaitTask(appState, appState);
+    winSpecWaitTask->setDarkAcquisition(true);
+    waitTaskItem.task = winSpecWaitTask;
+    waitTaskItem.waitFor = WaitTaskListTraits::WaitFor::WinSpec;
+    taskItem.task = new WaitExpTask(waitTaskItem, this);
+    taskItem.taskType = ExpTaskListTraits::TaskType::WaitExp;
+    addTask(taskItem);
+
+    taskItem.task = new WaitingTask(this);
+    taskItem.taskType = ExpTaskListTraits::TaskType::Waiting;
+    addTask(taskItem);
+
+    if (relaySettings->dark_shutter_switch_enabled) {
+        biomolecules::sprelay::core::k8090::CommandID commandId;
+        if (relaySettings->dark_shutter_switch_on) {
+            commandId = biomolecules::sprelay::core::k8090::CommandID::RelayOff;
+        } else {
+            commandId = biomolecules::sprelay::core::k8090::CommandID::RelayOn;
+        }
+        taskItem.task = new RelayTasks::SwitchRelay{
+            appState->k8090(), commandId, relaySettings->dark_shutter_switch_id};
+        taskItem.taskType = ExpTaskListTraits::TaskType::SwitchRelay;
+        addTask(taskItem);
+    }
+}
+
+/*!
+   \brief Tells if the missing darks are acquired during the waits. The dark
+   is taken right after the stage moves to the measurement position, so the
+   sample has to be closed by the dark shutter relay, otherwise the lit frames
+   would be stored as darks.
+ */
+bool WinSpecTasks::DarkExpList::idleAcquisition(AppState *appState)
+{
+    biomolecules::spexpert::core::DarkLibraryParams darkParams =
+            appState->spectrumPipeline()->darkLibrary()->params();
+    return darkParams.enabled && darkParams.idleAcquisition
+            && appState->relaySettings()->dark_shutter_switch_enabled;
+}
+
+void WinSpecTasks::DarkExpList::start()
+{
+    if (running()) {
+        return;
+    }
+    // decided before the shutter is switched, the dark is only a filler and
+    // must not prolong the wait
+    const AppStateTraits::ExpWinSpecParams &expe = appState_->initWinSpecParams()->expe.at(expNumber_);
+    biomolecules::spexpert::core::DarkLibrary *darkLibrary = appState_->spectrumPipeline()->darkLibrary();
+    if (darkLibrary->contains(darkLibrary->key(expe.expo, expe.acc))) {
+        emit finished();
+        return;
+    }
+    qint64 darkMSec = static_cast<qint64>(1000 * expe.expo * expe.acc * expe.frm) + 2000
+            + 2 * appState_->relaySettings()->dark_shutter_switch_delay_msec;
+    if (QDateTime::currentDateTime().msecsTo(appState_->getWaitingFinishTime()) < darkMSec) {
+        qDebug() << "WinSpecTasks::DarkExpList::start(): not enough time for the dark, skipping.";
+        emit finished();
+        return;
+    }
+    ExpTaskList::start();
+}
+
 StageTasks::Run::Run(AppState *pappState, int dest,
                      StageControlTraits::ReferenceType refType, QObject *parent) :
     ExpTask(parent), pstageControl_(pappState->stageControl()), pappState_(pappState), dest_(dest), refType_(refType)
@@ -423,20 +773,16 @@ void StageTasks::Run::start()
 {
     if (!pstageControl_->connected())
     {
-        QMessageBox::critical(pappState_->appCore()->mainWindow(),
-                              tr("Stage is not connected!"),
-                              tr("Stage failed to start movement because it is not connected."),
-                              QMessageBox::Ok);
+        criticalMessage(pappState_, tr("Stage is not connected!"),
+                        tr("Stage failed to start movement because it is not connected."));
         emit taskFailed();
         emit finished();
         return;
     }
     if (pstageControl_->motorRunning())
     {
-        QMessageBox::critical(pappState_->appCore()->mainWindow(),
-                              tr("Stage is already running!"),
-                              tr("Stage failed to start movement because it is already running."),
-                              QMessageBox::Ok);
+        criticalMessage(pappState_, tr("Stage is already running!"),
+                        tr("Stage failed to start movement because it is already running."));
         emit taskFailed();
         emit finished();
         return;
@@ -464,20 +810,16 @@ void StageTasks::GoToLim::start()
 {
     if (!pstageControl_->connected())
     {
-        QMessageBox::critical(pappState_->appCore()->mainWindow(),
-                              tr("Stage is not connected!"),
-                              tr("Stage failed to start movement because it is not connected."),
-                              QMessageBox::Ok);
+        criticalMessage(pappState_, tr("Stage is not connected!"),
+                        tr("Stage failed to start movement because it is not connected."));
         emit taskFailed();
         emit finished();
         return;
     }
     if (pstageControl_->motorRunning())
     {
-        QMessageBox::critical(pappState_->appCore()->mainWindow(),
-                              tr("Stage is already running!"),
-                              tr("Stage failed to start movement because it is already running."),
-                              QMessageBox::Ok);
+        criticalMessage(pappState_, tr("Stage is already running!"),
+                        tr("Stage failed to start movement because it is already running."));
         emit taskFailed();
         emit finished();
         return;
@@ -513,20 +855,16 @@ void StageTasks::SendToPos::start()
 {
     if (!pstageControl_->connected())
     {
-        QMessageBox::critical(pappState_->appCore()->mainWindow(),
-                              tr("Stage is not connected!"),
-                              tr("Stage failed to start movement because it is not connected."),
-                              QMessageBox::Ok);
+        criticalMessage(pappState_, tr("Stage is not connected!"),
+                        tr("Stage failed to start movement because it is not connected."));
         emit taskFailed();
         emit finished();
         return;
     }
     if (pstageControl_->motorRunning())
     {
-        QMessageBox::critical(pappState_->appCore()->mainWindow(),
-                              tr("Stage is already running!"),
-                              tr("Stage failed to start movement because it is already running."),
-                              QMessageBox::Ok);
+        criticalMessage(pappState_, tr("Stage is already running!"),
+                        tr("Stage failed to start movement because it is already running."));
         emit taskFailed();
         emit finished();
         return;
@@ -561,10 +899,8 @@ void StageTasks::SwitchPower::start()
 {
     if (!pstageControl_->connected())
     {
-        QMessageBox::critical(pappState_->appCore()->mainWindow(),
-                              tr("Stage is not connected"),
-                              tr("Stage failed to start movement because it is not connected"),
-                              QMessageBox::Ok);
+        criticalMessage(pappState_, tr("Stage is not connected"),
+                        tr("Stage failed to start movement because it is not connected"));
         emit taskFailed();
         emit finished();
         return;
@@ -1088,12 +1424,8 @@ WholeExtExpList::WholeExtExpList(AppState *appState, QObject *parent) :
             taskItem.taskType = ExpTaskListTraits::TaskType::StartWaiting;
             addTask(taskItem);
 
-            taskItem.task = new StageTasks::GoToPosExpList(appState, StageControlTraits::PosType::Calibration, this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::StageControlGoToPosExpList;
-            addTask(taskItem);
-
-            taskItem.task = new WinSpecTasks::ExpList(appState, true, ii, this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
+            taskItem.task = new WinSpecTasks::CalExpList(appState, ii, this);
+            taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecCalExpList;
             addTask(taskItem);
 
             ForkJoinTask *fj = new ForkJoinTask(2, this);
@@ -1178,6 +1510,9 @@ TExpList::TExpList(AppState *appState, TimeSpan *delay, int expNumber, int shift
     WaitTaskListTraits::TaskItem waitTaskItem;
     ForkJoinTask * forkJoinTask;
 
+    // missing darks are acquired while the bath settles
+    bool idleDarks = WinSpecTasks::DarkExpList::idleAcquisition(appState);
+
     taskItem.task = new WinSpecTasks::ExpList(appState, false, expNumber, this);
     taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
     addTask(taskItem);
@@ -1205,12 +1540,8 @@ TExpList::TExpList(AppState *appState, TimeSpan *delay, int expNumber, int shift
             forkJoinTask->addTask(taskItem, 0);
 
             // thread no. 1
-            taskItem.task = new StageTasks::GoToPosExpList(appState, StageControlTraits::PosType::Calibration, this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::StageControlGoToPosExpList;
-            forkJoinTask->addTask(taskItem, 1);
-
-            taskItem.task = new WinSpecTasks::ExpList(appState, true, expNumber, this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
+            taskItem.task = new WinSpecTasks::CalExpList(appState, expNumber, this);
+            taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecCalExpList;
             forkJoinTask->addTask(taskItem, 1);
 
             if (params->extRan.extendedRange && params->expe.size() > 1) {
@@ -1242,6 +1573,11 @@ TExpList::TExpList(AppState *appState, TimeSpan *delay, int expNumber, int shift
                 taskItem.taskType = ExpTaskListTraits::TaskType::StageControlGoToPosExpList;
                 forkJoinTask->addTask(taskItem, 1);
             }
+            if (idleDarks) {
+                taskItem.task = new WinSpecTasks::DarkExpList(appState, expNumber, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecDarkExpList;
+                forkJoinTask->addTask(taskItem, 1);
+            }
             // ForkJoinTask filling end
 
             taskItem.task = forkJoinTask;
@@ -1260,15 +1596,39 @@ TExpList::TExpList(AppState *appState, TimeSpan *delay, int expNumber, int shift
                 addTask(taskItem);
             }
 
-            waitTaskItem.task = new DelayWaitTask(appState, delay, appState);
-            waitTaskItem.waitFor = WaitTaskListTraits::WaitFor::Delay;
-            taskItem.task = new WaitExpTask(waitTaskItem, this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::WaitExp;
-            addTask(taskItem);
+            if (idleDarks) {
+                forkJoinTask = new ForkJoinTask(2, this);
 
-            taskItem.task = new WaitingTask(this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::Waiting;
-            addTask(taskItem);
+                // thread no. 0
+                waitTaskItem.task = new DelayWaitTask(appState, delay, appState);
+                waitTaskItem.waitFor = WaitTaskListTraits::WaitFor::Delay;
+                taskItem.task = new WaitExpTask(waitTaskItem, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::WaitExp;
+                forkJoinTask->addTask(taskItem, 0);
+
+                taskItem.task = new WaitingTask(this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::Waiting;
+                forkJoinTask->addTask(taskItem, 0);
+
+                // thread no. 1
+                taskItem.task = new WinSpecTasks::DarkExpList(appState, expNumber, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecDarkExpList;
+                forkJoinTask->addTask(taskItem, 1);
+
+                taskItem.task = forkJoinTask;
+                taskItem.taskType = ExpTaskListTraits::TaskType::ForkJoin;
+                addTask(taskItem);
+            } else {
+                waitTaskItem.task = new DelayWaitTask(appState, delay, appState);
+                waitTaskItem.waitFor = WaitTaskListTraits::WaitFor::Delay;
+                taskItem.task = new WaitExpTask(waitTaskItem, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::WaitExp;
+                addTask(taskItem);
+
+                taskItem.task = new WaitingTask(this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::Waiting;
+                addTask(taskItem);
+            }
         }
 
         taskItem.task = new FinishWaitingTask(appState, this);
@@ -1284,12 +1644,8 @@ TExpList::TExpList(AppState *appState, TimeSpan *delay, int expNumber, int shift
         taskItem.taskType = ExpTaskListTraits::TaskType::NeslabSetT;
         addTask(taskItem);
 
-        taskItem.task = new StageTasks::GoToPosExpList(appState, StageControlTraits::PosType::Calibration, this);
-        taskItem.taskType = ExpTaskListTraits::TaskType::StageControlGoToPosExpList;
-        addTask(taskItem);
-
-        taskItem.task = new WinSpecTasks::ExpList(appState, true, expNumber, this);
-        taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
+        taskItem.task = new WinSpecTasks::CalExpList(appState, expNumber, this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecCalExpList;
         addTask(taskItem);
 
         if (params->extRan.extendedRange && params->expe.size() > 1) {
@@ -1353,12 +1709,57 @@ TExpList::TExpList(AppState *appState, TimeSpan *delay, int expNumber, int shift
 
 ExtTExpList::ExtTExpList(AppState *appState, TimeSpan *delay, int shiftT,
                          bool last, QObject *parent) :
+    ExtTExpList(appState, delay, shiftT, last, Order::Cyclic, parent)
+{
+}
+
+ExtTExpList::ExtTExpList(AppState *appState, TimeSpan *delay, int shiftT,
+                         bool last, Order order, QObject *parent) :
     ExpTaskList(parent)
 {
     AppStateTraits::InitWinSpecParams *params = appState->initWinSpecParams();
 
     ExpTaskListTraits::TaskItem taskItem;
 
+    int n = expNumberStep(appState);
+    int windows = params->expe.size();
+    int step = (order == Order::Descending) ? -1 : 1;
+    int first = (order == Order::Descending) ? windows - 1 : 0;
+
+    for (int ii = 0; ii < windows - 1; ++ii) {
+        taskItem.task = new TExpList(appState, delay, first + step * ii, step * n, false, step * n, this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::TExpList;
+        addTask(taskItem);
+
+        taskItem.task = new WinSpecTasks::AddExpNumber(
+                    appState, step * n, this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecAddExpNumber;
+        addTask(taskItem);
+    }
+    if (!last) {
+        // the cyclic order returns to the first window, the others stay at the
+        // last one and the next temperature walks the windows back
+        int back = (order == Order::Cyclic) ? - (windows - 1) * n : 0;
+        taskItem.task = new TExpList(appState, delay, first + step * (windows - 1), back + shiftT, true,
+                                     back + shiftT, this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::TExpList;
+        addTask(taskItem);
+
+        if (back != 0) {
+            taskItem.task = new WinSpecTasks::AddExpNumber(
+                        appState, back, this);
+            taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecAddExpNumber;
+            addTask(taskItem);
+        }
+    }
+}
+
+/*!
+   \brief The difference of the experiment numbers of the neighbouring windows.
+ */
+int ExtTExpList::expNumberStep(AppState *appState)
+{
+    AppStateTraits::InitWinSpecParams *params = appState->initWinSpecParams();
     int n;
     if (params->batch.batchExp && params->tExp.tExp) {
         n = params->batch.numSpectra;
@@ -1368,30 +1769,113 @@ ExtTExpList::ExtTExpList(AppState *appState, TimeSpan *delay, int shiftT,
     if (params->tExp.loop) {
         n = 2 * n;
     }
+    return n;
+}
+
+/*!
+   \class ExtTExpSeries
+   \brief Measures \a steps temperatures of the extended range experiment,
+   \a firstStep is the number of the temperatures measured before.
+
+   In the serpentine order (AppStateTraits::ExtendedRangeParams::serpentine)
+   the odd temperatures walk the windows backwards, so the grating moves only
+   to the neighbouring window at every temperature change instead of returning
+   to the first window. Every window still uses its own WinSpecTasks::Params and
+   temperatures, so the file numbering does not depend on the order.
+
+   If \a last is true, the last temperature ends with the measurement of the
+   last window in its order without the delay. The experiment number and the
+   grating are left at that window, which is the first window if the last
+   temperature walks the windows backwards, so the final calibration and the
+   next spectrum of the batch have to start from it, see end().
+ */
+ExtTExpSeries::ExtTExpSeries(AppState *appState, TimeSpan *delay, int shiftT, int steps, int firstStep,
+                             bool last, QObject *parent) :
+    ExpTaskList(parent)
+{
+    AppStateTraits::InitWinSpecParams *params = appState->initWinSpecParams();
 
-    for (int ii = 0; ii < params->expe.size() - 1; ++ii) {
-        taskItem.task = new TExpList(appState, delay, ii, n, false, n, this);
-        taskItem.taskType = ExpTaskListTraits::TaskType::TExpList;
-        addTask(taskItem);
+    ExpTaskListTraits::TaskItem taskItem;
+    ExtTExpList *extTExpList;
 
-        taskItem.task = new WinSpecTasks::AddExpNumber(
-                    appState, n, this);
-        taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecAddExpNumber;
+    int repeated = last ? steps - 1 : steps;
+    if (!params->extRan.serpentine) {
+        extTExpList = new ExtTExpList(appState, delay, shiftT, false, this);
+        extTExpList->setTimesExec(repeated);
+        taskItem.task = extTExpList;
+        taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
         addTask(taskItem);
+    } else {
+        if (repeated > 1) {
+            ExpTaskList *pair = new ExpTaskList(this);
+
+            taskItem.task = new ExtTExpList(appState, delay, shiftT, false, order(appState, firstStep), pair);
+            taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+            pair->addTask(taskItem);
+
+            taskItem.task = new ExtTExpList(appState, delay, shiftT, false, order(appState, firstStep + 1), pair);
+            taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+            pair->addTask(taskItem);
+
+            pair->setTimesExec(repeated / 2);
+            taskItem.task = pair;
+            taskItem.taskType = ExpTaskListTraits::TaskType::ExpList;
+            addTask(taskItem);
+        }
+        if (repeated % 2) {
+            taskItem.task = new ExtTExpList(appState, delay, shiftT, false,
+                                            order(appState, firstStep + repeated - 1), this);
+            taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+            addTask(taskItem);
+        }
     }
-    if (!last) {
-        taskItem.task = new TExpList(appState, delay, params->expe.size() - 1, - (params->expe.size() - 1) * n + shiftT, true,
-                                     - (params->expe.size() - 1) * n + shiftT, this);
-        taskItem.taskType = ExpTaskListTraits::TaskType::TExpList;
-        addTask(taskItem);
 
-        taskItem.task = new WinSpecTasks::AddExpNumber(
-                    appState, - (params->expe.size() - 1) * n, this);
-        taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecAddExpNumber;
+    if (last && steps > 0) {
+        ExtTExpList::Order lastOrder = order(appState, firstStep + steps - 1);
+        bool descending = (lastOrder == ExtTExpList::Order::Descending);
+
+        // the last task is may be without delay, so the last task is only
+        // spectrum measurement, see next taskItem.
+        if (params->expe.size() > 1) {
+            taskItem.task = new ExtTExpList(appState, delay, 0, true, lastOrder, this);
+            taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+            addTask(taskItem);
+        }
+        taskItem.task = new WinSpecTasks::ExpList(appState, false, descending ? 0 : params->expe.size() - 1, this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
         addTask(taskItem);
     }
 }
 
+ExtTExpList::Order ExtTExpSeries::order(AppState *appState, int step)
+{
+    return biomolecules::spexpert::core::windowOrder(appState->initWinSpecParams()->extRan.serpentine, step);
+}
+
+/*!
+   \brief The window of the extended range experiment measured last, where
+   the grating and the experiment number stay, and the shift of the experiment
+   number from it back to the first window.
+
+   The whole series of the temperatures is considered, as it is built by
+   WholeTExpList, BatchExpList and WholeBatchExpList.
+ */
+biomolecules::spexpert::core::SeriesEnd ExtTExpSeries::end(AppState *appState)
+{
+    AppStateTraits::InitWinSpecParams *params = appState->initWinSpecParams();
+    if (!params->tExp.tExp) {
+        return biomolecules::spexpert::core::seriesEnd(params->expe.size(), 1, 1, false, false);
+    }
+    int sign = ((params->tExp.endT == params->tExp.startT) ?
+                    0 :
+                    (params->tExp.endT > params->tExp.startT) ?
+                        1 : -1);
+    int numTMeas = sign * int((params->tExp.endT - params->tExp.startT) /
+            params->tExp.stepT) + 1;
+    return biomolecules::spexpert::core::seriesEnd(params->expe.size(), ExtTExpList::expNumberStep(appState),
+                                                   numTMeas, params->tExp.loop, params->extRan.serpentine);
+}
+
 WholeTExpList::WholeTExpList(AppState *appState, QObject *parent) :
     ExpTaskList(parent)
 {
@@ -1407,19 +1891,16 @@ WholeTExpList::WholeTExpList(AppState *appState, QObject *parent) :
     ExpTaskListTraits::TaskItem taskItem;
     WaitTaskListTraits::TaskItem waitTaskItem;
     TExpList *tExpList;
-    ExtTExpList *extTExpList;
 
     if (numTMeas > 1) {
         if (params->extRan.extendedRange) {
             if (params->tExp.loop) {
-                extTExpList = new ExtTExpList(appState, &params->tExp.delay, 0, false, this);
-                extTExpList->setTimesExec(numTMeas - 1);
-                taskItem.task = extTExpList;
-                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+                taskItem.task = new ExtTExpSeries(appState, &params->tExp.delay, 0, numTMeas - 1, 0, false, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpSeries;
                 addTask(taskItem);
 
-                taskItem.task =  new ExtTExpList(appState, &params->tExp.loopDelay, 1, false, this);
-                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+                taskItem.task = new ExtTExpSeries(appState, &params->tExp.loopDelay, 1, 1, numTMeas - 1, false, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpSeries;
                 addTask(taskItem);
 
                 taskItem.task = new WinSpecTasks::AddExpNumber(appState, 1, this);
@@ -1427,38 +1908,14 @@ WholeTExpList::WholeTExpList(AppState *appState, QObject *parent) :
                         ExpTaskListTraits::TaskType::WinSpecAddExpNumber;
                 addTask(taskItem);
 
-                extTExpList = new ExtTExpList(appState, &params->tExp.loopDelay, 0, false, this);
-                extTExpList->setTimesExec(numTMeas - 2);
-                taskItem.task = extTExpList;
-                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+                taskItem.task = new ExtTExpSeries(appState, &params->tExp.loopDelay, 0, numTMeas - 1, numTMeas, true, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpSeries;
                 addTask(taskItem);
-
-                // the last task is may be without delay, so the last task is only
-                // spectrum measurement, see next taskItem.
-                if (params->expe.size() > 1) {
-                    taskItem.task = new ExtTExpList(appState, &params->tExp.loopDelay, 0, true, this);
-                    taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
-                    addTask(taskItem);
-                }
             } else {
-                extTExpList =
-                        new ExtTExpList(appState, &params->tExp.delay, 0, false, this);
-                extTExpList->setTimesExec(numTMeas - 1);
-                taskItem.task = extTExpList;
-                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+                taskItem.task = new ExtTExpSeries(appState, &params->tExp.delay, 0, numTMeas, 0, true, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpSeries;
                 addTask(taskItem);
-
-                // the last task is may be without delay, so the last task is only
-                // spectrum measurement, see next taskItem.
-                if (params->expe.size() > 1) {
-                    taskItem.task = new ExtTExpList(appState, &params->tExp.delay, 0, true, this);
-                    taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
-                    addTask(taskItem);
-                }
             }
-            taskItem.task = new WinSpecTasks::ExpList(appState, false, params->expe.size() - 1, this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
-            addTask(taskItem);
         } else {
             if (params->tExp.loop) {
                 tExpList = new TExpList(appState, &params->tExp.delay, 0, 0, true, 0, this);
@@ -1502,9 +1959,11 @@ WholeTExpList::WholeTExpList(AppState *appState, QObject *parent) :
         taskItem.taskType = ExpTaskListTraits::TaskType::NeslabSetT;
         addTask(taskItem);
     }
+    // the final calibration is taken in the window measured last, where the
+    // grating stays, which is the first one after the backward pass
     int lastExpNumber;
     if (params->extRan.extendedRange) {
-        lastExpNumber = params->expe.size() - 1;
+        lastExpNumber = ExtTExpSeries::end(appState).window;
     } else {
         lastExpNumber = 0;
     }
@@ -1514,12 +1973,8 @@ WholeTExpList::WholeTExpList(AppState *appState, QObject *parent) :
         taskItem.taskType = ExpTaskListTraits::TaskType::StartWaiting;
         addTask(taskItem);
 
-        taskItem.task = new StageTasks::GoToPosExpList(appState, StageControlTraits::PosType::Calibration, this);
-        taskItem.taskType = ExpTaskListTraits::TaskType::StageControlGoToPosExpList;
-        addTask(taskItem);
-
-        taskItem.task = new WinSpecTasks::ExpList(appState, true, lastExpNumber, this);
-        taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
+        taskItem.task = new WinSpecTasks::CalExpList(appState, lastExpNumber, this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecCalExpList;
         addTask(taskItem);
 
         if (params->extRan.extendedRange) {
@@ -1600,16 +2055,13 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
                 params->tExp.stepT) + 1;
         if (numTMeas > 1) {
             if (params->extRan.extendedRange) {
-                ExtTExpList *extTExpList;
                 if (params->tExp.loop) {
-                    extTExpList = new ExtTExpList(appState, &params->tExp.delay, 0, false, this);
-                    extTExpList->setTimesExec(numTMeas - 1);
-                    taskItem.task = extTExpList;
-                    taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+                    taskItem.task = new ExtTExpSeries(appState, &params->tExp.delay, 0, numTMeas - 1, 0, false, this);
+                    taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpSeries;
                     addTask(taskItem);
 
-                    taskItem.task =  new ExtTExpList(appState, &params->tExp.loopDelay, 1, false, this);
-                    taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+                    taskItem.task = new ExtTExpSeries(appState, &params->tExp.loopDelay, 1, 1, numTMeas - 1, false, this);
+                    taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpSeries;
                     addTask(taskItem);
 
                     taskItem.task = new WinSpecTasks::AddExpNumber(appState, 1, this);
@@ -1617,38 +2069,14 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
                             ExpTaskListTraits::TaskType::WinSpecAddExpNumber;
                     addTask(taskItem);
 
-                    extTExpList = new ExtTExpList(appState, &params->tExp.loopDelay, 0, false, this);
-                    extTExpList->setTimesExec(numTMeas - 2);
-                    taskItem.task = extTExpList;
-                    taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+                    taskItem.task = new ExtTExpSeries(appState, &params->tExp.loopDelay, 0, numTMeas - 1, numTMeas, true, this);
+                    taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpSeries;
                     addTask(taskItem);
-
-                    // the last task is may be without delay, so the last task is only
-                    // spectrum measurement, see next taskItem.
-                    if (params->expe.size() > 1) {
-                        taskItem.task = new ExtTExpList(appState, &params->tExp.loopDelay, 0, true, this);
-                        taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
-                        addTask(taskItem);
-                    }
                 } else {
-                    extTExpList =
-                            new ExtTExpList(appState, &params->tExp.delay, 0, false, this);
-                    extTExpList->setTimesExec(numTMeas - 1);
-                    taskItem.task = extTExpList;
-                    taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+                    taskItem.task = new ExtTExpSeries(appState, &params->tExp.delay, 0, numTMeas, 0, true, this);
+                    taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpSeries;
                     addTask(taskItem);
-
-                    // the last task is may be without delay, so the last task is only
-                    // spectrum measurement, see next taskItem.
-                    if (params->expe.size() > 1) {
-                        taskItem.task = new ExtTExpList(appState, &params->tExp.delay, 0, true, this);
-                        taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
-                        addTask(taskItem);
-                    }
                 }
-                taskItem.task = new WinSpecTasks::ExpList(appState, false, params->expe.size() - 1, this);
-                taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
-                addTask(taskItem);
             } else {
                 if (params->tExp.loop) {
                     tExpList = new TExpList(appState, &params->tExp.delay, 0, 0, true, 0, this);
@@ -1699,12 +2127,8 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
                 taskItem.taskType = ExpTaskListTraits::TaskType::StartWaiting;
                 addTask(taskItem);
 
-                taskItem.task = new StageTasks::GoToPosExpList(appState, StageControlTraits::PosType::Calibration, this);
-                taskItem.taskType = ExpTaskListTraits::TaskType::StageControlGoToPosExpList;
-                addTask(taskItem);
-
-                taskItem.task = new WinSpecTasks::ExpList(appState, true, ii, this);
-                taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
+                taskItem.task = new WinSpecTasks::CalExpList(appState, ii, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecCalExpList;
                 addTask(taskItem);
 
                 ForkJoinTask *fj = new ForkJoinTask(2, this);
@@ -1776,18 +2200,14 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
         addTask(taskItem);
     }
 
+    // the temperature series may end in the first window, see
+    // ExtTExpSeries::end(), the next spectrum starts from the first window
     int lastExpNumber;
-    int n;
+    int back = 0;
     if (params->extRan.extendedRange) {
-        lastExpNumber = params->expe.size() - 1;
-        if (params->batch.batchExp && params->tExp.tExp) {
-            n = params->batch.numSpectra;
-        } else {
-            n = 1;
-        }
-        if (params->tExp.tExp && params->tExp.loop) {
-            n = 2 * n;
-        }
+        biomolecules::spexpert::core::SeriesEnd end = ExtTExpSeries::end(appState);
+        lastExpNumber = end.window;
+        back = end.backShift;
     } else {
         lastExpNumber = 0;
     }
@@ -1816,7 +2236,7 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
                 if (params->extRan.extendedRange) {
                     taskItem.task = new NeslabTasks::SetT(
                                 appState,
-                                true, - (params->expe.size() - 1) * n + 1,
+                                true, back + 1,
                                 true, this);
                     taskItem.taskType = ExpTaskListTraits::TaskType::NeslabSetT;
                     forkJoinTask->addTask(taskItem, 1);
@@ -1827,12 +2247,8 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
                 }
             }
 
-            taskItem.task = new StageTasks::GoToPosExpList(appState, StageControlTraits::PosType::Calibration, this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::StageControlGoToPosExpList;
-            forkJoinTask->addTask(taskItem, 1);
-
-            taskItem.task = new WinSpecTasks::ExpList(appState, true, lastExpNumber, this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
+            taskItem.task = new WinSpecTasks::CalExpList(appState, lastExpNumber, this);
+            taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecCalExpList;
             forkJoinTask->addTask(taskItem, 1);
 
             if (params->extRan.extendedRange) {
@@ -1845,13 +2261,13 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
                 if (params->tExp.tExp) {
                     taskItem.task = new GratingTasks::SendToPos(
                                 appState, true,
-                                - (params->expe.size() - 1) * n + 1, this);
+                                back + 1, this);
                     taskItem.taskType = ExpTaskListTraits::TaskType::GratingSendToPos;
                     fj->addTask(taskItem, 1);
                 } else {
                     taskItem.task = new GratingTasks::SendToPos(
                                 appState, true,
-                                - (params->expe.size() - 1) * n, this);
+                                back, this);
                     taskItem.taskType = ExpTaskListTraits::TaskType::GratingSendToPos;
                     fj->addTask(taskItem, 1);
                 }
@@ -1884,7 +2300,7 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
                 if (params->extRan.extendedRange) {
                     taskItem.task = new NeslabTasks::SetT(
                                 appState,
-                                true, - (params->expe.size() - 1) * n + 1,
+                                true, back + 1,
                                 true, this);
                     taskItem.taskType = ExpTaskListTraits::TaskType::NeslabSetT;
                     addTask(taskItem);
@@ -1899,13 +2315,13 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
                 if (params->tExp.tExp) {
                     taskItem.task = new GratingTasks::SendToPos(
                                 appState, true,
-                                - (params->expe.size() - 1) * n + 1, this);
+                                back + 1, this);
                     taskItem.taskType = ExpTaskListTraits::TaskType::GratingSendToPos;
                     addTask(taskItem);
                 } else {
                     taskItem.task = new GratingTasks::SendToPos(
                                 appState, true,
-                                - (params->expe.size() - 1) * n, this);
+                                back, this);
                     taskItem.taskType = ExpTaskListTraits::TaskType::GratingSendToPos;
                     addTask(taskItem);
                 }
@@ -1941,7 +2357,7 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
             if (params->extRan.extendedRange) {
                 taskItem.task = new NeslabTasks::SetT(
                             appState,
-                            true, - (params->expe.size() - 1) * n + 1,
+                            true, back + 1,
                             true, this);
                 taskItem.taskType = ExpTaskListTraits::TaskType::NeslabSetT;
                 addTask(taskItem);
@@ -1952,12 +2368,8 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
             }
         }
 
-        taskItem.task = new StageTasks::GoToPosExpList(appState, StageControlTraits::PosType::Calibration, this);
-        taskItem.taskType = ExpTaskListTraits::TaskType::StageControlGoToPosExpList;
-        addTask(taskItem);
-
-        taskItem.task = new WinSpecTasks::ExpList(appState, true, lastExpNumber, this);
-        taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
+        taskItem.task = new WinSpecTasks::CalExpList(appState, lastExpNumber, this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecCalExpList;
         addTask(taskItem);
         if (params->extRan.extendedRange) {
             ForkJoinTask *fj = new ForkJoinTask(2, this);
@@ -1969,13 +2381,13 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
             if (params->tExp.tExp) {
                 taskItem.task = new GratingTasks::SendToPos(
                             appState, true,
-                            - (params->expe.size() - 1) * n + 1, this);
+                            back + 1, this);
                 taskItem.taskType = ExpTaskListTraits::TaskType::GratingSendToPos;
                 fj->addTask(taskItem, 1);
             } else {
                 taskItem.task = new GratingTasks::SendToPos(
                             appState, true,
-                            - (params->expe.size() - 1) * n, this);
+                            back, this);
                 taskItem.taskType = ExpTaskListTraits::TaskType::GratingSendToPos;
                 fj->addTask(taskItem, 1);
             }
@@ -2011,13 +2423,13 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
         if (params->tExp.tExp) {
             taskItem.task = new GratingTasks::SendToPos(
                         appState, true,
-                        - (params->expe.size() - 1) * n + 1, this);
+                        back + 1, this);
             taskItem.taskType = ExpTaskListTraits::TaskType::GratingSendToPos;
             addTask(taskItem);
         } else {
             taskItem.task = new GratingTasks::SendToPos(
                         appState, true,
-                        - (params->expe.size() - 1) * n, this);
+                        back, this);
             taskItem.taskType = ExpTaskListTraits::TaskType::GratingSendToPos;
             addTask(taskItem);
         }
@@ -2039,7 +2451,7 @@ BatchExpList::BatchExpList(AppState *appState, QObject *parent) :
 
     if (params->extRan.extendedRange) {
         taskItem.task = new WinSpecTasks::AddExpNumber(
-                    appState, - (params->expe.size() - 1) * n, this);
+                    appState, back, this);
         taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecAddExpNumber;
         addTask(taskItem);
     }
@@ -2079,16 +2491,13 @@ WholeBatchExpList::WholeBatchExpList(AppState *appState, QObject *parent) :
     if (params->tExp.tExp && numTMeas > 1) {
         TExpList *tExpList;
         if (params->extRan.extendedRange) {
-            ExtTExpList *extTExpList;
             if (params->tExp.loop) {
-                extTExpList = new ExtTExpList(appState, &params->tExp.delay, 0, false, this);
-                extTExpList->setTimesExec(numTMeas - 1);
-                taskItem.task = extTExpList;
-                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+                taskItem.task = new ExtTExpSeries(appState, &params->tExp.delay, 0, numTMeas - 1, 0, false, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpSeries;
                 addTask(taskItem);
 
-                taskItem.task =  new ExtTExpList(appState, &params->tExp.loopDelay, 1, false, this);
-                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+                taskItem.task = new ExtTExpSeries(appState, &params->tExp.loopDelay, 1, 1, numTMeas - 1, false, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpSeries;
                 addTask(taskItem);
 
                 taskItem.task = new WinSpecTasks::AddExpNumber(appState, 1, this);
@@ -2096,38 +2505,14 @@ WholeBatchExpList::WholeBatchExpList(AppState *appState, QObject *parent) :
                         ExpTaskListTraits::TaskType::WinSpecAddExpNumber;
                 addTask(taskItem);
 
-                extTExpList = new ExtTExpList(appState, &params->tExp.loopDelay, 0, false, this);
-                extTExpList->setTimesExec(numTMeas - 2);
-                taskItem.task = extTExpList;
-                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+                taskItem.task = new ExtTExpSeries(appState, &params->tExp.loopDelay, 0, numTMeas - 1, numTMeas, true, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpSeries;
                 addTask(taskItem);
-
-                // the last task is may be without delay, so the last task is only
-                // spectrum measurement, see next taskItem.
-                if (params->expe.size() > 1) {
-                    taskItem.task = new ExtTExpList(appState, &params->tExp.loopDelay, 0, true, this);
-                    taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
-                    addTask(taskItem);
-                }
             } else {
-                extTExpList =
-                        new ExtTExpList(appState, &params->tExp.delay, 0, false, this);
-                extTExpList->setTimesExec(numTMeas - 1);
-                taskItem.task = extTExpList;
-                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
+                taskItem.task = new ExtTExpSeries(appState, &params->tExp.delay, 0, numTMeas, 0, true, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpSeries;
                 addTask(taskItem);
-
-                // the last task is may be without delay, so the last task is only
-                // spectrum measurement, see next taskItem.
-                if (params->expe.size() > 1) {
-                    taskItem.task = new ExtTExpList(appState, &params->tExp.delay, 0, true, this);
-                    taskItem.taskType = ExpTaskListTraits::TaskType::ExtTExpList;
-                    addTask(taskItem);
-                }
             }
-            taskItem.task = new WinSpecTasks::ExpList(appState, false, params->expe.size() - 1, this);
-            taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
-            addTask(taskItem);
         } else {
             if (params->tExp.loop) {
                 tExpList = new TExpList(appState, &params->tExp.delay, 0, 0, true, 0, this);
@@ -2177,12 +2562,8 @@ WholeBatchExpList::WholeBatchExpList(AppState *appState, QObject *parent) :
                 taskItem.taskType = ExpTaskListTraits::TaskType::StartWaiting;
                 addTask(taskItem);
 
-                taskItem.task = new StageTasks::GoToPosExpList(appState, StageControlTraits::PosType::Calibration, this);
-                taskItem.taskType = ExpTaskListTraits::TaskType::StageControlGoToPosExpList;
-                addTask(taskItem);
-
-                taskItem.task = new WinSpecTasks::ExpList(appState, true, ii, this);
-                taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
+                taskItem.task = new WinSpecTasks::CalExpList(appState, ii, this);
+                taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecCalExpList;
                 addTask(taskItem);
 
                 ForkJoinTask *fj = new ForkJoinTask(2, this);
@@ -2257,9 +2638,10 @@ WholeBatchExpList::WholeBatchExpList(AppState *appState, QObject *parent) :
         taskItem.taskType = ExpTaskListTraits::TaskType::NeslabSetT;
         addTask(taskItem);
     }
+    // the final calibration is taken in the window measured last
     int lastExpNumber;
     if (params->extRan.extendedRange) {
-        lastExpNumber = params->expe.size() - 1;
+        lastExpNumber = ExtTExpSeries::end(appState).window;
     } else {
         lastExpNumber = 0;
     }
@@ -2269,12 +2651,8 @@ WholeBatchExpList::WholeBatchExpList(AppState *appState, QObject *parent) :
         taskItem.taskType = ExpTaskListTraits::TaskType::StartWaiting;
         addTask(taskItem);
 
-        taskItem.task = new StageTasks::GoToPosExpList(appState, StageControlTraits::PosType::Calibration, this);
-        taskItem.taskType = ExpTaskListTraits::TaskType::StageControlGoToPosExpList;
-        addTask(taskItem);
-
-        taskItem.task = new WinSpecTasks::ExpList(appState, true, lastExpNumber, this);
-        taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecExpList;
+        taskItem.task = new WinSpecTasks::CalExpList(appState, lastExpNumber, this);
+        taskItem.taskType = ExpTaskListTraits::TaskType::WinSpecCalExpList;
         addTask(taskItem);
 
         if (params->extRan.extendedRange) {
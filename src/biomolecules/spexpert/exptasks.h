@@ -5,6 +5,7 @@
 
 #include "exptask.h"
 #include "waittasklist.h"
+#include "windoworder.h"
 
 // forward declarations
 class AppState;
@@ -147,7 +148,13 @@ public slots:
     virtual void start();
     virtual void stop();
 
+private slots:
+    void checkProbe();
+
 private:
+    void startProbe(double probeExposure);
+    void startAcquisition();
+
     WinSpec *pwinSpec;
     AppState *pappState;
     WinSpecTasks::Params *pwinSpecParams;
@@ -157,6 +164,8 @@ private:
     QString strFileName;
     bool autoGetParams;
     bool cal_;
+    bool probing_;
+    double probeExposure_;
 };
 
 class LogLastExpParams : public ExpTask
@@ -197,6 +206,58 @@ public:
     ExpList(AppState *appState, bool cal, int expNumber, QObject *parent = 0);
 };
 
+class CalExpList : public ExpTaskList
+{
+    Q_OBJECT
+
+public:
+    CalExpList(AppState *appState, int expNumber, QObject *parent = 0);
+
+public slots:
+    virtual void start();
+    virtual void stop();
+
+private slots:
+    void checkDrift();
+
+private:
+    AppState *appState_;
+    bool checkingDrift_;
+};
+
+class AcquireDark : public ExpTask
+{
+    Q_OBJECT
+
+public:
+    AcquireDark(AppState *appState, int expNumber, QObject *parent = 0);
+
+public slots:
+    virtual void start();
+    virtual void stop();
+
+private:
+    AppState *appState_;
+    WinSpec *winSpec_;
+    int expNumber_;
+};
+
+class DarkExpList : public ExpTaskList
+{
+    Q_OBJECT
+
+public:
+    DarkExpList(AppState *appState, int expNumber, QObject *parent = 0);
+    static bool idleAcquisition(AppState *appState);
+
+public slots:
+    virtual void start();
+
+private:
+    AppState *appState_;
+    int expNumber_;
+};
+
 } // namespace WinSpecTasks
 
 namespace StageTasks
@@ -209,6 +270,7 @@ class Run : public ExpTask
 public:
     Run(AppState *pappState, int dest, StageControlTraits::ReferenceType refType, QObject *parent = 0);
     virtual ~Run();
+    virtual bool concurrent() const { return true; }
 
 public slots:
     virtual void start();
@@ -228,6 +290,7 @@ class GoToLim : public ExpTask
 public:
     GoToLim(AppState *pappState, StageControlTraits::LimType limType, QObject *parent = 0);
     virtual ~GoToLim();
+    virtual bool concurrent() const { return true; }
 
 public slots:
     virtual void start();
@@ -246,6 +309,7 @@ class SendToPos : public ExpTask
 public:
     SendToPos(AppState *pappState, StageControlTraits::PosType posType, QObject *parent = 0);
     virtual ~SendToPos();
+    virtual bool concurrent() const { return true; }
 
 public slots:
     virtual void start();
@@ -270,6 +334,7 @@ public:
 
     SwitchPower(AppState *pappState, Power power, QObject *parent);
     virtual ~SwitchPower();
+    virtual bool concurrent() const { return true; }
 
 public slots:
     virtual void start();
@@ -512,7 +577,24 @@ class ExtTExpList : public ExpTaskList
     Q_OBJECT
 
 public:
+    typedef biomolecules::spexpert::core::WindowOrder Order;
+
     ExtTExpList(AppState *appState, TimeSpan *delay, int shiftT, bool last, QObject *parent = 0);
+    ExtTExpList(AppState *appState, TimeSpan *delay, int shiftT, bool last, Order order, QObject *parent = 0);
+
+    static int expNumberStep(AppState *appState);
+};
+
+class ExtTExpSeries : public ExpTaskList
+{
+    Q_OBJECT
+
+public:
+    ExtTExpSeries(AppState *appState, TimeSpan *delay, int shiftT, int steps, int firstStep, bool last,
+                  QObject *parent = 0);
+
+    static ExtTExpList::Order order(AppState *appState, int step);
+    static biomolecules::spexpert::core::SeriesEnd end(AppState *appState);
 };
 
 class WholeTExpList : public ExpTaskList
@@ -0,0 +1,116 @@
+#include "framecheck.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <QStringList>
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+/*!
+   \class FrameCheck
+   \brief Checks every readout of a running acquisition, so a spoiled long
+   accumulation can be stopped early.
+
+   The readout is checked for the pixels reaching FrameCheckParams::fullScale,
+   for the signal above the offset (the sum over the readout less its minimum
+   times the number of pixels) dropping below FrameCheckParams::collapseFraction
+   of the first readout, e.g. when the laser or the lamp goes off, and for the
+   detector rows without any finite nonzero value. All is done in a single pass
+   over the data, which is negligible against the readout itself.
+ */
+
+FrameCheck::FrameCheck(const FrameCheckParams& params)
+    : params_(params),
+      reference_{-1.0},
+      saturated_{0},
+      signal_{0.0}
+{}
+
+
+/*!
+   \brief Forgets the reference readout, e.g. before the acquisition restarts.
+ */
+void FrameCheck::reset()
+{
+    reference_ = -1.0;
+    saturated_ = 0;
+    signal_ = 0.0;
+}
+
+
+/*!
+   \brief Checks the \a frame of \a x pixels and \a y rows in the WinSpec
+   order, where the rows of the pixel are neighbours.
+   \return the found problems as a combination of the Problem flags.
+ */
+int FrameCheck::check(const QVariantList& frame, int x, int y)
+{
+    if (x < 1 || y < 1 || frame.size() != x * y) {
+        return None;
+    }
+    row_sums_.fill(0.0, y);
+    const double full_scale = params_.fullScale;
+    double total = 0.0;
+    double min = std::numeric_limits<double>::infinity();
+    int saturated = 0;
+    int empty_rows = 0;
+    QVariantList::const_iterator it = frame.constBegin();
+    for (int ii = 0; ii < x; ++ii) {
+        for (int row = 0; row < y; ++row, ++it) {
+            double value = it->toDouble();
+            if (!std::isfinite(value)) {
+                continue;
+            }
+            if (value >= full_scale) {
+                ++saturated;
+            }
+            total += value;
+            min = std::min(min, value);
+            row_sums_[row] += std::abs(value);
+        }
+    }
+    for (int row = 0; row < y; ++row) {
+        if (row_sums_.at(row) == 0.0) {
+            ++empty_rows;
+        }
+    }
+    saturated_ = saturated;
+    signal_ = std::isfinite(min) ? total - min * x * y : 0.0;
+
+    int problems = None;
+    if (saturated > params_.maxSaturated) {
+        problems |= Saturated;
+    }
+    if (empty_rows > 0) {
+        problems |= EmptyRows;
+    } else if (reference_ < 0.0) {
+        reference_ = signal_;
+    } else if (signal_ < params_.collapseFraction * reference_) {
+        problems |= Collapsed;
+    }
+    return problems;
+}
+
+
+QString FrameCheck::describe(int problems)
+{
+    QStringList out;
+    if (problems & Saturated) {
+        out << "saturated";
+    }
+    if (problems & Collapsed) {
+        out << "signal-collapsed";
+    }
+    if (problems & EmptyRows) {
+        out << "empty-rows";
+    }
+    return out.join(",");
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
@@ -0,0 +1,60 @@
+#ifndef BIOMOLECULES_SPEXPERT_FRAMECHECK_H_
+#define BIOMOLECULES_SPEXPERT_FRAMECHECK_H_
+
+#include <QString>
+#include <QVariantList>
+#include <QVector>
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+enum class FrameCheckAction {
+    Flag,   // only notes the problem in the measurement log
+    Abort,  // stops the acquisition and continues with the next one
+    Retry   // restarts the acquisition, with the halved exposure if saturated
+};
+
+struct FrameCheckParams
+{
+    bool enabled;
+    int fullScale;            // saturation counts of one readout
+    int maxSaturated;         // saturated pixels tolerated in one readout
+    double collapseFraction;  // signal drop against the first readout
+    FrameCheckAction action;
+    int maxRetries;
+};
+
+class FrameCheck
+{
+public:
+    enum Problem {
+        None = 0,
+        Saturated = 1,
+        Collapsed = 2,
+        EmptyRows = 4
+    };
+
+    explicit FrameCheck(const FrameCheckParams& params);
+
+    void reset();
+    int check(const QVariantList& frame, int x, int y);
+    int saturated() const { return saturated_; }
+    double signal() const { return signal_; }
+
+    static QString describe(int problems);
+
+private:
+    FrameCheckParams params_;
+    QVector<double> row_sums_;
+    double reference_;
+    int saturated_;
+    double signal_;
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_FRAMECHECK_H_
@@ -10,8 +10,15 @@
 #include "experimentsetup.h"
 #include "relay_options_widgets.h"
 #include "relay.h"
+#include "adaptiveaccumulation.h"
+#include "autoexposure.h"
+#include "darklibrary.h"
+#include "driftmonitor.h"
+#include "framecheck.h"
+#include "spectrumpipeline.h"
 #include "stagesetup.h"
 #include "stagecontrol.h"
+#include "winspec.h"
 #include <QCoreApplication>
 #include <QSettings>
 #include <QMenuBar>
@@ -21,6 +28,8 @@
 #include <QDir>
 #include <QCloseEvent>
 
+#include <QDebug>
+
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent)
 {
@@ -165,6 +174,7 @@ void MainWindow::closeEvent(QCloseEvent *event)
     settings.setValue("autoFileNames", extRan.autoFileNames);
     settings.setValue("fileNameBase", extRan.fileNameBase);
     settings.setValue("directory", extRan.directory);
+    settings.setValue("serpentine", extRan.serpentine);
     settings.endGroup();
 
     settings.endGroup();
@@ -216,7 +226,110 @@ void MainWindow::closeEvent(QCloseEvent *event)
             static_cast<unsigned int>(biomolecules::sprelay::core::k8090::CommandID::RelayOff));
     }
     settings.setValue("calibrationLampSwitchDelayMSec", relaySettings->calibration_lamp_switch_delay_msec);
+    settings.setValue("darkShutterSwitchEnabled", relaySettings->dark_shutter_switch_enabled);
+    for (relay_id_repr = 0; relay_id_repr < 8; ++relay_id_repr) {
+        if ((relaySettings->dark_shutter_switch_id
+            & static_cast<biomolecules::sprelay::core::k8090::RelayID>(1u << relay_id_repr))
+            != biomolecules::sprelay::core::k8090::RelayID::None) {
+            break;
+        }
+    }
+    if (relay_id_repr > 7) {
+        relay_id_repr = 1;
+    }
+    settings.setValue("darkShutterSwitchId", relay_id_repr);
+    if (relaySettings->dark_shutter_switch_on) {
+        settings.setValue("darkShutterSwitchAction",
+            static_cast<unsigned int>(biomolecules::sprelay::core::k8090::CommandID::RelayOn));
+    } else {
+        settings.setValue("darkShutterSwitchAction",
+            static_cast<unsigned int>(biomolecules::sprelay::core::k8090::CommandID::RelayOff));
+    }
+    settings.setValue("darkShutterSwitchDelayMSec", relaySettings->dark_shutter_switch_delay_msec);
     settings.endGroup();
+
+    settings.beginGroup("Processing");
+    biomolecules::spexpert::core::ProcessingParams processingParams =
+            appCore->appState()->spectrumPipeline()->processingParams();
+    settings.setValue("cosmicRayRejection", processingParams.cosmicRay.enabled);
+    settings.setValue("cosmicRayThreshold", processingParams.cosmicRay.threshold);
+    settings.setValue("cosmicRaySpikeHalfWidth", processingParams.cosmicRay.spikeHalfWidth);
+    settings.setValue("cosmicRayReadNoise", processingParams.cosmicRay.readNoise);
+    settings.setValue("darkSubtraction", processingParams.darkSubtraction);
+    settings.setValue("flatField", processingParams.flatField);
+    settings.setValue("binning", processingParams.binning);
+    settings.setValue("calibration", processingParams.calibration);
+    QVariantList calibrationCoefficients;
+    for (double coefficient : processingParams.calibrationCoefficients) {
+        calibrationCoefficients.append(coefficient);
+    }
+    settings.setValue("calibrationCoefficients", calibrationCoefficients);
+    settings.setValue("smoothing", processingParams.smoothing);
+    settings.setValue("stitching", processingParams.stitching.enabled);
+    settings.setValue("stitchDispersion", processingParams.stitching.dispersion);
+    settings.setValue("stitchCenterPixel", processingParams.stitching.centerPixel);
+    settings.setValue("stitchSaveComposite", processingParams.stitching.saveComposite);
+    settings.setValue("archive", processingParams.archive);
+    settings.setValue("darkReference", processingParams.darkReference);
+    settings.setValue("flatReference", processingParams.flatReference);
+    biomolecules::spexpert::core::DarkLibrary* darkLibrary =
+            appCore->appState()->spectrumPipeline()->darkLibrary();
+    biomolecules::spexpert::core::DarkLibraryParams darkParams = darkLibrary->params();
+    settings.setValue("darkLibrary", darkParams.enabled);
+    settings.setValue("darkExpiryHours", darkParams.expiryHours);
+    settings.setValue("darkCcdTemperature", darkParams.ccdTemperature);
+    settings.setValue("darkReadout", darkParams.readout);
+    settings.setValue("darkIdleAcquisition", darkParams.idleAcquisition);
+    biomolecules::spexpert::core::DriftParams driftParams =
+            appCore->appState()->spectrumPipeline()->driftMonitor()->params();
+    settings.setValue("driftAdaptiveCalibration", driftParams.enabled);
+    settings.setValue("driftThreshold", driftParams.threshold);
+    settings.setValue("driftMaxInterval", driftParams.maxInterval);
+    settings.setValue("driftMaxLag", driftParams.maxLag);
+    settings.setValue("driftRegionFrom", driftParams.regionFrom);
+    settings.setValue("driftRegionTo", driftParams.regionTo);
+    settings.setValue("driftPeakFit", static_cast<int>(driftParams.peakFit));
+    settings.endGroup();
+
+    settings.beginGroup("Spe");
+    settings.setValue("nativeSpe", appCore->appState()->nativeSpe());
+    settings.endGroup();
+
+    settings.beginGroup("AutoExposure");
+    biomolecules::spexpert::core::AutoExposureParams autoExposureParams =
+            appCore->appState()->autoExposure()->params();
+    settings.setValue("autoExposure", autoExposureParams.enabled);
+    settings.setValue("probeExposure", autoExposureParams.probeExposure);
+    settings.setValue("targetFraction", autoExposureParams.targetFraction);
+    settings.setValue("fullScale", autoExposureParams.fullScale);
+    settings.setValue("minExposure", autoExposureParams.minExposure);
+    settings.setValue("maxExposure", autoExposureParams.maxExposure);
+    settings.setValue("timeBudget", autoExposureParams.timeBudget);
+    settings.endGroup();
+
+    settings.beginGroup("FrameCheck");
+    biomolecules::spexpert::core::FrameCheckParams *frameCheckParams =
+            appCore->appState()->frameCheckParams();
+    settings.setValue("frameCheck", frameCheckParams->enabled);
+    settings.setValue("fullScale", frameCheckParams->fullScale);
+    settings.setValue("maxSaturated", frameCheckParams->maxSaturated);
+    settings.setValue("collapseFraction", frameCheckParams->collapseFraction);
+    settings.setValue("action", static_cast<int>(frameCheckParams->action));
+    settings.setValue("maxRetries", frameCheckParams->maxRetries);
+    settings.endGroup();
+
+    settings.beginGroup("AdaptiveAccumulation");
+    biomolecules::spexpert::core::AdaptiveAccumulationParams *adaptiveParams =
+            appCore->appState()->adaptiveAccumulationParams();
+    settings.setValue("adaptiveAccumulation", adaptiveParams->enabled);
+    settings.setValue("targetSnr", adaptiveParams->targetSnr);
+    settings.setValue("maxTime", adaptiveParams->maxTime);
+    settings.setValue("minAccums", adaptiveParams->minAccums);
+    settings.setValue("regionFrom", adaptiveParams->regionFrom);
+    settings.setValue("regionTo", adaptiveParams->regionTo);
+    settings.endGroup();
+    darkLibrary->purgeExpired();
+    darkLibrary->save();
 }
 
 void MainWindow::onLanguageChanged(QAction *action)
@@ -329,6 +442,11 @@ void MainWindow::createActions()
     relaySettingsDialogAction_ = new QAction{tr("&Settings"), this};
     relaySettingsDialogAction_->setStatusTip(tr("Relay settings."));
     connect(relaySettingsDialogAction_, &QAction::triggered, this, &MainWindow::onRelaySettingsDialogActionTrigered);
+
+    waterfallAction_ = new QAction{tr("&Waterfall"), this};
+    waterfallAction_->setStatusTip(tr("Show all the measured spectra as a waterfall instead of the last spectrum or the temperatures."));
+    waterfallAction_->setCheckable(true);
+    connect(waterfallAction_, &QAction::toggled, appCore, &AppCore::setWaterfallView);
 }
 
 void MainWindow::createMenus()
@@ -345,6 +463,9 @@ void MainWindow::createMenus()
     relayMenu->addAction(relayControlPanelAction_);
     relayMenu->addAction(relaySettingsDialogAction_);
 
+    viewMenu = menuBar()->addMenu(tr("&View"));
+    viewMenu->addAction(waterfallAction_);
+
     createLanguageMenu();
 }
 
@@ -559,6 +680,7 @@ void MainWindow::readSettings()
     extRan.autoFileNames = settings.value("autoFileNames", true).toBool();
     extRan.fileNameBase = settings.value("fileNameBase", "temp").toString();
     extRan.directory = settings.value("directory", "").toString();
+    extRan.serpentine = settings.value("serpentine", false).toBool();
     settings.endGroup();
 
     settings.endGroup();
@@ -698,6 +820,195 @@ void MainWindow::readSettings()
         calSwitchDelayMSec = 1000;
     }
     appCore->appState()->relaySettings()->calibration_lamp_switch_delay_msec = calSwitchDelayMSec;
+
+    appCore->appState()->relaySettings()->dark_shutter_switch_enabled =
+            settings.value("darkShutterSwitchEnabled", false).toBool();
+    unsigned int darkShutterSwitchId = settings.value("darkShutterSwitchId", 1).toUInt(&ok);
+    if (!ok || darkShutterSwitchId >= 8) {
+        darkShutterSwitchId = 1;
+    }
+    appCore->appState()->relaySettings()->dark_shutter_switch_id
+        = biomolecules::sprelay::core::k8090::from_number(darkShutterSwitchId);
+    auto dark_shutter_relay_action = static_cast<biomolecules::sprelay::core::k8090::CommandID>(
+        settings.value("darkShutterSwitchAction", 0).toUInt(&ok));
+    if (dark_shutter_relay_action == biomolecules::sprelay::core::k8090::CommandID::RelayOff)
+        appCore->appState()->relaySettings()->dark_shutter_switch_on = false;
+    else {
+        appCore->appState()->relaySettings()->dark_shutter_switch_on = true;
+    }
+    unsigned int darkSwitchDelayMSec = settings.value("darkShutterSwitchDelayMSec", 500).toUInt(&ok);
+    if (!ok) {
+        darkSwitchDelayMSec = 500;
+    }
+    appCore->appState()->relaySettings()->dark_shutter_switch_delay_msec = darkSwitchDelayMSec;
+    settings.endGroup();
+
+    settings.beginGroup("Processing");
+    biomolecules::spexpert::core::ProcessingParams processingParams =
+            appCore->appState()->spectrumPipeline()->processingParams();
+    processingParams.cosmicRay.enabled = settings.value("cosmicRayRejection", false).toBool();
+    processingParams.cosmicRay.threshold = settings.value("cosmicRayThreshold", 5.0).toDouble(&ok);
+    if (!ok || processingParams.cosmicRay.threshold <= 0.0)
+        processingParams.cosmicRay.threshold = 5.0;
+    processingParams.cosmicRay.spikeHalfWidth = settings.value("cosmicRaySpikeHalfWidth", 3).toInt(&ok);
+    if (!ok || processingParams.cosmicRay.spikeHalfWidth < 1)
+        processingParams.cosmicRay.spikeHalfWidth = 3;
+    processingParams.cosmicRay.readNoise = settings.value("cosmicRayReadNoise", 5.0).toDouble(&ok);
+    if (!ok || processingParams.cosmicRay.readNoise < 0.0)
+        processingParams.cosmicRay.readNoise = 5.0;
+    processingParams.darkSubtraction = settings.value("darkSubtraction", false).toBool();
+    processingParams.flatField = settings.value("flatField", false).toBool();
+    processingParams.binning = settings.value("binning", 1).toInt(&ok);
+    if (!ok || processingParams.binning < 1)
+        processingParams.binning = 1;
+    processingParams.calibration = settings.value("calibration", false).toBool();
+    processingParams.calibrationCoefficients.clear();
+    for (const QVariant &coefficient : settings.value("calibrationCoefficients").toList()) {
+        processingParams.calibrationCoefficients.append(coefficient.toDouble());
+    }
+    processingParams.smoothing = settings.value("smoothing", 0).toInt(&ok);
+    if (!ok || processingParams.smoothing < 0)
+        processingParams.smoothing = 0;
+    processingParams.stitching.enabled = settings.value("stitching", false).toBool();
+    processingParams.stitching.dispersion = settings.value("stitchDispersion", 1.0).toDouble(&ok);
+    if (!ok || processingParams.stitching.dispersion == 0.0)
+        processingParams.stitching.dispersion = 1.0;
+    processingParams.stitching.centerPixel = settings.value("stitchCenterPixel", -1.0).toDouble(&ok);
+    if (!ok)
+        processingParams.stitching.centerPixel = -1.0;
+    processingParams.stitching.saveComposite = settings.value("stitchSaveComposite", true).toBool();
+    processingParams.archive = settings.value("archive", false).toBool();
+    processingParams.darkReference = settings.value("darkReference").toString();
+    processingParams.flatReference = settings.value("flatReference").toString();
+    appCore->appState()->spectrumPipeline()->setProcessingParams(processingParams);
+    // the dark library, if enabled, overrides the fixed dark for the exposures it holds
+    QVector<double> reference;
+    if (!processingParams.darkReference.isEmpty()) {
+        if (biomolecules::spexpert::core::readReferenceSpectrum(processingParams.darkReference, reference))
+            appCore->appState()->spectrumPipeline()->setDarkReference(reference);
+        else
+            qDebug() << "MainWindow::readSettings(): can not read the dark reference" << processingParams.darkReference;
+    }
+    if (!processingParams.flatReference.isEmpty()) {
+        if (biomolecules::spexpert::core::readReferenceSpectrum(processingParams.flatReference, reference))
+            appCore->appState()->spectrumPipeline()->setFlatReference(reference);
+        else
+            qDebug() << "MainWindow::readSettings(): can not read the flat reference" << processingParams.flatReference;
+    }
+
+    biomolecules::spexpert::core::DarkLibrary* darkLibrary =
+            appCore->appState()->spectrumPipeline()->darkLibrary();
+    biomolecules::spexpert::core::DarkLibraryParams darkParams = darkLibrary->params();
+    darkParams.enabled = settings.value("darkLibrary", false).toBool();
+    darkParams.expiryHours = settings.value("darkExpiryHours", 24).toInt(&ok);
+    if (!ok || darkParams.expiryHours < 0)
+        darkParams.expiryHours = 24;
+    darkParams.ccdTemperature = settings.value("darkCcdTemperature", -70.0).toDouble(&ok);
+    if (!ok)
+        darkParams.ccdTemperature = -70.0;
+    darkParams.readout = settings.value("darkReadout").toString();
+    darkParams.idleAcquisition = settings.value("darkIdleAcquisition", true).toBool();
+    darkLibrary->setParams(darkParams);
+    darkLibrary->setFileName(QCoreApplication::applicationDirPath() + "/darks.dat");
+    darkLibrary->load();
+
+    biomolecules::spexpert::core::DriftParams driftParams =
+            appCore->appState()->spectrumPipeline()->driftMonitor()->params();
+    driftParams.enabled = settings.value("driftAdaptiveCalibration", false).toBool();
+    driftParams.threshold = settings.value("driftThreshold", 0.5).toDouble(&ok);
+    if (!ok || driftParams.threshold <= 0.0)
+        driftParams.threshold = 0.5;
+    driftParams.maxInterval = settings.value("driftMaxInterval", 10).toInt(&ok);
+    if (!ok || driftParams.maxInterval < 1)
+        driftParams.maxInterval = 10;
+    driftParams.maxLag = settings.value("driftMaxLag", 20).toInt(&ok);
+    if (!ok || driftParams.maxLag < 1)
+        driftParams.maxLag = 20;
+    driftParams.regionFrom = settings.value("driftRegionFrom", 0).toInt(&ok);
+    if (!ok || driftParams.regionFrom < 0)
+        driftParams.regionFrom = 0;
+    driftParams.regionTo = settings.value("driftRegionTo", -1).toInt(&ok);
+    if (!ok)
+        driftParams.regionTo = -1;
+    int peakFit = settings.value("driftPeakFit", 0).toInt(&ok);
+    if (!ok || peakFit < 0 || peakFit > static_cast<int>(biomolecules::spexpert::core::PeakFit::Gaussian))
+        peakFit = 0;
+    driftParams.peakFit = static_cast<biomolecules::spexpert::core::PeakFit>(peakFit);
+    appCore->appState()->spectrumPipeline()->driftMonitor()->setParams(driftParams);
+    settings.endGroup();
+
+    settings.beginGroup("Spe");
+    // without WinSpec, e.g. in the mock build, the spectra are not saved otherwise
+    appCore->appState()->setNativeSpe(
+                settings.value("nativeSpe", !appCore->appState()->winSpec()->autoSaves()).toBool());
+    settings.endGroup();
+
+    settings.beginGroup("AutoExposure");
+    biomolecules::spexpert::core::AutoExposureParams autoExposureParams =
+            appCore->appState()->autoExposure()->params();
+    autoExposureParams.enabled = settings.value("autoExposure", false).toBool();
+    autoExposureParams.probeExposure = settings.value("probeExposure", 0.1).toDouble(&ok);
+    if (!ok || autoExposureParams.probeExposure <= 0.0)
+        autoExposureParams.probeExposure = 0.1;
+    autoExposureParams.targetFraction = settings.value("targetFraction", 0.7).toDouble(&ok);
+    if (!ok || autoExposureParams.targetFraction <= 0.0 || autoExposureParams.targetFraction > 1.0)
+        autoExposureParams.targetFraction = 0.7;
+    autoExposureParams.fullScale = settings.value("fullScale", 65535).toInt(&ok);
+    if (!ok || autoExposureParams.fullScale < 1)
+        autoExposureParams.fullScale = 65535;
+    autoExposureParams.minExposure = settings.value("minExposure", 0.01).toDouble(&ok);
+    if (!ok || autoExposureParams.minExposure <= 0.0)
+        autoExposureParams.minExposure = 0.01;
+    autoExposureParams.maxExposure = settings.value("maxExposure", 60.0).toDouble(&ok);
+    if (!ok || autoExposureParams.maxExposure < autoExposureParams.minExposure)
+        autoExposureParams.maxExposure = 60.0;
+    autoExposureParams.timeBudget = settings.value("timeBudget", 0.0).toDouble(&ok);
+    if (!ok)
+        autoExposureParams.timeBudget = 0.0;
+    appCore->appState()->autoExposure()->setParams(autoExposureParams);
+    settings.endGroup();
+
+    settings.beginGroup("FrameCheck");
+    biomolecules::spexpert::core::FrameCheckParams *frameCheckParams =
+            appCore->appState()->frameCheckParams();
+    frameCheckParams->enabled = settings.value("frameCheck", false).toBool();
+    frameCheckParams->fullScale = settings.value("fullScale", 65535).toInt(&ok);
+    if (!ok || frameCheckParams->fullScale < 1)
+        frameCheckParams->fullScale = 65535;
+    frameCheckParams->maxSaturated = settings.value("maxSaturated", 0).toInt(&ok);
+    if (!ok || frameCheckParams->maxSaturated < 0)
+        frameCheckParams->maxSaturated = 0;
+    frameCheckParams->collapseFraction = settings.value("collapseFraction", 0.2).toDouble(&ok);
+    if (!ok || frameCheckParams->collapseFraction < 0.0 || frameCheckParams->collapseFraction > 1.0)
+        frameCheckParams->collapseFraction = 0.2;
+    int action = settings.value("action", 0).toInt(&ok);
+    if (!ok || action < 0 || action > static_cast<int>(biomolecules::spexpert::core::FrameCheckAction::Retry))
+        action = 0;
+    frameCheckParams->action = static_cast<biomolecules::spexpert::core::FrameCheckAction>(action);
+    frameCheckParams->maxRetries = settings.value("maxRetries", 1).toInt(&ok);
+    if (!ok || frameCheckParams->maxRetries < 0)
+        frameCheckParams->maxRetries = 1;
+    settings.endGroup();
+
+    settings.beginGroup("AdaptiveAccumulation");
+    biomolecules::spexpert::core::AdaptiveAccumulationParams *adaptiveParams =
+            appCore->appState()->adaptiveAccumulationParams();
+    adaptiveParams->enabled = settings.value("adaptiveAccumulation", false).toBool();
+    adaptiveParams->targetSnr = settings.value("targetSnr", 100.0).toDouble(&ok);
+    if (!ok || adaptiveParams->targetSnr <= 0.0)
+        adaptiveParams->targetSnr = 100.0;
+    adaptiveParams->maxTime = settings.value("maxTime", 0.0).toDouble(&ok);
+    if (!ok)
+        adaptiveParams->maxTime = 0.0;
+    adaptiveParams->minAccums = settings.value("minAccums", 2).toInt(&ok);
+    if (!ok || adaptiveParams->minAccums < 2)
+        adaptiveParams->minAccums = 2;
+    adaptiveParams->regionFrom = settings.value("regionFrom", 0).toInt(&ok);
+    if (!ok || adaptiveParams->regionFrom < 0)
+        adaptiveParams->regionFrom = 0;
+    adaptiveParams->regionTo = settings.value("regionTo", -1).toInt(&ok);
+    if (!ok)
+        adaptiveParams->regionTo = -1;
     settings.endGroup();
 }
 
@@ -71,11 +71,13 @@ private:
     QAction *neslabSetupAction;
     QAction *relayControlPanelAction_;
     QAction *relaySettingsDialogAction_;
+    QAction *waterfallAction_;
 
     QActionGroup * langActionGroup;
 
     QMenu *fileMenu;
     QMenu *setupMenu;
+    QMenu *viewMenu;
     QMenu *languageMenu;
 
     QString langPath;
@@ -2,17 +2,71 @@
 
 #include "appstate.h"
 #include "lockableqvector.h"
+#include "waterfall.h"
 
 #include <QMutex>
 #include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QTimer>
 
 #include "qcustomplot/qcustomplot.h"
 
+namespace {
+
+class PlotDataBuilder : public QRunnable
+{
+public:
+    explicit PlotDataBuilder(std::function<void()> build) : build_(build) {}
+    virtual void run() { build_(); }
+
+private:
+    std::function<void()> build_;
+};
+
+} // namespace
+
+// immutable snapshot of the graphs' data, which is converted to the
+// QCPDataMap objects in the plotPool and adopted by the graphs in the GUI
+// thread
+struct PlotProxy::PlotData
+{
+    PlotSlot plotSlot;
+    unsigned long long generation;
+    int firstGraph;
+    QVector<QVector<double> > xs;
+    QVector<QVector<double> > ys;
+    QList<QCPDataMap *> maps;
+    std::function<void()> finish;  // sets the axes after the data are adopted
+
+    ~PlotData() { qDeleteAll(maps); }
+};
 
 PlotProxy::PlotProxy(QWidget *parent) :
-    QObject(parent)
+    QObject(parent),
+    waterfall(new biomolecules::spexpert::core::Waterfall),
+    waterfallItem(nullptr),
+    blWaterfallView(false),
+    waterfallXFirst(0.0),
+    waterfallXLast(1.0),
+    plotMutex(new QMutex),
+    blPlotDataReadyPending(false),
+    readTsPlotted(0),
+    measTsPlotted(0)
 {
     mainPlot = new QCustomPlot(parent);
+    // one thread keeps the requests in order
+    plotPool = new QThreadPool(this);
+    plotPool->setMaxThreadCount(1);
+    for (int ii = 0; ii < PlotSlots; ++ii) {
+        plotGeneration[ii] = 0;
+        adoptedGeneration[ii] = 0;
+    }
+    // the appended temperatures are shown together
+    replotTimer = new QTimer(this);
+    replotTimer->setSingleShot(true);
+    replotTimer->setInterval(250);
+    connect(replotTimer, &QTimer::timeout, this, [this] { mainPlot->replot(); });
 }
 
 QCustomPlot *PlotProxy::getMainPlot()
@@ -37,39 +91,24 @@ void PlotProxy::updatePlot(AppState *appState)
             {
                 QMutexLocker lockerY(appState->getLastFrame().toMutexY());
                 QMutexLocker lockerX(appState->getLastFrame().toMutexX());
-                mainPlot->graph(0)->setData(appState->getLastFrame().toXQVector(), appState->getLastFrame().toYQVector());
+                // shared copies, the writers detach from them
+                QVector<QVector<double> > xs(1, appState->getLastFrame().toXQVector());
+                QVector<QVector<double> > ys(1, appState->getLastFrame().toYQVector());
                 lockerY.unlock();
                 lockerX.unlock();
                 appState->setLastFrameChanged(false);
-                mainPlot->rescaleAxes();
-                mainPlot->replot();
+                requestPlot(AllGraphs, 0, xs, ys, [this] { mainPlot->rescaleAxes(); });
             }
             break;
         case AppStateTraits::PlotType::Spectrum :
             if (appState->spectrumChanged())
             {
-                mainPlot->clearGraphs();
-                ConstSpectrumIterator it;
-                ConstXSpectrumIterator itX;
-                int ii;
-                QMutexLocker lockerY(appState->getSpectrum().toMutexY());
-                QMutexLocker lockerX(appState->getSpectrum().toMutexX());
-                for (ii = 0, it = appState->getPlotSpectrum().toYQVector().begin(), itX = appState->getPlotSpectrum().toXQVector().begin();
-                     it != appState->getPlotSpectrum().toYQVector().end(); ++ii, ++it, ++itX)
-                {
-                    mainPlot->addGraph();
-                    mainPlot->graph(ii)->setData(*itX, *it);
+                if (blWaterfallView) {
+                    // the waterfall is redrawn by appendWaterfall()
+                    appState->setSpectrumChanged(false);
+                } else {
+                    plotGraphs(appState);
                 }
-                lockerY.unlock();
-                lockerX.unlock();
-                appState->setSpectrumChanged(false);
-                double lims[4];
-                appState->getPlotSpectrum().getLimsSafe(lims);
-                double dX = (lims[1] - lims[0]) / 10;
-                double dY = (lims[3] - lims[2]) / 10;
-                mainPlot->xAxis->setRange(lims[0] - dX, lims[1] + dX);
-                mainPlot->yAxis->setRange(lims[2] - dY, lims[3] + dY);
-                mainPlot->replot();
             }
             break;
         case AppStateTraits::PlotType::None :
@@ -86,13 +125,18 @@ void PlotProxy::plotTypeChanged(AppState *appState)
 {
     qDebug() << "PlotProxy::plotTypeChanged()";
     if (appState->plotStyle() == AppStateTraits::PlotStyle::Spectra) {
-        mainPlot->clearGraphs();
+        clearGraphs();
 
         switch(appState->getPlotType())
         {
         case AppStateTraits::PlotType::Frame :
+            hideWaterfall();
             mainPlot->addGraph();
             break;
+        case AppStateTraits::PlotType::Spectrum :
+            if (blWaterfallView)
+                plotWaterfall();
+            break;
         default :
             break;
         }
@@ -103,7 +147,15 @@ void PlotProxy::plotTypeChanged(AppState *appState)
 void PlotProxy::onPlotTemperatures()
 {
     qDebug() << "PlotProxy::onPlotTemperatures()";
-    mainPlot->clearGraphs();
+    hideWaterfall();
+    clearGraphs();
+    if (blWaterfallView) {
+        // the spectra of the series are shown instead of the temperatures
+        mainPlot->xAxis->setLabel(QString());
+        mainPlot->yAxis->setLabel(QString());
+        plotWaterfall();
+        return;
+    }
     mainPlot->addGraph();
     mainPlot->graph(0)->setPen(QPen(Qt::blue));
     mainPlot->graph(0)->setLineStyle(QCPGraph::lsLine);
@@ -119,9 +171,30 @@ void PlotProxy::onPlotTemperatures()
 //    mainPlot->xAxis->setDateTimeFormat("dd'd'hh:mm:ss");
 }
 
+// the temperatures are not plotted under the waterfall, the graphs get all of
+// them when the waterfall is hidden, see setWaterfallView()
 void PlotProxy::onUpdateMeasT(AppState *appState)
 {
-    mainPlot->graph(1)->setData(appState->tMeasTs(), appState->measTs());
+    if (blWaterfallView)
+        return;
+    setTRanges(appState);
+    appendT(MeasTGraph, 1, appState->tMeasTs(), appState->measTs(), &measTsPlotted);
+}
+
+void PlotProxy::onUpdateReadT(AppState *appState)
+{
+    if (blWaterfallView)
+        return;
+    setTRanges(appState);
+    appendT(ReadTGraph, 0, appState->tReadTs(), appState->readTs(), &readTsPlotted);
+}
+
+// the ranges follow the first and the last reading and the running extremes
+// kept by AppState, so they cost nothing with the growing series
+void PlotProxy::setTRanges(AppState *appState)
+{
+    if (appState->tReadTs().isEmpty())
+        return;
     xmax = appState->tReadTs().last();
     xmin = appState->tReadTs().first();
     ymax = appState->tYMax();
@@ -136,30 +209,241 @@ void PlotProxy::onUpdateMeasT(AppState *appState)
     } else {
         mainPlot->yAxis->setRange(ymin - (ymax - ymin) / 20.0 , ymax + (ymax - ymin) / 20.0 );
     }
-    mainPlot->replot();
 }
 
-void PlotProxy::onUpdateReadT(AppState *appState)
+// Adds only the samples of \a values, which are not plotted yet, to the
+// graph and schedules the replot. The whole series is requested only if it
+// was shortened (AppState thins the read temperatures out when they grow too
+// long) or if an earlier request for the graph is not adopted yet.
+void PlotProxy::appendT(PlotSlot plotSlot, int graph, const QVector<double> &ts,
+                        const QVector<double> &values, int *plotted)
 {
-    xmax = appState->tReadTs().last();
-    xmin = appState->tReadTs().first();
-    ymax = appState->tYMax();
-    ymin = appState->tYMin();
-    if (xmax == xmin) {
-        mainPlot->xAxis->setRange(xmin - 0.5, xmax + 0.5);
+    int n = qMin(ts.size(), values.size());
+    if (*plotted <= n && graph < mainPlot->graphCount() &&
+            plotGeneration[plotSlot] == adoptedGeneration[plotSlot]) {
+        for (int ii = *plotted; ii < n; ++ii)
+            mainPlot->graph(graph)->addData(ts.at(ii), values.at(ii));
+        *plotted = n;
+        if (!replotTimer->isActive())
+            replotTimer->start();
     } else {
-        mainPlot->xAxis->setRange(xmin - (xmax - xmin) / 20.0 , xmax + (xmax - xmin) / 20.0 );
+        requestPlot(plotSlot, graph, QVector<QVector<double> >(1, ts), QVector<QVector<double> >(1, values),
+                    std::function<void()>());
+        *plotted = n;
     }
-    if (ymax == ymin) {
-        mainPlot->yAxis->setRange(ymin - 0.5, ymax + 0.5);
-    } else {
-        mainPlot->yAxis->setRange(ymin - (ymax - ymin) / 20.0 , ymax + (ymax - ymin) / 20.0 );
+}
+
+/*!
+   \brief Requests the update of the graphs from \a firstGraph on by the data
+   \a xs and \a ys, one pair for each graph.
+
+   The QCPDataMap objects, which QCustomPlot needs, are built from the
+   snapshot in the plotPool, so the GUI thread only adopts them and replots in
+   plotDataReady(), where \a finish is called before the replot. The graphs
+   are added if needed, for AllGraphs the superfluous graphs are removed.
+
+   The snapshot of the same \a plotSlot which is requested later replaces the
+   one, which is not built or adopted yet, so the plot never lags behind the
+   data.
+ */
+void PlotProxy::requestPlot(PlotSlot plotSlot, int firstGraph, const QVector<QVector<double> > &xs,
+                            const QVector<QVector<double> > &ys, std::function<void()> finish)
+{
+    PlotData *data = new PlotData;
+    data->plotSlot = plotSlot;
+    data->firstGraph = firstGraph;
+    data->xs = xs;
+    data->ys = ys;
+    data->finish = finish;
+    {
+        QMutexLocker locker(plotMutex.get());
+        data->generation = ++plotGeneration[plotSlot];
+    }
+    plotPool->start(new PlotDataBuilder([this, data] { buildPlotData(data); }));
+}
+
+// called in the plotPool
+void PlotProxy::buildPlotData(PlotData *data)
+{
+    QMutexLocker locker(plotMutex.get());
+    if (data->generation != plotGeneration[data->plotSlot]) {
+        // a newer snapshot was requested meanwhile
+        delete data;
+        return;
+    }
+    locker.unlock();
+
+    for (int ii = 0; ii < data->ys.size(); ++ii) {
+        QCPDataMap *map = new QCPDataMap;
+        const QVector<double> &x = data->xs.at(ii);
+        const QVector<double> &y = data->ys.at(ii);
+        int n = qMin(x.size(), y.size());
+        for (int jj = 0; jj < n; ++jj)
+            map->insertMulti(x.at(jj), QCPData(x.at(jj), y.at(jj)));
+        data->maps.append(map);
     }
-    mainPlot->replot();mainPlot->graph(0)->setData(appState->tReadTs(), appState->readTs());
+
+    locker.relock();
+    if (data->generation != plotGeneration[data->plotSlot]) {
+        delete data;
+        return;
+    }
+    readyPlotData[data->plotSlot].reset(data);
+    if (!blPlotDataReadyPending) {
+        blPlotDataReadyPending = true;
+        QMetaObject::invokeMethod(this, "plotDataReady", Qt::QueuedConnection);
+    }
+}
+
+// adopts all the built data and replots once
+void PlotProxy::plotDataReady()
+{
+    std::unique_ptr<PlotData> ready[PlotSlots];
+    {
+        QMutexLocker locker(plotMutex.get());
+        blPlotDataReadyPending = false;
+        for (int ii = 0; ii < PlotSlots; ++ii) {
+            // not the data of an older request, requested again meanwhile
+            if (readyPlotData[ii] && readyPlotData[ii]->generation == plotGeneration[ii])
+                ready[ii] = std::move(readyPlotData[ii]);
+            else
+                readyPlotData[ii].reset();
+        }
+    }
+    bool blReplot = false;
+    for (int ii = 0; ii < PlotSlots; ++ii) {
+        if (!ready[ii])
+            continue;
+        PlotData *data = ready[ii].get();
+        int graphs = data->firstGraph + data->maps.size();
+        while (mainPlot->graphCount() < graphs)
+            mainPlot->addGraph();
+        if (data->plotSlot == AllGraphs) {
+            while (mainPlot->graphCount() > graphs)
+                mainPlot->removeGraph(mainPlot->graphCount() - 1);
+        }
+        for (int jj = 0; jj < data->maps.size(); ++jj)
+            mainPlot->graph(data->firstGraph + jj)->setData(data->maps.at(jj), false);
+        data->maps.clear();
+        adoptedGeneration[ii] = data->generation;
+        if (data->finish)
+            data->finish();
+        blReplot = true;
+    }
+    if (blReplot) {
+        replotTimer->stop();
+        mainPlot->replot();
+    }
+}
+
+// the data requested for the removed graphs are dropped
+void PlotProxy::clearGraphs()
+{
+    {
+        QMutexLocker locker(plotMutex.get());
+        for (int ii = 0; ii < PlotSlots; ++ii) {
+            adoptedGeneration[ii] = ++plotGeneration[ii];
+            readyPlotData[ii].reset();
+        }
+    }
+    readTsPlotted = 0;
+    measTsPlotted = 0;
+    mainPlot->clearGraphs();
+}
+
+void PlotProxy::plotGraphs(AppState *appState)
+{
+    hideWaterfall();
+    QMutexLocker lockerY(appState->getSpectrum().toMutexY());
+    QMutexLocker lockerX(appState->getSpectrum().toMutexX());
+    QVector<QVector<double> > xs = appState->getPlotSpectrum().toXQVector();
+    QVector<QVector<double> > ys = appState->getPlotSpectrum().toYQVector();
+    lockerY.unlock();
+    lockerX.unlock();
+    appState->setSpectrumChanged(false);
+    double lims[4];
+    appState->getPlotSpectrum().getLimsSafe(lims);
+    double dX = (lims[1] - lims[0]) / 10;
+    double dY = (lims[3] - lims[2]) / 10;
+    requestPlot(AllGraphs, 0, xs, ys, [this, lims, dX, dY] {
+        mainPlot->xAxis->setRange(lims[0] - dX, lims[1] + dX);
+        mainPlot->yAxis->setRange(lims[2] - dY, lims[3] + dY);
+    });
+}
+
+// the waterfall with the history of the spectra replaces the graphs of the
+// last spectrum or of the temperatures
+void PlotProxy::setWaterfallView(bool blWaterfallView_, AppState *appState)
+{
+    blWaterfallView = blWaterfallView_;
+    if (appState->plotStyle() == AppStateTraits::PlotStyle::Temperatures) {
+        onPlotTemperatures();
+        if (!blWaterfallView) {
+            onUpdateReadT(appState);
+            onUpdateMeasT(appState);
+        }
+    } else if (appState->getPlotType() == AppStateTraits::PlotType::Spectrum) {
+        if (blWaterfallView) {
+            clearGraphs();
+            plotWaterfall();
+        } else {
+            plotGraphs(appState);
+        }
+    }
+}
+
+void PlotProxy::clearWaterfall()
+{
+    waterfall->clear();
+}
+
+// each frame of the processed spectrum is one row of the waterfall, also when
+// it is not shown, in all the plot styles. The rows are the copy sent with
+// the spectrum, the spectrum in AppState may be a newer one already.
+void PlotProxy::appendWaterfall(const QVector<QVector<double> > &rows, const QVector<double> &x)
+{
+    if (rows.isEmpty())
+        return;
+    for (const QVector<double> &row : rows)
+        waterfall->append(row);
+    if (!x.isEmpty()) {
+        waterfallXFirst = x.first();
+        waterfallXLast = x.last();
+    }
+    if (waterfallItem && waterfallItem->visible())
+        plotWaterfall();
+}
+
+// only the new rows are drawn into the waterfall's image, the replot converts
+// the image of the screen size at most
+void PlotProxy::plotWaterfall()
+{
+    if (!waterfallItem) {
+        waterfallItem = new QCPItemPixmap(mainPlot);
+        mainPlot->addItem(waterfallItem);
+        waterfallItem->setScaled(true, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+    }
+    int spectra = waterfall->spectra();
+    waterfallItem->setPixmap(QPixmap::fromImage(waterfall->image()));
+    waterfallItem->topLeft->setCoords(waterfallXFirst, 0);
+    waterfallItem->bottomRight->setCoords(waterfallXLast, spectra);
+    waterfallItem->setVisible(true);
+    mainPlot->xAxis->setRange(waterfallXFirst, waterfallXLast);
+    mainPlot->yAxis->setRange(0, spectra > 0 ? spectra : 1);
+    // the oldest spectrum at the top
+    mainPlot->yAxis->setRangeReversed(true);
     mainPlot->replot();
 }
 
-PlotProxy::~PlotProxy()
+void PlotProxy::hideWaterfall()
 {
+    if (waterfallItem && waterfallItem->visible()) {
+        waterfallItem->setVisible(false);
+        mainPlot->yAxis->setRangeReversed(false);
+    }
+}
 
+PlotProxy::~PlotProxy()
+{
+    plotPool->waitForDone();
 }
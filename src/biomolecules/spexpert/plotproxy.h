@@ -1,11 +1,26 @@
 #ifndef PLOTPROXY_H
 #define PLOTPROXY_H
 
+#include <functional>
+#include <memory>
+
 #include <QObject>
+#include <QVector>
 
 // forward declarations
 class QCustomPlot;
+class QCPItemPixmap;
+class QMutex;
+class QThreadPool;
+class QTimer;
 class AppState;
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+class Waterfall;
+}
+}
+}
 
 class PlotProxy : public QObject
 {
@@ -16,6 +31,7 @@ public:
 
     QCustomPlot* getMainPlot();
     QWidget *getMainPlotWidget();
+    bool waterfallView() const { return blWaterfallView; }
 signals:
 
 public slots:
@@ -24,10 +40,58 @@ public slots:
     void onPlotTemperatures();
     void onUpdateMeasT(AppState *appState);
     void onUpdateReadT(AppState *appState);
+    void setWaterfallView(bool blWaterfallView_, AppState *appState);
+    void clearWaterfall();
+    void appendWaterfall(const QVector<QVector<double> > &rows, const QVector<double> &x);
+
+private slots:
+    void plotDataReady();
 
 private:
+    // graphs of the plot which are updated together, a newer request replaces
+    // the older one of the same kind
+    enum PlotSlot {
+        AllGraphs   = 0,
+        ReadTGraph  = 1,
+        MeasTGraph  = 2,
+        PlotSlots   = 3
+    };
+    struct PlotData;
+
+    void requestPlot(PlotSlot plotSlot, int firstGraph, const QVector<QVector<double> > &xs,
+                     const QVector<QVector<double> > &ys, std::function<void()> finish);
+    void buildPlotData(PlotData *data);
+    void clearGraphs();
+    void setTRanges(AppState *appState);
+    void appendT(PlotSlot plotSlot, int graph, const QVector<double> &ts,
+                 const QVector<double> &values, int *plotted);
+    void plotGraphs(AppState *appState);
+    void plotWaterfall();
+    void hideWaterfall();
+
     QCustomPlot *mainPlot;
 
+    // history of the spectra, shown instead of the graphs of the spectrum or
+    // of the temperatures if blWaterfallView
+    std::unique_ptr<biomolecules::spexpert::core::Waterfall> waterfall;
+    QCPItemPixmap *waterfallItem;
+    bool blWaterfallView;
+    double waterfallXFirst;
+    double waterfallXLast;
+
+    // the graph data are built in plotPool, see requestPlot()
+    QThreadPool *plotPool;
+    std::unique_ptr<QMutex> plotMutex;
+    unsigned long long plotGeneration[PlotSlots];     // latest requests
+    unsigned long long adoptedGeneration[PlotSlots];  // GUI thread only
+    std::unique_ptr<PlotData> readyPlotData[PlotSlots];
+    bool blPlotDataReadyPending;
+
+    // temperatures already in the graphs, see appendT()
+    int readTsPlotted;
+    int measTsPlotted;
+    QTimer *replotTimer;
+
     double xmin;
     double xmax;
     double ymin;
@@ -14,6 +14,10 @@ struct Settings
     sprelay::core::k8090::RelayID calibration_lamp_switch_id;
     bool calibration_lamp_switch_on;
     unsigned int calibration_lamp_switch_delay_msec;
+    bool dark_shutter_switch_enabled;
+    sprelay::core::k8090::RelayID dark_shutter_switch_id;
+    bool dark_shutter_switch_on;
+    unsigned int dark_shutter_switch_delay_msec;
 };
 
 }  // biomolecules
@@ -0,0 +1,556 @@
+#include "spectrumarchive.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <QDataStream>
+#include <QFile>
+
+#include <QDebug>
+
+#include "countspectrum.h"
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+namespace {
+
+const quint32 kArchiveMagic = 0x41585053;  // "SPXA"
+const quint32 kChunkMagic = 0x43585053;    // "SPXC"
+const quint32 kTrailerMagic = 0x49585053;  // "SPXI"
+const quint32 kVersion = 1;
+const qint64 kHeaderSize = 8;
+const qint64 kTrailerSize = 12;
+
+// quotients from kEscape on are replaced by the raw value of kRawBits bits,
+// the residual of two 32 bit counts fits in 33 bits after the zigzag mapping
+const int kEscape = 24;
+const int kRawBits = 34;
+const int kMaxK = 32;
+const int kResetCount = 64;
+
+void setUp(QDataStream& stream)
+{
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream.setByteOrder(QDataStream::LittleEndian);
+}
+
+inline std::uint64_t zigzag(std::int64_t value)
+{
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+inline std::int64_t unzigzag(std::uint64_t value)
+{
+    return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+class BitWriter
+{
+public:
+    explicit BitWriter(QByteArray& out) : out_(out), acc_{0}, bits_{0} {}
+
+    void put(std::uint64_t value, int bits)
+    {
+        while (bits > 32) {
+            bits -= 32;
+            put32(static_cast<std::uint32_t>(value >> bits), 32);
+        }
+        put32(static_cast<std::uint32_t>(value & ((std::uint64_t{1} << bits) - 1)), bits);
+    }
+
+    void ones(int count)
+    {
+        while (count > 32) {
+            put32(0xffffffffu, 32);
+            count -= 32;
+        }
+        put32(static_cast<std::uint32_t>((std::uint64_t{1} << count) - 1), count);
+    }
+
+    void flush()
+    {
+        if (bits_ > 0) {
+            out_.append(static_cast<char>((acc_ << (8 - bits_)) & 0xff));
+            acc_ = 0;
+            bits_ = 0;
+        }
+    }
+
+private:
+    void put32(std::uint32_t value, int bits)
+    {
+        acc_ = (acc_ << bits) | value;
+        bits_ += bits;
+        while (bits_ >= 8) {
+            bits_ -= 8;
+            out_.append(static_cast<char>((acc_ >> bits_) & 0xff));
+        }
+        acc_ &= (std::uint64_t{1} << bits_) - 1;
+    }
+
+    QByteArray& out_;
+    std::uint64_t acc_;
+    int bits_;
+};
+
+class BitReader
+{
+public:
+    explicit BitReader(const QByteArray& data)
+        : data_{reinterpret_cast<const unsigned char*>(data.constData())},
+          size_{data.size()},
+          pos_{0},
+          acc_{0},
+          bits_{0},
+          overrun_{false}
+    {}
+
+    std::uint64_t get(int bits)
+    {
+        std::uint64_t value = 0;
+        while (bits > 32) {
+            bits -= 32;
+            value = (value << 32) | get32(32);
+        }
+        return (value << bits) | get32(bits);
+    }
+
+    int ones(int limit)
+    {
+        int count = 0;
+        while (count < limit && get32(1)) {
+            ++count;
+        }
+        return count;
+    }
+
+    bool overrun() const { return overrun_; }
+
+private:
+    std::uint32_t get32(int bits)
+    {
+        while (bits_ < bits) {
+            if (pos_ < size_) {
+                acc_ = (acc_ << 8) | data_[pos_++];
+            } else {
+                acc_ <<= 8;
+                overrun_ = true;
+            }
+            bits_ += 8;
+        }
+        bits_ -= bits;
+        std::uint32_t value = static_cast<std::uint32_t>((acc_ >> bits_) & ((std::uint64_t{1} << bits) - 1));
+        acc_ &= (std::uint64_t{1} << bits_) - 1;
+        return value;
+    }
+
+    const unsigned char* data_;
+    int size_;
+    int pos_;
+    std::uint64_t acc_;
+    int bits_;
+    bool overrun_;
+};
+
+// adaptive Rice parameter as in LOCO-I, from the running mean of the mapped
+// residuals
+class RiceState
+{
+public:
+    RiceState() : sum_{32}, count_{1} {}
+
+    int k() const
+    {
+        int k = 0;
+        while ((count_ << k) < sum_ && k < kMaxK) {
+            ++k;
+        }
+        return k;
+    }
+
+    void update(std::uint64_t value)
+    {
+        sum_ += value;
+        if (++count_ >= kResetCount) {
+            sum_ >>= 1;
+            count_ >>= 1;
+        }
+    }
+
+private:
+    std::uint64_t sum_;
+    std::uint64_t count_;
+};
+
+bool readChunkHeader(QDataStream& in, quint32* frames, quint32* x, CountSpectrumInfo* info,
+                     QByteArray* payload)
+{
+    quint32 magic;
+    qint32 accumulations;
+    qint32 window;
+    in >> magic;
+    if (in.status() != QDataStream::Ok || magic != kChunkMagic) {
+        return false;
+    }
+    in >> *frames >> *x >> info->exposure >> accumulations >> window >> info->fileName >> *payload;
+    info->accumulations = accumulations;
+    info->window = window;
+    return in.status() == QDataStream::Ok;
+}
+
+/*!
+   \brief Reads the chunk offsets from the index of the archive \a file or, if
+   the index is missing, e.g. after a crash, by scanning the chunks.
+   \a end is set to the end of the last chunk.
+ */
+bool readOffsets(QFile& file, QVector<qint64>& offsets, qint64& end)
+{
+    offsets.clear();
+    QDataStream in(&file);
+    setUp(in);
+    quint32 magic;
+    quint32 version;
+    file.seek(0);
+    in >> magic >> version;
+    if (in.status() != QDataStream::Ok || magic != kArchiveMagic || version != kVersion) {
+        return false;
+    }
+
+    const qint64 size = file.size();
+    if (size >= kHeaderSize + kTrailerSize) {
+        qint64 index_offset;
+        quint32 trailer;
+        file.seek(size - kTrailerSize);
+        in >> index_offset >> trailer;
+        if (in.status() == QDataStream::Ok && trailer == kTrailerMagic && index_offset >= kHeaderSize
+                && index_offset <= size - kTrailerSize - 4) {
+            quint32 count;
+            file.seek(index_offset);
+            in >> count;
+            if (static_cast<qint64>(count) * 8 == size - kTrailerSize - 4 - index_offset) {
+                offsets.resize(count);
+                for (quint32 ii = 0; ii < count; ++ii) {
+                    in >> offsets[ii];
+                }
+                if (in.status() == QDataStream::Ok) {
+                    end = index_offset;
+                    return true;
+                }
+            }
+        }
+        in.resetStatus();
+        offsets.clear();
+    }
+
+    qint64 pos = kHeaderSize;
+    file.seek(pos);
+    quint32 frames;
+    quint32 x;
+    CountSpectrumInfo info;
+    QByteArray payload;
+    while (readChunkHeader(in, &frames, &x, &info, &payload)) {
+        offsets.append(pos);
+        pos = file.pos();
+    }
+    in.resetStatus();
+    end = pos;
+    return true;
+}
+
+}  // namespace
+
+
+/*!
+   \class SpectrumCodec
+   \brief Lossless compression of the CountSpectrum.
+
+   Every frame is predicted either from the previous pixel or, from the second
+   frame on, from the same pixel of the previous frame, whichever gives the
+   smaller residuals, and the choice is stored as one bit. The residuals are
+   mapped to unsigned values and written by the adaptive Rice coding, which
+   suits their roughly Laplacian distribution and needs only a few operations
+   per pixel. The rare large residuals, e.g. of cosmic rays, are escaped and
+   written raw.
+ */
+
+void SpectrumCodec::encode(const CountSpectrum& spectrum, QByteArray& out)
+{
+    out.clear();
+    const int frames = spectrum.frames();
+    const int x = spectrum.size();
+    out.reserve(frames * x);
+    BitWriter writer{out};
+    RiceState state;
+    for (int frame = 0; frame < frames; ++frame) {
+        bool from_frame = false;
+        if (frame > 0) {
+            std::int64_t pixel_cost = 0;
+            std::int64_t frame_cost = 0;
+            for (int ii = 0; ii < x; ++ii) {
+                std::int64_t value = spectrum.count(frame, ii);
+                pixel_cost += std::llabs(value - (ii > 0 ? spectrum.count(frame, ii - 1) : 0));
+                frame_cost += std::llabs(value - spectrum.count(frame - 1, ii));
+            }
+            from_frame = frame_cost < pixel_cost;
+            writer.put(from_frame ? 1 : 0, 1);
+        }
+        for (int ii = 0; ii < x; ++ii) {
+            std::int64_t prediction;
+            if (from_frame) {
+                prediction = spectrum.count(frame - 1, ii);
+            } else {
+                prediction = ii > 0 ? spectrum.count(frame, ii - 1) : 0;
+            }
+            std::uint64_t value = zigzag(static_cast<std::int64_t>(spectrum.count(frame, ii)) - prediction);
+            int k = state.k();
+            std::uint64_t quotient = value >> k;
+            if (quotient < static_cast<std::uint64_t>(kEscape)) {
+                writer.ones(static_cast<int>(quotient));
+                writer.put(0, 1);
+                writer.put(value, k);
+            } else {
+                writer.ones(kEscape);
+                writer.put(value, kRawBits);
+            }
+            state.update(value);
+        }
+    }
+    writer.flush();
+}
+
+
+/*!
+   \return false if the \a data are not an encoded spectrum of \a frames
+   frames of \a x pixels.
+ */
+bool SpectrumCodec::decode(const QByteArray& data, int frames, int x, CountSpectrum& spectrum)
+{
+    if (frames < 1 || x < 1) {
+        return false;
+    }
+    QVector<std::uint32_t> counts(frames * x);
+    std::uint32_t* current = counts.data();
+    BitReader reader{data};
+    RiceState state;
+    for (int frame = 0; frame < frames; ++frame, current += x) {
+        const std::uint32_t* previous = current - x;
+        bool from_frame = frame > 0 && reader.get(1);
+        for (int ii = 0; ii < x; ++ii) {
+            std::uint64_t value;
+            int k = state.k();
+            int quotient = reader.ones(kEscape);  // consumes the terminating zero
+            if (quotient < kEscape) {
+                value = (static_cast<std::uint64_t>(quotient) << k) | reader.get(k);
+            } else {
+                value = reader.get(kRawBits);
+            }
+            state.update(value);
+            std::int64_t prediction;
+            if (from_frame) {
+                prediction = previous[ii];
+            } else {
+                prediction = ii > 0 ? current[ii - 1] : 0;
+            }
+            std::int64_t count = prediction + unzigzag(value);
+            if (count < 0 || count > 0xffffffffll) {
+                return false;
+            }
+            current[ii] = static_cast<std::uint32_t>(count);
+        }
+    }
+    if (reader.overrun()) {
+        return false;
+    }
+    return spectrum.fromCounts(counts, frames, x);
+}
+
+
+/*!
+   \class SpectrumArchiveWriter
+   \brief Appends the CountSpectrum of every measurement to the spectrum
+   archive, compressed by the SpectrumCodec.
+
+   The archive starts with a header, the spectra follow as chunks with the
+   acquisition parameters and the compressed counts, and the index of the
+   chunk offsets closes the file. The index is rewritten after every appended
+   chunk, so the archive is complete after each measurement. If it is missing,
+   the archive is recovered by scanning the chunks.
+ */
+
+SpectrumArchiveWriter::SpectrumArchiveWriter()
+    : end_{0}
+{}
+
+
+SpectrumArchiveWriter::~SpectrumArchiveWriter()
+{
+    close();
+}
+
+
+/*!
+   \brief Opens the archive \a file_name, an existing one is appended to.
+ */
+bool SpectrumArchiveWriter::open(const QString& file_name)
+{
+    close();
+    file_.reset(new QFile{file_name});
+    if (file_->exists() && file_->size() > 0) {
+        if (!file_->open(QIODevice::ReadWrite) || !readOffsets(*file_, offsets_, end_)) {
+            qDebug() << "SpectrumArchiveWriter::open():" << file_name << "is not a spectrum archive";
+            file_.reset();
+            return false;
+        }
+        return true;
+    }
+    if (!file_->open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        qDebug() << "SpectrumArchiveWriter::open(): can not open" << file_name;
+        file_.reset();
+        return false;
+    }
+    QDataStream out(file_.get());
+    setUp(out);
+    out << kArchiveMagic << kVersion;
+    offsets_.clear();
+    end_ = kHeaderSize;
+    return writeIndex();
+}
+
+
+void SpectrumArchiveWriter::close()
+{
+    if (file_) {
+        file_->close();
+        file_.reset();
+    }
+    offsets_.clear();
+    end_ = 0;
+}
+
+
+bool SpectrumArchiveWriter::isOpen() const
+{
+    return file_ != nullptr;
+}
+
+
+QString SpectrumArchiveWriter::fileName() const
+{
+    return file_ ? file_->fileName() : QString{};
+}
+
+
+bool SpectrumArchiveWriter::append(const CountSpectrum& spectrum)
+{
+    if (!file_ || spectrum.isEmpty()) {
+        return false;
+    }
+    SpectrumCodec::encode(spectrum, buffer_);
+    file_->seek(end_);
+    QDataStream out(file_.get());
+    setUp(out);
+    out << kChunkMagic << static_cast<quint32>(spectrum.frames()) << static_cast<quint32>(spectrum.size())
+        << spectrum.info.exposure << static_cast<qint32>(spectrum.info.accumulations)
+        << static_cast<qint32>(spectrum.info.window) << spectrum.info.fileName << buffer_;
+    if (out.status() != QDataStream::Ok) {
+        return false;
+    }
+    offsets_.append(end_);
+    end_ = file_->pos();
+    return writeIndex();
+}
+
+
+bool SpectrumArchiveWriter::writeIndex()
+{
+    file_->seek(end_);
+    QDataStream out(file_.get());
+    setUp(out);
+    out << static_cast<quint32>(offsets_.size());
+    for (qint64 offset : offsets_) {
+        out << offset;
+    }
+    out << end_ << kTrailerMagic;
+    if (file_->size() > file_->pos()) {
+        file_->resize(file_->pos());
+    }
+    return out.status() == QDataStream::Ok && file_->flush();
+}
+
+
+/*!
+   \class SpectrumArchiveReader
+   \brief Reads the spectra from the archive written by the
+   SpectrumArchiveWriter, any of them directly by the index.
+ */
+
+SpectrumArchiveReader::SpectrumArchiveReader() = default;
+
+
+SpectrumArchiveReader::~SpectrumArchiveReader() = default;
+
+
+bool SpectrumArchiveReader::open(const QString& file_name)
+{
+    close();
+    file_.reset(new QFile{file_name});
+    qint64 end;
+    if (!file_->open(QIODevice::ReadOnly) || !readOffsets(*file_, offsets_, end)) {
+        qDebug() << "SpectrumArchiveReader::open():" << file_name << "is not a spectrum archive";
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+void SpectrumArchiveReader::close()
+{
+    file_.reset();
+    offsets_.clear();
+}
+
+
+bool SpectrumArchiveReader::read(int index, CountSpectrum& spectrum)
+{
+    return readChunk(index, &spectrum, nullptr);
+}
+
+
+bool SpectrumArchiveReader::info(int index, CountSpectrumInfo& info)
+{
+    return readChunk(index, nullptr, &info);
+}
+
+
+bool SpectrumArchiveReader::readChunk(int index, CountSpectrum* spectrum, CountSpectrumInfo* info)
+{
+    if (!file_ || index < 0 || index >= offsets_.size() || !file_->seek(offsets_.at(index))) {
+        return false;
+    }
+    QDataStream in(file_.get());
+    setUp(in);
+    quint32 frames;
+    quint32 x;
+    CountSpectrumInfo chunk_info;
+    QByteArray payload;
+    if (!readChunkHeader(in, &frames, &x, &chunk_info, &payload)) {
+        return false;
+    }
+    if (info) {
+        *info = chunk_info;
+    }
+    if (spectrum) {
+        if (!SpectrumCodec::decode(payload, static_cast<int>(frames), static_cast<int>(x), *spectrum)) {
+            return false;
+        }
+        spectrum->info = chunk_info;
+    }
+    return true;
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
@@ -0,0 +1,78 @@
+#ifndef BIOMOLECULES_SPEXPERT_SPECTRUMARCHIVE_H_
+#define BIOMOLECULES_SPEXPERT_SPECTRUMARCHIVE_H_
+
+#include <memory>
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+
+// forward declarations
+class QFile;
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+class CountSpectrum;
+struct CountSpectrumInfo;
+
+class SpectrumCodec
+{
+public:
+    static void encode(const CountSpectrum& spectrum, QByteArray& out);
+    static bool decode(const QByteArray& data, int frames, int x, CountSpectrum& spectrum);
+};
+
+class SpectrumArchiveWriter
+{
+public:
+    SpectrumArchiveWriter();
+    SpectrumArchiveWriter(const SpectrumArchiveWriter&) = delete;
+    SpectrumArchiveWriter& operator=(const SpectrumArchiveWriter&) = delete;
+    ~SpectrumArchiveWriter();
+
+    bool open(const QString& file_name);
+    void close();
+    bool isOpen() const;
+    QString fileName() const;
+    bool append(const CountSpectrum& spectrum);
+    int size() const { return offsets_.size(); }
+
+private:
+    bool writeIndex();
+
+    std::unique_ptr<QFile> file_;
+    QVector<qint64> offsets_;
+    qint64 end_;  // end of the last chunk, where the index starts
+    QByteArray buffer_;
+};
+
+class SpectrumArchiveReader
+{
+public:
+    SpectrumArchiveReader();
+    SpectrumArchiveReader(const SpectrumArchiveReader&) = delete;
+    SpectrumArchiveReader& operator=(const SpectrumArchiveReader&) = delete;
+    ~SpectrumArchiveReader();
+
+    bool open(const QString& file_name);
+    void close();
+    int size() const { return offsets_.size(); }
+    bool read(int index, CountSpectrum& spectrum);
+    bool info(int index, CountSpectrumInfo& info);
+
+private:
+    bool readChunk(int index, CountSpectrum* spectrum, CountSpectrumInfo* info);
+
+    std::unique_ptr<QFile> file_;
+    QVector<qint64> offsets_;
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_SPECTRUMARCHIVE_H_
@@ -0,0 +1,416 @@
+#include "spectrumpipeline.h"
+
+#include <utility>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringBuilder>
+#include <QTextStream>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <QDebug>
+
+#include "appstate.h"
+#include "cosmicrayfilter.h"
+#include "countspectrum.h"
+#include "darklibrary.h"
+#include "driftmonitor.h"
+#include "lockableqvector.h"
+#include "spectrumarchive.h"
+#include "winspec.h"
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+/*!
+   \class SpectrumPipeline
+   \brief Converts and publishes acquired spectra on a dedicated worker thread.
+
+   WinSpecWaitTask only copies the raw data out of the detector and pushes them
+   here, so the next exposure can be started while the previous one is being
+   converted and plotted. The queue is bounded by capacity(), push() blocks the
+   producer when it is full, which throttles acquisition if the worker can not
+   keep up.
+
+   Before publishing, the spectra pass through the ProcessingChain built from
+   processingParams(). The chain is rebuilt in the worker thread before the
+   next spectrum whenever the parameters or references change or
+   rebuildStages() is called, e.g. at the start of each experiment.
+
+   Spectra marked as SpectrumJob::dark are not published, their frames are
+   combined and stored in the darkLibrary() instead. The dark stage of the
+   chain then looks up the dark matching each spectrum in it. The processed
+   measurement spectra are passed to the driftMonitor(), calibration spectra
+   reset it, both for the window of the extended range experiment they belong
+   to. The windows of the extended range experiment are joined by the
+   SpectrumStitcher if it is enabled and the growing composite is published
+   instead of the window.
+
+   The raw counts of the measurement spectra are converted to CountSpectrum,
+   which is compressed to the spectrum archive by the SpectrumArchiveWriter if
+   archiveFileName() is set.
+ */
+
+class SpectrumPipeline::Worker : public QThread
+{
+public:
+    explicit Worker(SpectrumPipeline* pipeline) : pipeline_{pipeline} {}
+
+protected:
+    void run() override { pipeline_->run(); }
+
+private:
+    SpectrumPipeline* pipeline_;
+};
+
+
+SpectrumPipeline::SpectrumPipeline(AppState* app_state, int capacity, QObject* parent)
+    : QObject{parent},
+      app_state_{app_state},
+      capacity_{capacity > 0 ? capacity : 1},
+      busy_{0},
+      quit_{false},
+      processing_params_{{false, 5.0, 3, 5.0}, false, false, 1, false, QVector<double>{}, 0,
+                         {false, 1.0, -1.0, true}, false, QString{}, QString{}},
+      rebuild_{true},
+      dark_library_{new DarkLibrary},
+      drift_monitor_{new DriftMonitor},
+      archive_{new SpectrumArchiveWriter},
+      mutex_{new QMutex},
+      not_empty_{new QWaitCondition},
+      not_full_{new QWaitCondition},
+      idle_{new QWaitCondition},
+      worker_{new Worker{this}}
+{
+    worker_->start();
+}
+
+
+SpectrumPipeline::~SpectrumPipeline()
+{
+    // the spectra acquired last are archived and published too
+    flush();
+    {
+        QMutexLocker locker{mutex_.get()};
+        quit_ = true;
+        not_empty_->wakeAll();
+        not_full_->wakeAll();
+    }
+    worker_->wait();
+}
+
+
+/*!
+   \brief Enqueues the raw spectrum, blocks while the queue is full.
+   \return false if the pipeline is shutting down and the job was dropped.
+ */
+bool SpectrumPipeline::push(SpectrumJob job)
+{
+    QMutexLocker locker{mutex_.get()};
+    while (queue_.size() >= capacity_ && !quit_) {
+        not_full_->wait(mutex_.get());
+    }
+    if (quit_) {
+        return false;
+    }
+    queue_.enqueue(std::move(job));
+    not_empty_->wakeOne();
+    return true;
+}
+
+
+/*!
+   \brief Blocks until all the queued spectra are published.
+ */
+void SpectrumPipeline::flush()
+{
+    QMutexLocker locker{mutex_.get()};
+    while ((!queue_.isEmpty() || busy_) && !quit_) {
+        idle_->wait(mutex_.get());
+    }
+}
+
+
+int SpectrumPipeline::pending() const
+{
+    QMutexLocker locker{mutex_.get()};
+    return queue_.size() + busy_;
+}
+
+
+ProcessingParams SpectrumPipeline::processingParams() const
+{
+    QMutexLocker locker{mutex_.get()};
+    return processing_params_;
+}
+
+
+/*!
+   \brief Sets the processing, it is applied from the next dequeued spectrum.
+ */
+void SpectrumPipeline::setProcessingParams(const ProcessingParams& params)
+{
+    QMutexLocker locker{mutex_.get()};
+    processing_params_ = params;
+    rebuild_ = true;
+}
+
+
+void SpectrumPipeline::setDarkReference(const QVector<double>& dark)
+{
+    QMutexLocker locker{mutex_.get()};
+    dark_ = dark;
+    rebuild_ = true;
+}
+
+
+void SpectrumPipeline::setFlatReference(const QVector<double>& flat)
+{
+    QMutexLocker locker{mutex_.get()};
+    flat_ = flat;
+    rebuild_ = true;
+}
+
+
+/*!
+   \brief Rebuilds the stages before the next spectrum, which also resets the
+   stage timings.
+ */
+void SpectrumPipeline::rebuildStages()
+{
+    QMutexLocker locker{mutex_.get()};
+    rebuild_ = true;
+}
+
+
+QString SpectrumPipeline::archiveFileName() const
+{
+    QMutexLocker locker{mutex_.get()};
+    return archive_file_name_;
+}
+
+
+/*!
+   \brief Sets the spectrum archive the next dequeued spectra are appended
+   to, the empty \a file_name stops the archiving.
+ */
+void SpectrumPipeline::setArchiveFileName(const QString& file_name)
+{
+    QMutexLocker locker{mutex_.get()};
+    archive_file_name_ = file_name;
+}
+
+
+QVector<StageTiming> SpectrumPipeline::stageTimings() const
+{
+    QMutexLocker locker{mutex_.get()};
+    return timings_;
+}
+
+
+void SpectrumPipeline::run()
+{
+    forever {
+        SpectrumJob job;
+        CosmicRayParams cosmic_ray_params;
+        StitchParams stitch_params;
+        QString archive_file_name;
+        {
+            QMutexLocker locker{mutex_.get()};
+            while (queue_.isEmpty() && !quit_) {
+                not_empty_->wait(mutex_.get());
+            }
+            if (quit_) {
+                return;
+            }
+            job = queue_.dequeue();
+            if (rebuild_) {
+                chain_ = ProcessingChain::fromParams(processing_params_, dark_, flat_, dark_library_.get());
+                stitcher_.reset(new SpectrumStitcher{processing_params_.stitching});
+                timings_ = chain_->timings();
+                rebuild_ = false;
+            }
+            cosmic_ray_params = processing_params_.cosmicRay;
+            stitch_params = processing_params_.stitching;
+            archive_file_name = archive_file_name_;
+            busy_ = 1;
+            not_full_->wakeOne();
+        }
+
+        bool converted;
+        CountSpectrum counts;
+        if (counts.fromRaw(job.raw, job.frames, job.x, job.y)) {
+            counts.toSpectrum(job.spectrum);
+            converted = true;
+        } else {
+            // e.g. the negative values of a background corrected WinSpec data
+            converted = WinSpec::convertSpectrum(job.raw, job.frames, job.x, job.y, job.spectrum);
+        }
+        if (converted) {
+            job.raw.clear();
+            if (!job.dark && !job.calibration && !counts.isEmpty()) {
+                counts.info = CountSpectrumInfo{job.file_name, job.exposure, job.accumulations, job.window};
+                archive(counts, archive_file_name);
+            }
+            if (job.dark) {
+                storeDark(job, cosmic_ray_params);
+            } else {
+                if (!chain_->isEmpty()) {
+                    chain_->process(job);
+                }
+                // the waterfall gets the measured spectra of the same length
+                // only, so the partial composites are left out
+                bool waterfall = !job.calibration;
+                if (job.calibration) {
+                    drift_monitor_->calibrated(job.window);
+                } else if (!job.spectrum.isEmpty()) {
+                    drift_monitor_->addSpectrum(job.spectrum.first(), job.window);
+                    if (stitch_params.enabled && job.window >= 0) {
+                        waterfall = stitch(job, stitch_params.saveComposite);
+                    }
+                }
+                publish(job, waterfall);
+            }
+        } else {
+            qDebug() << "SpectrumPipeline::run(): conversion of" << job.file_name << "failed";
+        }
+
+        QMutexLocker locker{mutex_.get()};
+        timings_ = chain_->timings();
+        busy_ = 0;
+        if (queue_.isEmpty()) {
+            idle_->wakeAll();
+        }
+    }
+}
+
+
+/*!
+   \brief Appends the \a counts to the archive \a file_name, which is opened
+   when it changes.
+ */
+void SpectrumPipeline::archive(const CountSpectrum& counts, const QString& file_name)
+{
+    if (file_name.isEmpty()) {
+        archive_->close();
+        return;
+    }
+    if (archive_->fileName() != file_name && !archive_->open(file_name)) {
+        return;
+    }
+    if (!archive_->append(counts)) {
+        qDebug() << "SpectrumPipeline::archive():" << counts.info.fileName << "was not archived";
+    }
+}
+
+
+/*!
+   \brief Moves the processed spectrum to the AppState and announces it by
+   spectrumProcessed().
+
+   The spectrum is published in all plot styles, so the waterfall gets the
+   spectra of the temperature series too. The first argument of
+   spectrumProcessed() is true only if the spectrum is plotted as graphs, i.e.
+   in the AppStateTraits::PlotStyle::Spectra plot style. The others are the
+   shared copies of the published frames and their axis if \a waterfall is
+   true, so the receiver does not depend on the spectrum in the AppState, which
+   may be replaced meanwhile, otherwise they are empty.
+ */
+void SpectrumPipeline::publish(SpectrumJob& job, bool waterfall)
+{
+    QVector<QVector<double> > waterfall_rows;
+    QVector<double> axis;
+    LockableSpectrum& spectrum = app_state_->getSpectrum();
+    {
+        QMutexLocker y_locker{spectrum.toMutexY()};
+        QMutexLocker x_locker{spectrum.toMutexX()};
+        spectrum.toYQVector().swap(job.spectrum);
+        if (!spectrum.toYQVector().isEmpty() && job.axis.size() == spectrum.toYQVector().first().size()) {
+            spectrum.toXQVector().swap(job.axis);
+        } else if (spectrum.toYQVector().isEmpty()
+                || spectrum.toXQVector().size() != spectrum.toYQVector().first().size()) {
+            spectrum.autoGenerateX();
+        }
+        if (waterfall) {
+            waterfall_rows = spectrum.toYQVector();
+            axis = spectrum.toXQVector();
+        }
+    }
+    if (app_state_->plotStyle() != AppStateTraits::PlotStyle::Spectra) {
+        emit spectrumProcessed(false, waterfall_rows, axis);
+        return;
+    }
+    app_state_->makePlotSpectrum();
+    // do not switch the plot away from the frames of the already running exposure
+    if (app_state_->winSpecState() == AppStateTraits::WinSpecState::Ready) {
+        app_state_->setPlotType(AppStateTraits::PlotType::Spectrum);
+    }
+    emit spectrumProcessed(true, waterfall_rows, axis);
+}
+
+/*!
+   \brief Combines the frames of the dark with the cosmic ray rejection and
+   stores the result in the darkLibrary().
+ */
+void SpectrumPipeline::storeDark(SpectrumJob& job, const CosmicRayParams& params)
+{
+    if (job.spectrum.isEmpty()) {
+        return;
+    }
+    CosmicRayFilter filter{params};
+    QVector<double> dark;
+    int rejected = filter.combine(job.spectrum, dark);
+    dark_library_->insert(dark_library_->key(job.exposure, job.accumulations), dark);
+    if (!dark_library_->save()) {
+        qDebug() << "SpectrumPipeline::storeDark(): dark library was not saved";
+    }
+    qDebug() << "SpectrumPipeline::storeDark(): stored dark" << job.file_name << "for exposure" << job.exposure
+             << "and" << job.accumulations << "accumulations," << rejected << "values rejected";
+}
+
+/*!
+   \brief Adds the window to the composite and replaces the job's spectrum by
+   the composite. The finished composite is saved next to the last window if
+   \a save is true.
+   \return true if the composite is finished.
+ */
+bool SpectrumPipeline::stitch(SpectrumJob& job, bool save)
+{
+    if (job.axis.size() != job.spectrum.first().size()) {
+        job.axis.resize(job.spectrum.first().size());
+        for (int ii = 0; ii < job.axis.size(); ++ii) {
+            job.axis[ii] = ii;
+        }
+    }
+    bool complete = stitcher_->add(job.window, job.windows, job.gratingPosition, job.axis, job.spectrum.first());
+    if (stitcher_->x().isEmpty()) {
+        return false;
+    }
+    job.axis = stitcher_->x();
+    job.spectrum.resize(1);
+    job.spectrum.first() = stitcher_->y();
+    if (!complete || !save || job.file_name.isEmpty()) {
+        return complete;
+    }
+
+    QFileInfo fileInfo{job.file_name};
+    QFile file{fileInfo.absolutePath() % QDir::separator() % fileInfo.completeBaseName() % "_stitched.txt"};
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qDebug() << "SpectrumPipeline::stitch(): can not save" << file.fileName();
+        return complete;
+    }
+    QTextStream out{&file};
+    for (int ii = 0; ii < job.axis.size(); ++ii) {
+        out << job.axis.at(ii) << '\t' << job.spectrum.first().at(ii) << '\n';
+    }
+    return complete;
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
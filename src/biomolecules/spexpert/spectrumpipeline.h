@@ -0,0 +1,94 @@
+#ifndef BIOMOLECULES_SPEXPERT_SPECTRUMPIPELINE_H_
+#define BIOMOLECULES_SPEXPERT_SPECTRUMPIPELINE_H_
+
+#include <memory>
+
+#include <QObject>
+#include <QQueue>
+#include <QString>
+#include <QVector>
+
+#include "spectrumprocessing.h"
+
+
+// forward declarations
+class AppState;
+class QMutex;
+class QThread;
+class QWaitCondition;
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+class CountSpectrum;
+class DriftMonitor;
+class SpectrumArchiveWriter;
+
+class SpectrumPipeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SpectrumPipeline(AppState* app_state, int capacity = 4, QObject* parent = nullptr);
+    SpectrumPipeline(const SpectrumPipeline&) = delete;
+    SpectrumPipeline& operator=(const SpectrumPipeline&) = delete;
+    ~SpectrumPipeline() override;
+
+    bool push(SpectrumJob job);
+    void flush();
+    int pending() const;
+    int capacity() const { return capacity_; }
+    ProcessingParams processingParams() const;
+    void setProcessingParams(const ProcessingParams& params);
+    void setDarkReference(const QVector<double>& dark);
+    void setFlatReference(const QVector<double>& flat);
+    void rebuildStages();
+    QString archiveFileName() const;
+    void setArchiveFileName(const QString& file_name);
+    QVector<StageTiming> stageTimings() const;
+    DarkLibrary* darkLibrary() { return dark_library_.get(); }
+    DriftMonitor* driftMonitor() { return drift_monitor_.get(); }
+
+signals:
+    void spectrumProcessed(bool processed, const QVector<QVector<double> >& waterfall_rows,
+                           const QVector<double>& axis);
+
+private:
+    class Worker;
+
+    void run();
+    void archive(const CountSpectrum& counts, const QString& file_name);
+    void publish(SpectrumJob& job, bool waterfall);
+    void storeDark(SpectrumJob& job, const CosmicRayParams& params);
+    bool stitch(SpectrumJob& job, bool save);
+
+    AppState* app_state_;
+    const int capacity_;
+    QQueue<SpectrumJob> queue_;
+    int busy_;
+    bool quit_;
+    ProcessingParams processing_params_;
+    QVector<double> dark_;
+    QVector<double> flat_;
+    bool rebuild_;
+    std::unique_ptr<DarkLibrary> dark_library_;
+    std::unique_ptr<DriftMonitor> drift_monitor_;
+    std::unique_ptr<ProcessingChain> chain_;  // used only from the worker thread
+    std::unique_ptr<SpectrumStitcher> stitcher_;  // used only from the worker thread
+    std::unique_ptr<SpectrumArchiveWriter> archive_;  // used only from the worker thread
+    QString archive_file_name_;
+    QVector<StageTiming> timings_;
+    std::unique_ptr<QMutex> mutex_;
+    std::unique_ptr<QWaitCondition> not_empty_;
+    std::unique_ptr<QWaitCondition> not_full_;
+    std::unique_ptr<QWaitCondition> idle_;
+    std::unique_ptr<QThread> worker_;
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_SPECTRUMPIPELINE_H_
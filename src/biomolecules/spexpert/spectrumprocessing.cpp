@@ -0,0 +1,537 @@
+#include "spectrumprocessing.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegExp>
+#include <QRunnable>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+#include <QDebug>
+
+#include "darklibrary.h"
+#include "spefile.h"
+#include "winspec.h"
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+/*!
+   \brief Reads the fixed dark or flat field reference of the processing.
+
+   The frames of the .spe file are averaged. Other files are read as text
+   with the values in the last column, so a spectrum saved with its axis
+   can be used as well.
+   \return false if the file can not be read or contains no values.
+ */
+bool readReferenceSpectrum(const QString& file_name, QVector<double>& reference)
+{
+    reference.clear();
+    if (QFileInfo{file_name}.suffix().compare("spe", Qt::CaseInsensitive) == 0) {
+        QVariantList raw;
+        SpeHeader header;
+        QVector<QVector<double> > frames;
+        if (!SpeFile::read(file_name, raw, &header)
+                || !WinSpec::convertSpectrum(raw, header.frames, header.x, header.y, frames)) {
+            return false;
+        }
+        reference = frames.first();
+        for (int ff = 1; ff < frames.size(); ++ff) {
+            for (int ii = 0; ii < reference.size(); ++ii) {
+                reference[ii] += frames.at(ff).at(ii);
+            }
+        }
+        for (int ii = 0; ii < reference.size(); ++ii) {
+            reference[ii] /= frames.size();
+        }
+        return !reference.isEmpty();
+    }
+
+    QFile file{file_name};
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+    QTextStream in{&file};
+    QRegExp separators{"[\\s,;]+"};
+    while (!in.atEnd()) {
+        QStringList columns = in.readLine().split(separators, QString::SkipEmptyParts);
+        bool ok = false;
+        double value = columns.isEmpty() ? 0.0 : columns.last().toDouble(&ok);
+        if (ok) {
+            reference.append(value);
+        }
+    }
+    return !reference.isEmpty();
+}
+
+
+/*!
+   \class ProcessingStage
+   \brief Base of the spectrum processing stages run by ProcessingChain.
+
+   The stage gets the axis once per spectrum in processAxis() and every frame in
+   processFrame(). If frameParallel() returns true, processFrame() is called
+   for different frames concurrently, so it may touch only the data of the
+   given frame. Stages which need all the frames at once return false and
+   reimplement processJob(). All the working buffers should be allocated in
+   prepare(), which is called only when the shape of the input changes. The
+   per spectrum setup, e.g. the choice of the reference for its exposure,
+   belongs to begin(), which is called right before the stage processes the
+   spectrum.
+ */
+
+void ProcessingStage::prepare(int frames, int pixels)
+{
+    Q_UNUSED(frames);
+    Q_UNUSED(pixels);
+}
+
+
+void ProcessingStage::begin(const SpectrumJob& job)
+{
+    Q_UNUSED(job);
+}
+
+
+void ProcessingStage::processAxis(QVector<double>& axis)
+{
+    Q_UNUSED(axis);
+}
+
+
+void ProcessingStage::processFrame(int frame, QVector<double>& y)
+{
+    Q_UNUSED(frame);
+    Q_UNUSED(y);
+}
+
+
+void ProcessingStage::processJob(SpectrumJob& job)
+{
+    processAxis(job.axis);
+    for (int ii = 0; ii < job.spectrum.size(); ++ii) {
+        processFrame(ii, job.spectrum[ii]);
+    }
+}
+
+
+/*!
+   \class CosmicRayStage
+   \brief Merges the frames into a single spectrum without cosmic rays, see
+   CosmicRayFilter.
+ */
+
+CosmicRayStage::CosmicRayStage(const CosmicRayParams& params)
+    : ProcessingStage(QStringLiteral("cosmic rays")),
+      filter_(params)
+{}
+
+
+void CosmicRayStage::prepare(int frames, int pixels)
+{
+    Q_UNUSED(frames);
+    cleaned_.reserve(pixels);
+}
+
+
+void CosmicRayStage::processJob(SpectrumJob& job)
+{
+    job.rejected = filter_.combine(job.spectrum, cleaned_);
+    job.spectrum.resize(1);
+    job.spectrum.first().swap(cleaned_);
+    if (job.rejected) {
+        qDebug() << "CosmicRayStage::processJob():" << job.rejected << "cosmic ray values rejected in"
+                 << job.file_name;
+    }
+}
+
+
+/*!
+   \class DarkSubtractionStage
+   \brief Subtracts the dark from every frame.
+
+   The dark matching the exposure and accumulations of the spectrum is taken
+   from the DarkLibrary if it is enabled, otherwise the fixed dark reference is
+   used.
+ */
+
+DarkSubtractionStage::DarkSubtractionStage(const QVector<double>& dark, const DarkLibrary* library)
+    : ProcessingStage(QStringLiteral("dark")),
+      dark_(dark),
+      library_(library),
+      current_(&dark_),
+      matches_(false)
+{}
+
+
+void DarkSubtractionStage::begin(const SpectrumJob& job)
+{
+    current_ = &dark_;
+    if (library_ && job.exposure > 0.0 && library_->params().enabled
+            && library_->lookup(library_->key(job.exposure, job.accumulations), libraryDark_)) {
+        current_ = &libraryDark_;
+    }
+    const int pixels = job.spectrum.first().size();
+    matches_ = (current_->size() == pixels);
+    if (!matches_) {
+        qDebug() << "DarkSubtractionStage::begin(): no dark with" << pixels << "pixels for" << job.file_name
+                 << ", skipping";
+    }
+}
+
+
+void DarkSubtractionStage::processFrame(int frame, QVector<double>& y)
+{
+    Q_UNUSED(frame);
+    if (!matches_) {
+        return;
+    }
+    double* out = y.data();
+    const double* dark = current_->constData();
+    const int n = y.size();
+    for (int ii = 0; ii < n; ++ii) {
+        out[ii] -= dark[ii];
+    }
+}
+
+
+/*!
+   \class FlatFieldStage
+   \brief Corrects the pixel sensitivity by the flat reference normalized to the
+   unit mean.
+ */
+
+FlatFieldStage::FlatFieldStage(const QVector<double>& flat)
+    : ProcessingStage(QStringLiteral("flat field")),
+      gain_(flat.size(), 1.0),
+      matches_(false)
+{
+    double mean = 0.0;
+    for (int ii = 0; ii < flat.size(); ++ii) {
+        mean += flat.at(ii);
+    }
+    if (flat.size()) {
+        mean /= flat.size();
+    }
+    for (int ii = 0; ii < flat.size(); ++ii) {
+        if (flat.at(ii) > 0.0 && mean > 0.0) {
+            gain_[ii] = mean / flat.at(ii);
+        }
+    }
+}
+
+
+void FlatFieldStage::prepare(int frames, int pixels)
+{
+    Q_UNUSED(frames);
+    matches_ = (gain_.size() == pixels);
+    if (!matches_) {
+        qDebug() << "FlatFieldStage::prepare(): flat has" << gain_.size() << "pixels instead of" << pixels
+                 << ", skipping";
+    }
+}
+
+
+void FlatFieldStage::processFrame(int frame, QVector<double>& y)
+{
+    Q_UNUSED(frame);
+    if (!matches_) {
+        return;
+    }
+    double* out = y.data();
+    const double* gain = gain_.constData();
+    const int n = y.size();
+    for (int ii = 0; ii < n; ++ii) {
+        out[ii] *= gain[ii];
+    }
+}
+
+
+/*!
+   \class BinningStage
+   \brief Sums the neighbouring pixels into bins of the given size. The axis is
+   averaged, the incomplete bin at the end is dropped.
+ */
+
+BinningStage::BinningStage(int factor)
+    : ProcessingStage(QStringLiteral("binning")),
+      factor_(std::max(1, factor))
+{}
+
+
+void BinningStage::prepare(int frames, int pixels)
+{
+    axisBuffer_.reserve(pixels);
+    buffers_.resize(frames);
+    for (int ii = 0; ii < frames; ++ii) {
+        buffers_[ii].reserve(pixels);
+    }
+}
+
+
+void BinningStage::processAxis(QVector<double>& axis)
+{
+    bin(axis, axisBuffer_, factor_, 1.0 / factor_);
+    axis.swap(axisBuffer_);
+}
+
+
+void BinningStage::processFrame(int frame, QVector<double>& y)
+{
+    bin(y, buffers_[frame], factor_, 1.0);
+    y.swap(buffers_[frame]);
+}
+
+
+void BinningStage::bin(const QVector<double>& in, QVector<double>& out, int factor, double scale)
+{
+    const int n = in.size() / factor;
+    out.resize(n);
+    const double* src = in.constData();
+    double* dst = out.data();
+    for (int ii = 0; ii < n; ++ii) {
+        double sum = 0.0;
+        for (int jj = 0; jj < factor; ++jj) {
+            sum += src[ii * factor + jj];
+        }
+        dst[ii] = sum * scale;
+    }
+}
+
+
+/*!
+   \class CalibrationStage
+   \brief Maps the axis from pixels to the spectral units by the calibration
+   polynomial.
+ */
+
+CalibrationStage::CalibrationStage(const QVector<double>& coefficients)
+    : ProcessingStage(QStringLiteral("calibration")),
+      coefficients_(coefficients)
+{}
+
+
+void CalibrationStage::processAxis(QVector<double>& axis)
+{
+    if (coefficients_.isEmpty()) {
+        return;
+    }
+    double* x = axis.data();
+    const int n = axis.size();
+    for (int ii = 0; ii < n; ++ii) {
+        double value = 0.0;
+        for (int jj = coefficients_.size() - 1; jj >= 0; --jj) {
+            value = value * x[ii] + coefficients_.at(jj);
+        }
+        x[ii] = value;
+    }
+}
+
+
+/*!
+   \class SmoothingStage
+   \brief Moving average over 2 * halfWidth + 1 pixels, shortened at the edges.
+ */
+
+SmoothingStage::SmoothingStage(int halfWidth)
+    : ProcessingStage(QStringLiteral("smoothing")),
+      halfWidth_(std::max(1, halfWidth))
+{}
+
+
+void SmoothingStage::prepare(int frames, int pixels)
+{
+    buffers_.resize(frames);
+    for (int ii = 0; ii < frames; ++ii) {
+        buffers_[ii].reserve(pixels);
+    }
+}
+
+
+void SmoothingStage::processFrame(int frame, QVector<double>& y)
+{
+    QVector<double>& out = buffers_[frame];
+    const int n = y.size();
+    out.resize(n);
+    const double* src = y.constData();
+    double* dst = out.data();
+    double sum = 0.0;
+    int from = 0;
+    int to = -1;
+    for (int ii = 0; ii < n; ++ii) {
+        // slide the window [from, to] by the running sum
+        const int new_to = std::min(n - 1, ii + halfWidth_);
+        while (to < new_to) {
+            sum += src[++to];
+        }
+        const int new_from = std::max(0, ii - halfWidth_);
+        while (from < new_from) {
+            sum -= src[from++];
+        }
+        dst[ii] = sum / (to - from + 1);
+    }
+    y.swap(out);
+}
+
+
+/*!
+   \class ProcessingChain
+   \brief Runs the registered stages in order and measures their duration.
+
+   Stages which can process the frames independently are run on the chain's own
+   thread pool when the spectrum has more than one frame. Timings of the stages
+   are accessible through timings().
+ */
+
+namespace {
+
+class FrameRunnable : public QRunnable
+{
+public:
+    FrameRunnable(ProcessingStage* stage, QVector<double>* frames, int from, int to)
+        : stage_(stage), frames_(frames), from_(from), to_(to)
+    {}
+
+    void run() override
+    {
+        for (int ii = from_; ii < to_; ++ii) {
+            stage_->processFrame(ii, frames_[ii]);
+        }
+    }
+
+private:
+    ProcessingStage* stage_;
+    QVector<double>* frames_;
+    int from_;
+    int to_;
+};
+
+}  // namespace
+
+
+/*!
+   \brief Constructs the chain, \a threads less than 1 means the ideal thread count.
+ */
+ProcessingChain::ProcessingChain(int threads)
+    : pool_(new QThreadPool)
+{
+    pool_->setMaxThreadCount(threads > 0 ? threads : QThread::idealThreadCount());
+}
+
+
+ProcessingChain::~ProcessingChain()
+{
+    pool_->waitForDone();
+}
+
+
+/*!
+   \brief Builds the chain in the fixed order: cosmic rays, dark, flat field,
+   binning, calibration and smoothing. The dark and flat stages are left out if
+   there is no reference, the \a darkLibrary may be null.
+ */
+std::unique_ptr<ProcessingChain> ProcessingChain::fromParams(const ProcessingParams& params,
+                                                             const QVector<double>& dark,
+                                                             const QVector<double>& flat,
+                                                             const DarkLibrary* darkLibrary)
+{
+    std::unique_ptr<ProcessingChain> chain{new ProcessingChain};
+    if (params.cosmicRay.enabled) {
+        chain->addStage(std::unique_ptr<ProcessingStage>{new CosmicRayStage{params.cosmicRay}});
+    }
+    if (params.darkSubtraction && (!dark.isEmpty() || darkLibrary)) {
+        chain->addStage(std::unique_ptr<ProcessingStage>{new DarkSubtractionStage{dark, darkLibrary}});
+    }
+    if (params.flatField && !flat.isEmpty()) {
+        chain->addStage(std::unique_ptr<ProcessingStage>{new FlatFieldStage{flat}});
+    }
+    if (params.binning > 1) {
+        chain->addStage(std::unique_ptr<ProcessingStage>{new BinningStage{params.binning}});
+    }
+    if (params.calibration) {
+        chain->addStage(std::unique_ptr<ProcessingStage>{new CalibrationStage{params.calibrationCoefficients}});
+    }
+    if (params.smoothing > 0) {
+        chain->addStage(std::unique_ptr<ProcessingStage>{new SmoothingStage{params.smoothing}});
+    }
+    return chain;
+}
+
+
+void ProcessingChain::addStage(std::unique_ptr<ProcessingStage> stage)
+{
+    StageTiming timing = {stage->name(), 0, 0, 0, 0};
+    timings_.append(timing);
+    shapes_.push_back(-1);
+    shapes_.push_back(-1);
+    stages_.push_back(std::move(stage));
+}
+
+
+void ProcessingChain::process(SpectrumJob& job)
+{
+    if (job.spectrum.isEmpty()) {
+        return;
+    }
+    if (job.axis.size() != job.spectrum.first().size()) {
+        job.axis.resize(job.spectrum.first().size());
+        for (int ii = 0; ii < job.axis.size(); ++ii) {
+            job.axis[ii] = ii;
+        }
+    }
+
+    QElapsedTimer timer;
+    for (std::size_t ii = 0; ii < stages_.size(); ++ii) {
+        if (job.spectrum.isEmpty()) {
+            break;
+        }
+        ProcessingStage* stage = stages_[ii].get();
+        timer.start();
+
+        const int frames = job.spectrum.size();
+        const int pixels = job.spectrum.first().size();
+        if (shapes_[2 * ii] != frames || shapes_[2 * ii + 1] != pixels) {
+            stage->prepare(frames, pixels);
+            shapes_[2 * ii] = frames;
+            shapes_[2 * ii + 1] = pixels;
+        }
+        stage->begin(job);
+        if (stage->frameParallel() && frames > 1 && pool_->maxThreadCount() > 1) {
+            stage->processAxis(job.axis);
+            runFrames(stage, job);
+        } else {
+            stage->processJob(job);
+        }
+
+        const qint64 elapsed = timer.nsecsElapsed();
+        StageTiming& timing = timings_[static_cast<int>(ii)];
+        ++timing.calls;
+        timing.lastNSec = elapsed;
+        timing.totalNSec += elapsed;
+        timing.maxNSec = std::max(timing.maxNSec, elapsed);
+    }
+}
+
+
+void ProcessingChain::runFrames(ProcessingStage* stage, SpectrumJob& job)
+{
+    const int frames = job.spectrum.size();
+    const int chunks = std::min(frames, pool_->maxThreadCount());
+    // data() detaches the outer vector once, the runnables then touch disjoint frames
+    QVector<double>* data = job.spectrum.data();
+    for (int ii = 0; ii < chunks; ++ii) {
+        pool_->start(new FrameRunnable{stage, data, ii * frames / chunks, (ii + 1) * frames / chunks});
+    }
+    pool_->waitForDone();
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
@@ -0,0 +1,199 @@
+#ifndef BIOMOLECULES_SPEXPERT_SPECTRUMPROCESSING_H_
+#define BIOMOLECULES_SPEXPERT_SPECTRUMPROCESSING_H_
+
+#include <memory>
+#include <vector>
+
+#include <QString>
+#include <QVariantList>
+#include <QVector>
+
+#include "cosmicrayfilter.h"
+#include "spectrumstitcher.h"
+
+
+// forward declarations
+class QThreadPool;
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+class DarkLibrary;
+
+struct SpectrumJob
+{
+    QVariantList raw;
+    int frames = 0;
+    int x = 0;
+    int y = 0;
+    QVector<double> axis;
+    QVector<QVector<double> > spectrum;
+    QString file_name;
+    double exposure = 0.0;
+    int accumulations = 0;
+    bool dark = false;  // dark for the DarkLibrary, it is not processed
+    bool calibration = false;
+    int window = -1;  // window of the extended range experiment
+    int windows = 0;
+    double gratingPosition = 0.0;
+    int rejected = 0;
+};
+
+struct ProcessingParams
+{
+    CosmicRayParams cosmicRay;
+    bool darkSubtraction;
+    bool flatField;
+    int binning;                              // 1 means no binning
+    bool calibration;
+    QVector<double> calibrationCoefficients;  // polynomial from the lowest order
+    int smoothing;                            // half width of the window, 0 means no smoothing
+    StitchParams stitching;
+    bool archive;                             // raw counts to the SpectrumArchiveWriter
+    QString darkReference;                    // file of the fixed dark, see readReferenceSpectrum()
+    QString flatReference;                    // file of the flat field
+};
+
+struct StageTiming
+{
+    QString name;
+    int calls;
+    qint64 lastNSec;
+    qint64 totalNSec;
+    qint64 maxNSec;
+};
+
+bool readReferenceSpectrum(const QString& file_name, QVector<double>& reference);
+
+class ProcessingStage
+{
+public:
+    explicit ProcessingStage(const QString& name) : name_(name) {}
+    ProcessingStage(const ProcessingStage&) = delete;
+    ProcessingStage& operator=(const ProcessingStage&) = delete;
+    virtual ~ProcessingStage() {}
+
+    const QString& name() const { return name_; }
+    virtual bool frameParallel() const { return true; }
+    virtual void prepare(int frames, int pixels);
+    virtual void begin(const SpectrumJob& job);
+    virtual void processAxis(QVector<double>& axis);
+    virtual void processFrame(int frame, QVector<double>& y);
+    virtual void processJob(SpectrumJob& job);
+
+private:
+    QString name_;
+};
+
+class CosmicRayStage : public ProcessingStage
+{
+public:
+    explicit CosmicRayStage(const CosmicRayParams& params);
+    bool frameParallel() const override { return false; }
+    void prepare(int frames, int pixels) override;
+    void processJob(SpectrumJob& job) override;
+
+private:
+    CosmicRayFilter filter_;
+    QVector<double> cleaned_;
+};
+
+class DarkSubtractionStage : public ProcessingStage
+{
+public:
+    DarkSubtractionStage(const QVector<double>& dark, const DarkLibrary* library);
+    void begin(const SpectrumJob& job) override;
+    void processFrame(int frame, QVector<double>& y) override;
+
+private:
+    QVector<double> dark_;
+    const DarkLibrary* library_;
+    QVector<double> libraryDark_;
+    const QVector<double>* current_;
+    bool matches_;
+};
+
+class FlatFieldStage : public ProcessingStage
+{
+public:
+    explicit FlatFieldStage(const QVector<double>& flat);
+    void prepare(int frames, int pixels) override;
+    void processFrame(int frame, QVector<double>& y) override;
+
+private:
+    QVector<double> gain_;
+    bool matches_;
+};
+
+class BinningStage : public ProcessingStage
+{
+public:
+    explicit BinningStage(int factor);
+    void prepare(int frames, int pixels) override;
+    void processAxis(QVector<double>& axis) override;
+    void processFrame(int frame, QVector<double>& y) override;
+
+private:
+    static void bin(const QVector<double>& in, QVector<double>& out, int factor, double scale);
+
+    int factor_;
+    QVector<double> axisBuffer_;
+    QVector<QVector<double> > buffers_;
+};
+
+class CalibrationStage : public ProcessingStage
+{
+public:
+    explicit CalibrationStage(const QVector<double>& coefficients);
+    void processAxis(QVector<double>& axis) override;
+
+private:
+    QVector<double> coefficients_;
+};
+
+class SmoothingStage : public ProcessingStage
+{
+public:
+    explicit SmoothingStage(int halfWidth);
+    void prepare(int frames, int pixels) override;
+    void processFrame(int frame, QVector<double>& y) override;
+
+private:
+    int halfWidth_;
+    QVector<QVector<double> > buffers_;
+};
+
+class ProcessingChain
+{
+public:
+    explicit ProcessingChain(int threads = 0);
+    ProcessingChain(const ProcessingChain&) = delete;
+    ProcessingChain& operator=(const ProcessingChain&) = delete;
+    ~ProcessingChain();
+
+    static std::unique_ptr<ProcessingChain> fromParams(const ProcessingParams& params,
+                                                       const QVector<double>& dark,
+                                                       const QVector<double>& flat,
+                                                       const DarkLibrary* darkLibrary = nullptr);
+
+    void addStage(std::unique_ptr<ProcessingStage> stage);
+    bool isEmpty() const { return stages_.empty(); }
+    void process(SpectrumJob& job);
+    const QVector<StageTiming>& timings() const { return timings_; }
+
+private:
+    void runFrames(ProcessingStage* stage, SpectrumJob& job);
+
+    std::vector<std::unique_ptr<ProcessingStage> > stages_;
+    std::vector<int> shapes_;  // frames and pixels at the input of each stage
+    QVector<StageTiming> timings_;
+    std::unique_ptr<QThreadPool> pool_;
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_SPECTRUMPROCESSING_H_
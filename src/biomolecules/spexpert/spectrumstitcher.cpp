@@ -0,0 +1,194 @@
+#include "spectrumstitcher.h"
+
+#include <algorithm>
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+/*!
+   \class SpectrumStitcher
+   \brief Joins the windows of the extended range experiment into one composite
+   spectrum as they are acquired.
+
+   The pixels of the window are mapped to the spectral axis linearly around its
+   grating position, x = position + StitchParams::dispersion * (pixel - center).
+   The window is scaled to the composite by the least squares factor computed
+   in their overlap, where both are then cross-faded, so there is no step at the
+   edges of the overlap. The first window sets the intensity scale.
+
+   When a window which is already part of the composite arrives again, e.g. at
+   the next temperature, a new composite is started. add() returns true once
+   all the windows are joined. The buffers are reused, so the stitcher stops
+   allocating after the first full composite.
+ */
+
+SpectrumStitcher::SpectrumStitcher(const StitchParams& params)
+    : params_(params),
+      last_scale_(1.0)
+{}
+
+
+void SpectrumStitcher::reset()
+{
+    included_.fill(false);
+    x_.resize(0);
+    y_.resize(0);
+    last_scale_ = 1.0;
+}
+
+
+/*!
+   \brief Merges the window number \a window of \a windows acquired at the
+   grating \a position into the composite.
+   \return true if the composite contains all the windows.
+ */
+bool SpectrumStitcher::add(int window, int windows, double position, const QVector<double>& axis,
+                           const QVector<double>& y)
+{
+    if (window < 0 || window >= windows || axis.size() != y.size() || y.isEmpty()) {
+        return false;
+    }
+    if (included_.size() != windows) {
+        included_.resize(windows);
+        reset();
+    } else if (included_.at(window)) {
+        reset();
+    }
+
+    mapWindow(position, axis, y);
+    if (x_.isEmpty()) {
+        x_ = window_x_;
+        y_ = window_y_;
+        last_scale_ = 1.0;
+    } else {
+        last_scale_ = scale();
+        merge(last_scale_);
+        x_.swap(merged_x_);
+        y_.swap(merged_y_);
+    }
+    included_[window] = true;
+    return !included_.contains(false);
+}
+
+
+void SpectrumStitcher::mapWindow(double position, const QVector<double>& axis, const QVector<double>& y)
+{
+    const int n = axis.size();
+    const double center = (params_.centerPixel < 0.0) ? 0.5 * (axis.first() + axis.last()) : params_.centerPixel;
+    window_x_.resize(n);
+    window_y_.resize(n);
+    // the composite is kept ascending
+    const bool reverse = (params_.dispersion < 0.0);
+    for (int ii = 0; ii < n; ++ii) {
+        const int jj = reverse ? n - 1 - ii : ii;
+        window_x_[ii] = position + params_.dispersion * (axis.at(jj) - center);
+        window_y_[ii] = y.at(jj);
+    }
+}
+
+
+double SpectrumStitcher::interpolate(double x) const
+{
+    const double* begin = x_.constData();
+    const double* end = begin + x_.size();
+    const double* it = std::lower_bound(begin, end, x);
+    if (it == begin) {
+        return y_.first();
+    }
+    if (it == end) {
+        return y_.last();
+    }
+    const int hi = static_cast<int>(it - begin);
+    const int lo = hi - 1;
+    const double t = (x - x_.at(lo)) / (x_.at(hi) - x_.at(lo));
+    return y_.at(lo) + t * (y_.at(hi) - y_.at(lo));
+}
+
+
+/*!
+   \brief Least squares factor which scales the window to the composite in
+   their overlap, 1 if the overlap is too small.
+ */
+double SpectrumStitcher::scale() const
+{
+    const double lo = std::max(x_.first(), window_x_.first());
+    const double hi = std::min(x_.last(), window_x_.last());
+    double numerator = 0.0;
+    double denominator = 0.0;
+    int count = 0;
+    for (int ii = 0; ii < window_x_.size(); ++ii) {
+        const double x = window_x_.at(ii);
+        if (x < lo || x > hi) {
+            continue;
+        }
+        const double w = window_y_.at(ii);
+        numerator += interpolate(x) * w;
+        denominator += w * w;
+        ++count;
+    }
+    if (count < 3 || denominator <= 0.0 || numerator <= 0.0) {
+        return 1.0;
+    }
+    return numerator / denominator;
+}
+
+
+void SpectrumStitcher::merge(double scale)
+{
+    const double lo = std::max(x_.first(), window_x_.first());
+    const double hi = std::min(x_.last(), window_x_.last());
+    const bool lower = window_x_.first() < x_.first();
+    const bool upper = window_x_.last() > x_.last();
+    merged_x_.resize(0);
+    merged_y_.resize(0);
+
+    int cc = 0;
+    int ww = 0;
+    const int c_n = x_.size();
+    const int w_n = window_x_.size();
+    // below the overlap only one of them has points
+    while (cc < c_n && x_.at(cc) < lo) {
+        merged_x_.append(x_.at(cc));
+        merged_y_.append(y_.at(cc));
+        ++cc;
+    }
+    while (ww < w_n && window_x_.at(ww) < lo) {
+        merged_x_.append(window_x_.at(ww));
+        merged_y_.append(scale * window_y_.at(ww));
+        ++ww;
+    }
+    // in the overlap the window grid is kept and cross-faded with the composite
+    while (cc < c_n && x_.at(cc) <= hi) {
+        ++cc;
+    }
+    while (ww < w_n && window_x_.at(ww) <= hi) {
+        const double x = window_x_.at(ww);
+        double t;
+        if (lower == upper) {
+            t = upper ? 1.0 : 0.5;
+        } else if (hi > lo) {
+            t = upper ? (x - lo) / (hi - lo) : (hi - x) / (hi - lo);
+        } else {
+            t = 0.5;
+        }
+        merged_x_.append(x);
+        merged_y_.append((1.0 - t) * interpolate(x) + t * scale * window_y_.at(ww));
+        ++ww;
+    }
+    // above the overlap only one of them has points again
+    while (cc < c_n) {
+        merged_x_.append(x_.at(cc));
+        merged_y_.append(y_.at(cc));
+        ++cc;
+    }
+    while (ww < w_n) {
+        merged_x_.append(window_x_.at(ww));
+        merged_y_.append(scale * window_y_.at(ww));
+        ++ww;
+    }
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
@@ -0,0 +1,51 @@
+#ifndef BIOMOLECULES_SPEXPERT_SPECTRUMSTITCHER_H_
+#define BIOMOLECULES_SPEXPERT_SPECTRUMSTITCHER_H_
+
+#include <QVector>
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+struct StitchParams
+{
+    bool enabled;
+    double dispersion;    // spectral axis units per pixel, negative for the descending axis
+    double centerPixel;   // pixel at the grating position, negative means the middle
+    bool saveComposite;   // save the finished composite next to the last window
+};
+
+class SpectrumStitcher
+{
+public:
+    explicit SpectrumStitcher(const StitchParams& params);
+
+    void reset();
+    bool add(int window, int windows, double position, const QVector<double>& axis, const QVector<double>& y);
+    const QVector<double>& x() const { return x_; }
+    const QVector<double>& y() const { return y_; }
+    double lastScale() const { return last_scale_; }
+
+private:
+    void mapWindow(double position, const QVector<double>& axis, const QVector<double>& y);
+    double interpolate(double x) const;
+    double scale() const;
+    void merge(double scale);
+
+    StitchParams params_;
+    QVector<bool> included_;
+    QVector<double> x_;
+    QVector<double> y_;
+    QVector<double> window_x_;
+    QVector<double> window_y_;
+    QVector<double> merged_x_;
+    QVector<double> merged_y_;
+    double last_scale_;
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_SPECTRUMSTITCHER_H_
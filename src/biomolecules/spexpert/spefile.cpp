@@ -0,0 +1,360 @@
+#include "spefile.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+#include <QWaitCondition>
+#include <QtEndian>
+
+#include <QDebug>
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+namespace {
+
+// offsets of the used fields of the WinSpec 2.x header
+const int kHeaderSize = 4100;
+const int kXDimDet = 6;         // WORD
+const int kExposure = 10;       // float, seconds
+const int kYDimDet = 18;        // WORD
+const int kDate = 20;           // char[10], "ddMMMyyyy"
+const int kXDim = 42;           // WORD
+const int kDataType = 108;      // short
+const int kYDim = 656;          // WORD
+const int kAccumulations = 668; // long, lavgexp
+const int kNumFrames = 1446;    // long
+const int kHeaderVersion = 1992;  // float
+const int kWinViewId = 2996;    // long
+const int kLastValue = 4098;    // short
+
+const qint32 kWinViewIdValue = 0x01234567;
+const qint16 kLastValueValue = 0x5555;
+
+enum DataType {
+    Float = 0,
+    Long = 1,
+    Short = 2,
+    UnsignedShort = 3
+};
+
+int dataSize(int type)
+{
+    switch (type) {
+    case Float:
+    case Long:
+        return 4;
+    case Short:
+    case UnsignedShort:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+template<typename T>
+void put(QByteArray& data, int offset, T value)
+{
+    qToLittleEndian<T>(value, reinterpret_cast<uchar*>(data.data() + offset));
+}
+
+void putFloat(QByteArray& data, int offset, float value)
+{
+    quint32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put<quint32>(data, offset, bits);
+}
+
+float getFloat(const uchar* data)
+{
+    quint32 bits = qFromLittleEndian<quint32>(data);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// the smallest type the counts fit in without loss
+int chooseDataType(const QVariantList& raw)
+{
+    int type = UnsignedShort;
+    for (const QVariant& value : raw) {
+        double count = value.toDouble();
+        if (count != std::floor(count) || count < std::numeric_limits<qint32>::min()
+                || count > std::numeric_limits<qint32>::max()) {
+            return Float;
+        }
+        if (count < 0 || count > std::numeric_limits<quint16>::max()) {
+            type = Long;
+        }
+    }
+    return type;
+}
+
+}  // namespace
+
+
+/*!
+   \class SpeFile
+   \brief Writes and reads the WinSpec SPE files without WinSpec.
+
+   Only the header fields spexpert knows are filled, the dimensions, the
+   exposure, the number of accumulations and frames and the data type, the
+   rest of the 4100 bytes long header is zero. The data are stored as unsigned
+   16 bit integers if all the counts fit, 32 bit integers or floats otherwise.
+
+   The data passed to write() and returned by read() are ordered as from
+   WinSpec::getRawSpectrum(), where the rows of the pixel are neighbours, while
+   the SPE file stores the rows one after another.
+ */
+
+bool SpeFile::write(const QString& file_name, const QVariantList& raw, const SpeHeader& header)
+{
+    const int n = header.frames * header.x * header.y;
+    if (header.frames < 1 || header.x < 1 || header.y < 1 || header.x > 0xffff || header.y > 0xffff
+            || raw.size() != n) {
+        return false;
+    }
+    const int type = chooseDataType(raw);
+    const int size = dataSize(type);
+    QByteArray data(kHeaderSize + n * size, '\0');
+
+    put<quint16>(data, kXDimDet, static_cast<quint16>(header.x));
+    putFloat(data, kExposure, static_cast<float>(header.exposure));
+    put<quint16>(data, kYDimDet, static_cast<quint16>(header.y));
+    QByteArray date = QDateTime::currentDateTime().toString("ddMMMyyyy").toLatin1().left(9);
+    std::memcpy(data.data() + kDate, date.constData(), date.size());
+    put<quint16>(data, kXDim, static_cast<quint16>(header.x));
+    put<qint16>(data, kDataType, static_cast<qint16>(type));
+    put<quint16>(data, kYDim, static_cast<quint16>(header.y));
+    put<qint32>(data, kAccumulations, header.accumulations);
+    put<qint32>(data, kNumFrames, header.frames);
+    putFloat(data, kHeaderVersion, 2.5f);
+    put<qint32>(data, kWinViewId, kWinViewIdValue);
+    put<qint16>(data, kLastValue, kLastValueValue);
+
+    uchar* out = reinterpret_cast<uchar*>(data.data() + kHeaderSize);
+    const int frame_size = header.x * header.y;
+    for (int frame = 0; frame < header.frames; ++frame) {
+        for (int row = 0; row < header.y; ++row) {
+            for (int ii = 0; ii < header.x; ++ii, out += size) {
+                const QVariant& value = raw.at(frame * frame_size + ii * header.y + row);
+                switch (type) {
+                case UnsignedShort:
+                    qToLittleEndian<quint16>(static_cast<quint16>(value.toInt()), out);
+                    break;
+                case Long:
+                    qToLittleEndian<qint32>(static_cast<qint32>(value.toLongLong()), out);
+                    break;
+                default: {
+                    float count = static_cast<float>(value.toDouble());
+                    quint32 bits;
+                    std::memcpy(&bits, &count, sizeof(bits));
+                    qToLittleEndian<quint32>(bits, out);
+                    break;
+                }
+                }
+            }
+        }
+    }
+
+    QSaveFile file{file_name};
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "SpeFile::write(): can not open" << file_name;
+        return false;
+    }
+    if (file.write(data) != data.size()) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+
+/*!
+   \brief Reads the SPE file \a file_name through the memory mapping.
+   \return false if it is not an SPE file of a known data type.
+ */
+bool SpeFile::read(const QString& file_name, QVariantList& raw, SpeHeader* header)
+{
+    QFile file{file_name};
+    if (!file.open(QIODevice::ReadOnly) || file.size() < kHeaderSize) {
+        return false;
+    }
+    const qint64 file_size = file.size();
+    const uchar* data = file.map(0, file_size);
+    if (!data) {
+        return false;
+    }
+
+    SpeHeader h;
+    h.x = qFromLittleEndian<quint16>(data + kXDim);
+    h.y = qFromLittleEndian<quint16>(data + kYDim);
+    h.frames = qFromLittleEndian<qint32>(data + kNumFrames);
+    h.exposure = getFloat(data + kExposure);
+    h.accumulations = qFromLittleEndian<qint32>(data + kAccumulations);
+    const int type = qFromLittleEndian<qint16>(data + kDataType);
+    const int size = dataSize(type);
+    const qint64 n = static_cast<qint64>(h.frames) * h.x * h.y;
+    if (size == 0 || h.frames < 1 || h.x < 1 || h.y < 1 || kHeaderSize + n * size > file_size) {
+        file.unmap(const_cast<uchar*>(data));
+        return false;
+    }
+
+    raw.clear();
+    raw.reserve(static_cast<int>(n));
+    const int frame_size = h.x * h.y;
+    for (int frame = 0; frame < h.frames; ++frame) {
+        const uchar* frame_data = data + kHeaderSize + static_cast<qint64>(frame) * frame_size * size;
+        for (int ii = 0; ii < h.x; ++ii) {
+            for (int row = 0; row < h.y; ++row) {
+                const uchar* in = frame_data + (row * h.x + ii) * size;
+                switch (type) {
+                case Float:
+                    raw.append(static_cast<double>(getFloat(in)));
+                    break;
+                case Long:
+                    raw.append(qFromLittleEndian<qint32>(in));
+                    break;
+                case Short:
+                    raw.append(qFromLittleEndian<qint16>(in));
+                    break;
+                default:
+                    raw.append(qFromLittleEndian<quint16>(in));
+                    break;
+                }
+            }
+        }
+    }
+    file.unmap(const_cast<uchar*>(data));
+    if (header) {
+        *header = h;
+    }
+    return true;
+}
+
+
+/*!
+   \class SpeWriter
+   \brief Writes the SPE files by SpeFile on its own thread.
+
+   write() only enqueues the data, which are implicitly shared, so neither the
+   WinSpec nor the task threads wait for the disk. flush() blocks until all the
+   enqueued files are written, failed() counts the files which could not be.
+ */
+
+class SpeWriter::Worker : public QThread
+{
+public:
+    explicit Worker(SpeWriter* writer) : writer_{writer} {}
+
+protected:
+    void run() override { writer_->run(); }
+
+private:
+    SpeWriter* writer_;
+};
+
+
+SpeWriter::SpeWriter()
+    : busy_{0},
+      failed_{0},
+      quit_{false},
+      mutex_{new QMutex},
+      not_empty_{new QWaitCondition},
+      idle_{new QWaitCondition},
+      worker_{new Worker{this}}
+{
+    worker_->start();
+}
+
+
+/*!
+   \brief Writes the files still in the queue and stops the thread.
+ */
+SpeWriter::~SpeWriter()
+{
+    {
+        QMutexLocker locker{mutex_.get()};
+        quit_ = true;
+        not_empty_->wakeAll();
+    }
+    worker_->wait();
+}
+
+
+void SpeWriter::write(const QString& file_name, const QVariantList& raw, const SpeHeader& header)
+{
+    QMutexLocker locker{mutex_.get()};
+    queue_.enqueue(Job{file_name, raw, header});
+    not_empty_->wakeOne();
+}
+
+
+void SpeWriter::flush()
+{
+    QMutexLocker locker{mutex_.get()};
+    while (!queue_.isEmpty() || busy_) {
+        idle_->wait(mutex_.get());
+    }
+}
+
+
+int SpeWriter::pending() const
+{
+    QMutexLocker locker{mutex_.get()};
+    return queue_.size() + busy_;
+}
+
+
+int SpeWriter::failed() const
+{
+    QMutexLocker locker{mutex_.get()};
+    return failed_;
+}
+
+
+void SpeWriter::run()
+{
+    forever {
+        Job job;
+        {
+            QMutexLocker locker{mutex_.get()};
+            while (queue_.isEmpty() && !quit_) {
+                not_empty_->wait(mutex_.get());
+            }
+            if (queue_.isEmpty()) {
+                return;
+            }
+            job = queue_.dequeue();
+            busy_ = 1;
+        }
+
+        bool written = SpeFile::write(job.file_name, job.raw, job.header);
+        if (!written) {
+            qDebug() << "SpeWriter::run(): can not write" << job.file_name;
+        }
+
+        QMutexLocker locker{mutex_.get()};
+        if (!written) {
+            ++failed_;
+        }
+        busy_ = 0;
+        if (queue_.isEmpty()) {
+            idle_->wakeAll();
+        }
+    }
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
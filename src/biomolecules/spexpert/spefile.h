@@ -0,0 +1,76 @@
+#ifndef BIOMOLECULES_SPEXPERT_SPEFILE_H_
+#define BIOMOLECULES_SPEXPERT_SPEFILE_H_
+
+#include <memory>
+
+#include <QQueue>
+#include <QString>
+#include <QVariantList>
+
+
+// forward declarations
+class QMutex;
+class QThread;
+class QWaitCondition;
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+struct SpeHeader
+{
+    int frames;
+    int x;
+    int y;
+    double exposure;
+    int accumulations;
+};
+
+class SpeFile
+{
+public:
+    static bool write(const QString& file_name, const QVariantList& raw, const SpeHeader& header);
+    static bool read(const QString& file_name, QVariantList& raw, SpeHeader* header);
+};
+
+class SpeWriter
+{
+public:
+    SpeWriter();
+    SpeWriter(const SpeWriter&) = delete;
+    SpeWriter& operator=(const SpeWriter&) = delete;
+    ~SpeWriter();
+
+    void write(const QString& file_name, const QVariantList& raw, const SpeHeader& header);
+    void flush();
+    int pending() const;
+    int failed() const;
+
+private:
+    class Worker;
+
+    struct Job
+    {
+        QString file_name;
+        QVariantList raw;
+        SpeHeader header;
+    };
+
+    void run();
+
+    QQueue<Job> queue_;
+    int busy_;
+    int failed_;
+    bool quit_;
+    std::unique_ptr<QMutex> mutex_;
+    std::unique_ptr<QWaitCondition> not_empty_;
+    std::unique_ptr<QWaitCondition> idle_;
+    std::unique_ptr<QThread> worker_;
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_SPEFILE_H_
@@ -4,19 +4,27 @@
 #include "usmcvb_com.h"
 #endif // SPEXPERT_MOCK_CALIBRATION_STAGE
 
+#include "devicethread.h"
+
 #include <QString>
 #include <QMutex>
 #include <QMutexLocker>
 
+// the controller is created, called and destroyed only in the device thread,
+// motorRunning() reads the snapshot polled while the motor runs
 StageControl::StageControl(QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    device_(new biomolecules::spexpert::core::DeviceThread("StageControl"))
 {
+    device_->invoke([this] {
 #ifndef SPEXPERT_MOCK_CALIBRATION_STAGE
-    usmcvb = new USMCVB_COM::USMCVB_COM;
+        usmcvb = new USMCVB_COM::USMCVB_COM;
 #else // SPEXPERT_MOCK_CALIBRATION_STAGE
-    usmcvb = new VirtualStageControl;
+        usmcvb = new VirtualStageControl;
 #endif // SPEXPERT_MOCK_CALIBRATION_STAGE
+    });
     blConnected_ = false;
+    blMotorRunning_ = false;
     blInitialized_ = false;
     stageRange_ = defaultStageRange;
     iLowerLim_ = 0;
@@ -25,25 +33,23 @@ StageControl::StageControl(QObject *parent) :
     iMeasPos_ = 0;
     iCalPos_ = 0;
     mutex_ = new QMutex;
+    device_->setPoll([this] { pollMotion(); }, 100);
 }
 
 bool StageControl::motorRunning() const
 {
-    bool blMotorRunning = false;
-    if (blConnected_)
-    {
-        QMutexLocker locker(mutex_);
-        usmcvb->motorRunning(blMotorRunning);
-    }
-    return blMotorRunning;
+    QMutexLocker locker(mutex_);
+    return blConnected_ && blMotorRunning_;
 }
 
 bool StageControl::connect(QString &strErrMsg)
 {
     QMutexLocker locker(mutex_);
     blConnected_ = false;
+    locker.unlock();
     bool blConnected;
-    int ok = usmcvb->connect_2(strErrMsg, blConnected);
+    int ok = device_->invoke([&] { return usmcvb->connect_2(strErrMsg, blConnected); });
+    locker.relock();
     if (!ok)
     {
         blConnected_ = true;
@@ -58,70 +64,74 @@ bool StageControl::connect(QString &strErrMsg)
 
 bool StageControl::powerOn()
 {
-    bool isPoweredOff;
-    QMutexLocker locker(mutex_);
-    usmcvb->isPoweredOff(isPoweredOff);
-    if (isPoweredOff)
-        return !usmcvb->powerOn();
-    else
-        return false;
+    return device_->invoke([this] {
+        bool isPoweredOff;
+        usmcvb->isPoweredOff(isPoweredOff);
+        if (isPoweredOff)
+            return !usmcvb->powerOn();
+        else
+            return false;
+    });
 }
 
 bool StageControl::powerOff()
 {
-    bool isPoweredOff;
-    QMutexLocker locker(mutex_);
-    usmcvb->isPoweredOff(isPoweredOff);
-    if (!isPoweredOff)
-        return !usmcvb->powerOff();
-    else
-        return false;
+    return device_->invoke([this] {
+        bool isPoweredOff;
+        usmcvb->isPoweredOff(isPoweredOff);
+        if (!isPoweredOff)
+            return !usmcvb->powerOff();
+        else
+            return false;
+    });
 }
 
 bool StageControl::run(int dest, StageControlTraits::ReferenceType ref)
 {
-    bool blErr = true;
+    QMutexLocker locker(mutex_);
+    int pos = dest;
     switch (ref)
     {
     case StageControlTraits::ReferenceType::Absolute :
-        blErr = run(dest);
         break;
     case StageControlTraits::ReferenceType::LowerLimit :
-        blErr = run(dest + iLowerLim_);
+        pos = dest + iLowerLim_;
         break;
     case StageControlTraits::ReferenceType::UpperLimit :
-        blErr = run(iUpperLim_ - dest);
+        pos = iUpperLim_ - dest;
         break;
     }
-    return !blErr;
+    locker.unlock();
+    return startMotion(pos);
 }
 
 bool StageControl::stop()
 {
-    QMutexLocker locker(mutex_);
-    return !usmcvb->stopMotion();
+    return device_->invoke([this] {
+        bool blStopped = !usmcvb->stopMotion();
+        pollMotion();
+        return blStopped;
+    });
 }
 
 bool StageControl::goToLowerLim()
 {
-    QMutexLocker locker(mutex_);
     int iCurPos;
-    bool blErr = usmcvb->curPos(iCurPos);
+    bool blErr = device_->invoke([&] { return usmcvb->curPos(iCurPos); });
     if (blErr)
         return !blErr;
 
-    return !usmcvb->run(iCurPos - graterThanLimit);
+    return startMotion(iCurPos - graterThanLimit);
 }
 
 bool StageControl::goToUpperLim()
 {
-    QMutexLocker locker(mutex_);
     int iCurPos;
-    bool blErr = usmcvb->curPos(iCurPos);
+    bool blErr = device_->invoke([&] { return usmcvb->curPos(iCurPos); });
     if (blErr)
         return !blErr;
 
-    return !usmcvb->run(iCurPos + graterThanLimit);
+    return startMotion(iCurPos + graterThanLimit);
 }
 
 bool StageControl::goToMeas()
@@ -140,7 +150,8 @@ bool StageControl::goToMeas()
         pos = iUpperLim_ - iMeasPos_;
         break;
     }
-    return !usmcvb->run(pos);
+    locker.unlock();
+    return startMotion(pos);
 //    return !usmcvb->run(iMeasPos_);
 }
 
@@ -160,7 +171,8 @@ bool StageControl::goToCal()
         pos = iUpperLim_ - iCalPos_;
         break;
     }
-    return !usmcvb->run(pos);
+    locker.unlock();
+    return startMotion(pos);
 //    return !usmcvb->run(iCalPos_);
 }
 
@@ -291,10 +303,10 @@ int StageControl::upperLim(StageControlTraits::ReferenceType ref) const
 
 int StageControl::curPos(StageControlTraits::ReferenceType ref)
 {
-    QMutexLocker locker(mutex_);
     int cp;
     bool cpchanged = false;
-    usmcvb->curPos(cp);
+    device_->invoke([&] { usmcvb->curPos(cp); });
+    QMutexLocker locker(mutex_);
     if (cp != iCurPos_) {
         cpchanged = true;
         iCurPos_ = cp;
@@ -321,9 +333,39 @@ int StageControl::curPos(StageControlTraits::ReferenceType ref)
     return rv;
 }
 
+// starts the motion in the device thread and marks the motor running
+bool StageControl::startMotion(int dest)
+{
+    return device_->invoke([this, dest] {
+        bool blStarted = !usmcvb->run(dest);
+        if (blStarted) {
+            QMutexLocker locker(mutex_);
+            blMotorRunning_ = true;
+        }
+        return blStarted;
+    });
+}
+
+// called in the device thread, asks the controller only while the snapshot
+// says the motor runs
+void StageControl::pollMotion()
+{
+    QMutexLocker locker(mutex_);
+    if (!blConnected_ || !blMotorRunning_)
+        return;
+    locker.unlock();
+
+    bool blMotorRunning = false;
+    usmcvb->motorRunning(blMotorRunning);
+
+    locker.relock();
+    blMotorRunning_ = blMotorRunning;
+}
+
 StageControl::~StageControl()
 {
-    delete usmcvb;
+    device_->invoke([this] { delete usmcvb; });
+    device_.reset();
     delete mutex_;
 }
 
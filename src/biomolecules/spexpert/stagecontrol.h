@@ -1,11 +1,20 @@
 #ifndef STAGECONTROL_H
 #define STAGECONTROL_H
 
+#include <memory>
+
 #include <QObject>
 
 // forwar declarations
 class QString;
 class QMutex;
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+class DeviceThread;
+}
+}
+}
 #ifdef SPEXPERT_MOCK_CALIBRATION_STAGE
 class VirtualStageControl;
 
@@ -116,6 +125,8 @@ signals:
     void currPosChanged(int lim);
 
 private:
+    bool startMotion(int dest);
+    void pollMotion();
 
 #ifndef SPEXPERT_MOCK_CALIBRATION_STAGE
     USMCVB_COM::USMCVB_COM * usmcvb;
@@ -124,6 +135,7 @@ private:
 #endif // SPEXPERT_MOCK_CALIBRATION_STAGE
 
     bool blConnected_;
+    bool blMotorRunning_; // snapshot polled by the device thread
     bool blInitialized_;
     int stageRange_;
     int iLowerLim_;
@@ -136,6 +148,7 @@ private:
     StageControlTraits::ReferenceType calPosRef;
 
     QMutex * mutex_;
+    std::unique_ptr<biomolecules::spexpert::core::DeviceThread> device_;
 };
 
 // usmcvb controller simulation
@@ -0,0 +1,110 @@
+// Checks the signal-to-noise ratio estimated by AdaptiveAccumulation from
+// the readouts of a running acquisition. WinSpec reads out the running sum of
+// the accumulations, so each readout holds all the accumulations done so far.
+
+#include "adaptiveaccumulation.h"
+
+#include <QVariantList>
+
+#include <cmath>
+#include <iostream>
+#include <random>
+
+using biomolecules::spexpert::core::AdaptiveAccumulation;
+using biomolecules::spexpert::core::AdaptiveAccumulationParams;
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+const int pixelsN = 11;           // the first pixel is dark
+const double pixelSignal = 100.0; // counts of one accumulation
+const double pixelNoise = 5.0;    // standard deviation of one accumulation
+
+AdaptiveAccumulationParams params()
+{
+    AdaptiveAccumulationParams params;
+    params.enabled = true;
+    params.targetSnr = 5000.0;
+    params.maxTime = 0.0;
+    params.minAccums = 2;
+    params.regionFrom = 0;
+    params.regionTo = -1;
+    return params;
+}
+
+// the signal of the region above the dark pixel and its noise
+double expectedSnr(int accums)
+{
+    double mean = pixelSignal * (pixelsN - 1);
+    double sigma = pixelNoise * std::sqrt(static_cast<double>(pixelsN - 1));
+    return mean * std::sqrt(static_cast<double>(accums)) / sigma;
+}
+
+QVariantList readout(const QVector<double> &sums)
+{
+    QVariantList frame;
+    for (double sum : sums) {
+        frame.append(sum);
+    }
+    return frame;
+}
+
+} // unnamed namespace
+
+int main()
+{
+    std::mt19937 generator(7);
+    std::normal_distribution<double> noise(0.0, pixelNoise);
+    std::uniform_int_distribution<int> step(1, 3);
+
+    AdaptiveAccumulation adaptive(params());
+    QVector<double> sums(pixelsN, 0.0);
+    int accums = 0;
+    while (accums < 300) {
+        // the readouts come at irregular counts of new accumulations
+        int newAccums = step(generator);
+        for (int ii = 0; ii < newAccums; ++ii) {
+            for (int pixel = 1; pixel < pixelsN; ++pixel) {
+                sums[pixel] += pixelSignal + noise(generator);
+            }
+        }
+        accums += newAccums;
+        check(adaptive.add(readout(sums), pixelsN, 1, accums), "cumulative readout added");
+    }
+
+    double snr = adaptive.snr(accums);
+    double expected = expectedSnr(accums);
+    check(snr > 0.8 * expected && snr < 1.2 * expected,
+          "SNR of the cumulative readouts matches the one of the accumulations");
+    check(!adaptive.targetReached(accums), "target above the SNR is not reached");
+    check(!adaptive.add(readout(sums), pixelsN, 1, accums), "readout without new accumulations is skipped");
+    check(!adaptive.add(readout(sums), pixelsN + 1, 1, accums + 1), "frame of a different size is skipped");
+
+    // the noiseless readouts can not bound the SNR
+    adaptive.reset();
+    check(adaptive.snr(1) == 0.0, "no SNR after reset");
+    sums.fill(0.0);
+    for (int accum = 1; accum <= 3; ++accum) {
+        for (int pixel = 1; pixel < pixelsN; ++pixel) {
+            sums[pixel] += pixelSignal;
+        }
+        adaptive.add(readout(sums), pixelsN, 1, accum);
+    }
+    check(std::isinf(adaptive.snr(3)), "noiseless readouts");
+    check(adaptive.targetReached(3), "noiseless readouts reach the target");
+
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
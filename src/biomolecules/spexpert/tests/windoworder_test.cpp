@@ -0,0 +1,81 @@
+// Checks where the extended range temperature series leaves the grating and
+// the experiment number. WholeTExpList, BatchExpList and WholeBatchExpList
+// take the final calibration in SeriesEnd::window and BatchExpList shifts the
+// experiment number by SeriesEnd::backShift to the next spectrum of the batch.
+
+#include "windoworder.h"
+
+#include <iostream>
+
+using biomolecules::spexpert::core::SeriesEnd;
+using biomolecules::spexpert::core::WindowOrder;
+using biomolecules::spexpert::core::lastTStep;
+using biomolecules::spexpert::core::seriesEnd;
+using biomolecules::spexpert::core::windowOrder;
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+// the batch spectrum b is measured in the window w with the experiment number
+// b + w * n, the next spectrum starts in the first window
+void checkNextBatchSpectrum(const SeriesEnd &end, int n, const char *what)
+{
+    int batchSpectrum = 3;
+    int expNumber = batchSpectrum + end.window * n;
+    check(expNumber + end.backShift + 1 == batchSpectrum + 1, what);
+}
+
+} // unnamed namespace
+
+int main()
+{
+    check(windowOrder(false, 1) == WindowOrder::Cyclic, "cyclic order without serpentine");
+    check(windowOrder(true, 0) == WindowOrder::Ascending, "even temperature ascends");
+    check(windowOrder(true, 3) == WindowOrder::Descending, "odd temperature descends");
+    check(lastTStep(4, false) == 3, "last step of the series");
+    check(lastTStep(4, true) == 6, "last step of the loop");
+
+    // 2 temperatures, the second walks the windows backwards
+    SeriesEnd end = seriesEnd(4, 1, 2, false, true);
+    check(end.window == 0 && end.backShift == 0, "WholeTExpList ends descending in the first window");
+
+    // batch of 5 spectra, 3 windows, 4 temperatures, the last one descending
+    end = seriesEnd(3, 5, 4, false, true);
+    check(end.window == 0 && end.backShift == 0, "BatchExpList ends descending in the first window");
+    checkNextBatchSpectrum(end, 5, "BatchExpList continues from the first window after descending pass");
+
+    // the last spectrum of the batch measured by WholeBatchExpList
+    end = seriesEnd(3, 5, 2, false, true);
+    check(end.window == 0, "WholeBatchExpList takes the final calibration in the first window");
+
+    // ascending ends in the last window
+    end = seriesEnd(3, 5, 3, false, true);
+    check(end.window == 2 && end.backShift == -10, "serpentine ending ascending");
+    checkNextBatchSpectrum(end, 5, "BatchExpList continues from the last window after ascending pass");
+
+    // the loop measures 2 * 3 - 1 temperatures, the last step is even
+    end = seriesEnd(3, 10, 3, true, true);
+    check(end.window == 2 && end.backShift == -20, "serpentine loop ends ascending");
+    checkNextBatchSpectrum(end, 10, "BatchExpList continues after the loop");
+
+    end = seriesEnd(3, 5, 2, false, false);
+    check(end.window == 2 && end.backShift == -10, "cyclic order ends in the last window");
+
+    end = seriesEnd(3, 1, 1, false, true);
+    check(end.window == 2 && end.backShift == -2, "single temperature ends in the last window");
+
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,8 +1,5 @@
 #include "waittask.h"
 
-#include <QMutex>
-#include <QMutexLocker>
-
 /*!
    \class WaitTask
    \brief Abstract class which forms the base for task usable with
@@ -26,11 +23,8 @@
    \param parent Parent in Qt's ownership system.
  */
 WaitTask::WaitTask(QObject *parent) :
-    QObject(parent), id_(0), initDelay_(0)
+    QObject(parent), id_(0), initDelay_(0), blDelayedDelete_(false), handled_(false)
 {
-    delayedDeleteMutex = new QMutex;
-    blDelayedDelete_ = false;
-
 }
 
 /*!
@@ -50,7 +44,6 @@ WaitTask::WaitTask(QObject *parent) :
  */
 bool WaitTask::delayedDelete() const
 {
-    QMutexLocker locker(delayedDeleteMutex);
     return blDelayedDelete_;
 }
 
@@ -77,7 +70,6 @@ bool WaitTask::delayedDelete() const
  */
 void WaitTask::setDelayedDelete(bool blDelayedDelete)
 {
-    QMutexLocker locker(delayedDeleteMutex);
     blDelayedDelete_ = blDelayedDelete;
 }
 
@@ -124,7 +116,6 @@ void WaitTask::setDelayedDelete(bool blDelayedDelete)
  */
 WaitTask::~WaitTask()
 {
-    delete delayedDeleteMutex;
 }
 
 // private variables
@@ -137,9 +128,8 @@ WaitTask::~WaitTask()
        WaitTask is proceeded.
    \var WaitTask::blDelayedDelete_
        \brief true if the WaitTask should not be deleted immediatelly after it
-       finishes.
-   \var WaitTask::delayedDeleteMutex
-       \brief mutex which manages thread safety.
+       finishes. It is atomic, because it is read from the WaitWorker's
+       thread, so the WaitTask needs no mutex of its own.
    \var WaitTask::handled_
        \brief true if the WaitTask is handled by some WaitingTask in
        WaitTaskList.
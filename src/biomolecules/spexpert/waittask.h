@@ -1,10 +1,9 @@
 #ifndef WAITTASK_H
 #define WAITTASK_H
 
-#include <QObject>
+#include <atomic>
 
-// forward declarations
-class QMutex;
+#include <QObject>
 
 class WaitTask : public QObject
 {
@@ -41,8 +40,7 @@ private:
     unsigned int id_;
 
     int initDelay_; // initial delay in ms
-    bool blDelayedDelete_;
-    QMutex * delayedDeleteMutex;
+    std::atomic<bool> blDelayedDelete_;
     bool handled_;
 };
 
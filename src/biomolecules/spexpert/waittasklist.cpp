@@ -3,9 +3,61 @@
 #include "waittasks.h"
 
 #include <QMutex>
+#include <QMutexLocker>
 #include <QThread>
 #include <QTimer>
 
+namespace {
+
+// The WaitWorker objects of all the WaitTaskList objects are run in a small
+// pool of long-lived threads instead of one new thread per list, nested lists
+// are built for every calibration cycle. More than one thread keeps a slow
+// WaitTask::finish(), e.g. reading the spectrum, from delaying the others.
+class WaitService
+{
+public:
+    static const int threadsN = 2;
+
+    WaitService() : next_(0)
+    {
+        for (int ii = 0; ii < threadsN; ++ii) {
+            threads_[ii] = new QThread;
+            threads_[ii]->setObjectName(QString("WaitService%1").arg(ii));
+            threads_[ii]->start();
+        }
+    }
+
+    ~WaitService()
+    {
+        for (int ii = 0; ii < threadsN; ++ii) {
+            threads_[ii]->quit();
+            threads_[ii]->wait();
+            delete threads_[ii];
+        }
+    }
+
+    QThread * nextThread()
+    {
+        QMutexLocker locker(&mutex_);
+        QThread * thread = threads_[next_];
+        next_ = (next_ + 1) % threadsN;
+        return thread;
+    }
+
+private:
+    QThread * threads_[threadsN];
+    int next_;
+    QMutex mutex_;
+};
+
+QThread * waitServiceThread()
+{
+    static WaitService waitService;
+    return waitService.nextThread();
+}
+
+} // namespace
+
 /*!
    \namespace WaitTaskListTraits
    \brief Namespace containing WaitTaskList's enums and helper structures
@@ -277,8 +329,9 @@ WaitingTask::~WaitingTask()
    WaitTask objects will be handled by the first encounteder Waiting task in
    the thread with lowest number.
 
-   When, the start() slot is invoked, the underlying QThread and ExpTaskList is
-   started. When the WaitExpTask comes to execution, the
+   When, the start() slot is invoked, the WaitWorker is built in one of the
+   shared wait service threads, if it does not exist yet, and the underlying
+   ExpTaskList is started. When the WaitExpTask comes to execution, the
    WaitTaskList::onStartWaitTask() slot is executed, where the inner WaitTask
    connection to some WaitingTask is controlled and if so, the WaitTask is
    submited to the WaitWorker by emiting WaitTaskList::startWaitTaskInWorker()
@@ -303,8 +356,9 @@ WaitingTask::~WaitingTask()
    as if it is only in the ExpTaskList).
 
    When all ExpTasks are executed, the ExpTaskList's taskListFinished() method
-   is reimplemented to delete the contained thread is deleted (only if the
-   delayedDelete() is false and curTimesExec() is 1 or less).
+   is reimplemented to delete the remaining WaitTask objects (only if the
+   delayedDelete() is false and curTimesExec() is 1 or less). The WaitWorker
+   is kept until the WaitTaskList is destroyed.
 
    The execution can be stopped by the stop() slot.
  */
@@ -316,7 +370,7 @@ WaitingTask::~WaitingTask()
 WaitTaskList::WaitTaskList(QObject *parent) :
     ExpTaskList(parent)
 {
-    thread = nullptr;
+    waitWorker = nullptr;
     blQuit_ = false;
 
     // variables, which are used when the execution is interupted to wait for
@@ -365,7 +419,7 @@ void WaitTaskList::addTask(ExpTaskListTraits::TaskItem tsk)
 
 /*!
    \brief Starts execution of the ExpTask objects in WaitTaskList and builds
-   the new thread, which can execute all WaitTask's which are wrapped in the
+   the WaitWorker, which can execute all WaitTask's which are wrapped in the
    WaitExpTask objects inserted in the WaitTaskList. The execution can be
    stopped by the stop() method. See addTask() for more details.
  */
@@ -374,15 +428,11 @@ void WaitTaskList::start()
     if (!running()) {
         setTaskListFinished(false);
         setWaitWorkerFinished(false);
-        if (thread)
-        {
-            ExpTaskList::start();
-        }
-        else
+        if (!waitWorker)
         {
-            buildThread();
-            ExpTaskList::start();
+            buildWorker();
         }
+        ExpTaskList::start();
     }
 }
 
@@ -393,7 +443,7 @@ void WaitTaskList::stop()
 {
     if (running()) {
         setQuit(true);
-        if (thread) {
+        if (waitWorker) {
             emit stopWorker();
         }
         ExpTaskList::stop();
@@ -442,13 +492,13 @@ void WaitTaskList::onWaitTaskFinished(unsigned int id)
 }
 
 /*!
-   \brief This method is invoked only when the thread was quited by calling
+   \brief This method is invoked only when the waiting was quited by calling
    waitWorker's WaitWorker::stop() method in a reaction to the
    WaitWorker::quitFinished() signal.
 
    The WaitWorker::stop() method is called only after stop() is invoked and
-   from the WaitTaskList::~WaitTaskList() destructor. It deletes thread and all
-   the contained WaitTask objects.
+   from the WaitTaskList::~WaitTaskList() destructor. It deletes all the
+   contained WaitTask objects.
 
    If this method is called earlier than the taskListFinished() (the
    taskListIsFinished() is false), the waitWorkerFinished() is set to true by
@@ -462,12 +512,6 @@ void WaitTaskList::onWorkerQuitFinished()
     // method, which sets quit() to true or by the destructor, which leaves
     // quit at false value.
     if (quit()) {
-        if (thread) {
-            thread->quit();
-            thread->wait();
-            delete thread;
-            thread = nullptr;
-        }
         for (QMap<unsigned int, WaitTaskListTraits::TaskItem>::iterator it = waitTasks.begin(); it != waitTasks.end(); ++it) {
             delete it->task;
         }
@@ -486,8 +530,8 @@ void WaitTaskList::onWorkerQuitFinished()
 /*!
    \brief This is reimplemented method of the ExpTaskList::taskListFinished().
 
-   If this method is invoked after all tasks was finished, the contained thread
-   is deleted and all remaining WaitTask objects, which have been not connected
+   If this method is invoked after all tasks was finished, all remaining
+   WaitTask objects, which have been not connected
    to some WaitingTask is discarded (only when no repetetion of the execution
    of this task is planned or the delayedDelete() is not set. See
    ExpTask::delayedDelete() for more details). Then the finishing process is
@@ -521,12 +565,6 @@ void WaitTaskList::taskListFinished()
     } else {
         // if it was last run of this WaitWorker, everything is cleaned up
         if (currTimesExec() < 2 && !delayedDelete()) {
-            if (thread) {
-                thread->quit();
-                thread->wait();
-                delete thread;
-                thread = nullptr;
-            }
             if (!waitTasks.isEmpty()) {
                 for (QMap<unsigned int, WaitTaskListTraits::TaskItem>::iterator it = waitTasks.begin(); it != waitTasks.end(); ++it) {
                     delete it->task;
@@ -647,34 +685,24 @@ unsigned int WaitTaskList::getId()
 }
 
 /*!
-   \brief Constructs a new QThread and connects the WaitTaskList::stopWorker()
-   signal to the WaitWorker::stop(), WaitTaskList::startWaitTaskInWorker()
-   signal to the WaitWorker::addWaitTask() and finally
-   WaitWorker::quitFinished() signal to the
-   WaitTaskList::onWorkerQuitFinished() slot. Then it starts thread.
+   \brief Constructs a new WaitWorker in one of the shared wait service
+   threads and connects the WaitTaskList::stopWorker() signal to the
+   WaitWorker::stop(), WaitTaskList::startWaitTaskInWorker() signal to the
+   WaitWorker::addWaitTask() and finally WaitWorker::quitFinished() signal to
+   the WaitTaskList::onWorkerQuitFinished() slot.
  */
-void WaitTaskList::buildThread()
+void WaitTaskList::buildWorker()
 {
-    // creating new thread
-    thread = new QThread(this);
-    // creating new worker and moving it to the thread
+    // creating new worker and moving it to the running wait service thread,
+    // the threads are not created nor destroyed with the lists
     waitWorker = new WaitWorker;
-    waitWorker->moveToThread(thread);
-    // the thread object is in the WaitTaskList's thread, whereas the
-    // waitWorker is in the thread inside the QThread thread object, so it is
-    // not safe to destroy it from WaitTaskList's thread and threrefore the
-    // Qt's queued connection is used (it is chosen automatically if the signal
-    // is emitted from the different thread than is the owner of the slot) to
-    // the waitWorker's deleteLater() method.
-    connect(thread, &QThread::finished, waitWorker, &QObject::deleteLater);
+    waitWorker->moveToThread(waitServiceThread());
 
     // signals, which controlls the execution of the waitWorker
     connect(this, &WaitTaskList::stopWorker, waitWorker, &WaitWorker::stop);
     connect(waitWorker, &WaitWorker::quitFinished, this, &WaitTaskList::onWorkerQuitFinished);
     connect(this, &WaitTaskList::startWaitTaskInWorker, waitWorker, &WaitWorker::addWaitTask);
 
-    // starting thread's event loop
-    thread->start();
     setWaitWorkerFinished(false);
 }
 
@@ -683,28 +711,34 @@ void WaitTaskList::buildThread()
  */
 WaitTaskList::~WaitTaskList()
 {
-    waitTasks.clear();
-    if (thread)
+    if (waitWorker)
     {
-        emit stopWorker();
-        thread->quit();
-        thread->wait();
+        // the waitWorker lives in the shared thread, so it has to release the
+        // WaitTask objects there before they are deleted and it is deleted by
+        // the thread's event loop
+        disconnect(waitWorker, nullptr, this, nullptr);
+        if (QThread::currentThread() == waitWorker->thread())
+            waitWorker->stop();
+        else
+            QMetaObject::invokeMethod(waitWorker, "stop", Qt::BlockingQueuedConnection);
+        waitWorker->deleteLater();
     }
+    // the WaitTask objects, which were not released during the execution, are
+    // released together with the list, not left to their long living parent
     for (QMap<unsigned int, WaitTaskListTraits::TaskItem>::iterator it = waitTasks.begin(); it != waitTasks.end(); ++it)
     {
         delete it->task;
     }
+    waitTasks.clear();
 }
 
 /*!
-   \var WaitTaskList::thread
-       \brief The QThread object, which contains thread in which the WaitWorker
-       object runs.
-
-       \sa buildThread()
    \var WaitTaskList::waitWorker
        \brief The WaitWorker object, which controlls wheather the contained
-       WaitTask's is running.
+       WaitTask's is running. It lives in one of the shared wait service
+       threads.
+
+       \sa buildWorker()
    \var WaitTaskList::waitTasks
        \brief List which contains all the added WaitTask objects and their ids.
    \var WaitTaskList::newIds
@@ -725,7 +759,8 @@ WaitTaskList::~WaitTaskList()
    \class WaitWorker
    \brief This class is intended for the internal use in the WaitTaskList for
    controlling if the processes controlled by WaitTask objects is running. It
-   is executed in new thread.
+   is executed in one of the wait service threads shared by all the
+   WaitTaskList objects.
 
    When the new WaitTask is added to the list of controlled tasks by the
    addWaitTask() method, it is checked if the task has some
@@ -753,7 +788,8 @@ WaitTaskList::~WaitTaskList()
    The waitWorkerLoop() execution can be stopped by invoking the stop method,
    which calls the quitLoop() method, which stops all the running task by the
    WaitTask::stop() method executin and then it removes all the added WaitTask
-   objects from the internal list. At the end, it stops the internal QTimer and
+   objects from the internal list and discards the pending DelayedStart
+   objects. At the end, it stops the internal QTimer and
    emits quitFinished() signal, which is connected to the
    WaitTaskList::onWorkerQuitFinished() slot.
  */
@@ -860,6 +896,9 @@ void WaitWorker::quitLoop()
         it->task->stop();
     }
     waitTasks_.clear();
+    // the worker outlives the stopped waiting, so the delayed starts must not
+    // add their WaitTask objects later
+    qDeleteAll(findChildren<DelayedStart *>());
     timer->stop();
     emit quitFinished();
 }
@@ -135,9 +135,8 @@ protected:
 
 private:
     unsigned int getId();
-    void buildThread();
+    void buildWorker();
 
-    QThread *thread;
     WaitWorker *waitWorker;
     QMap<unsigned int, WaitTaskListTraits::TaskItem> waitTasks;
     QSet<unsigned int> newIds;
@@ -4,8 +4,17 @@
 #include "waittasklist.h"
 #include "stagecontrol.h"
 #include "timespan.h"
+#include "adaptiveaccumulation.h"
+#include "framecheck.h"
+#include "spefile.h"
+#include "spectrumpipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
 
 #include <QDateTime>
+#include <QStringList>
 
 DelayWaitTask::DelayWaitTask(AppState *pappState, const TimeSpan *delay, QObject *parent) :
     WaitTask(parent), pappState_(pappState)
@@ -47,6 +56,15 @@ WinSpecWaitTask::WinSpecWaitTask(AppState *pappState, QObject *parent) :
     WaitTask(parent), pappState_(pappState), pwinSpec_(pappState->winSpec())
 {
     hasSpectrum_ = false;
+    dark_ = false;
+    calibration_ = false;
+    lastReadout_ = 0;
+    retries_ = 0;
+    problems_ = 0;
+    aborted_ = false;
+    accumulationStopped_ = false;
+    stoppedSnr_ = 0.0;
+    writeSpe_ = false;
     connect(this, &WinSpecWaitTask::lastFrameChanged, pappState_, &AppState::setLastFrameChanged);
     connect(this, &WinSpecWaitTask::spectrumChanged, pappState_, &AppState::setSpectrumChanged);
 }
@@ -55,6 +73,9 @@ bool WinSpecWaitTask::running()
 {
    if (pwinSpec_->running())
    {
+       if (!checkReadout()) {
+           return false;
+       }
        if (pappState_->plotStyle() == AppStateTraits::PlotStyle::Spectra) {
            int currFrame;
            int iXX;
@@ -65,8 +86,24 @@ bool WinSpecWaitTask::running()
        }
        return true;
    }
-   else
+   else {
+       if (accumulationStopped_) {
+           // WinSpec does not save the stopped acquisition by itself
+           if (pappState_->nativeSpe()) {
+               // written without WinSpec in finish(), where it is read out
+               writeSpe_ = true;
+           } else {
+               double expo;
+               int acc;
+               int frm;
+               QString fileName;
+               pappState_->lastExpParams(&expo, &acc, &frm, &fileName);
+               pwinSpec_->saveAs(fileName);
+           }
+           accumulationStopped_ = false;
+       }
        return false;
+   }
 }
 
 void WinSpecWaitTask::start()
@@ -74,6 +111,26 @@ void WinSpecWaitTask::start()
     if (pwinSpec_->running())
     {
         hasSpectrum_ = true;
+        frameCheck_.reset(new biomolecules::spexpert::core::FrameCheck(*pappState_->frameCheckParams()));
+        biomolecules::spexpert::core::AdaptiveAccumulationParams *adaptiveParams =
+                pappState_->adaptiveAccumulationParams();
+        double expo;
+        int acc;
+        int frm;
+        QString fileName;
+        pappState_->lastExpParams(&expo, &acc, &frm, &fileName);
+        if (adaptiveParams->enabled && !dark_ && !calibration_ && frm == 1) {
+            adaptive_.reset(new biomolecules::spexpert::core::AdaptiveAccumulation(*adaptiveParams));
+        } else {
+            adaptive_.reset();
+        }
+        accumulationStopped_ = false;
+        stoppedSnr_ = 0.0;
+        writeSpe_ = false;
+        lastReadout_ = 0;
+        retries_ = 0;
+        problems_ = 0;
+        aborted_ = false;
         pappState_->setCurrExpParams(0, 0, AppStateTraits::WinSpecState::Running);
         pappState_->setPlotType(AppStateTraits::PlotType::Frame);
     }
@@ -88,14 +145,73 @@ void WinSpecWaitTask::stop()
 
 void WinSpecWaitTask::finish()
 {
-    if (hasSpectrum_ && pappState_->plotStyle() == AppStateTraits::PlotStyle::Spectra) {
-        int iFrames;
-        int iX;
-        int iY;
-        pwinSpec_->getSpectrum(pappState_->getSpectrum(), &iFrames, &iX, &iY);
-        pappState_->setPlotType(AppStateTraits::PlotType::Spectrum);
-        pappState_->makePlotSpectrum();
-        emit spectrumChanged(true);
+    // the measurement is logged after this task, see WinSpecTasks::ExpList,
+    // with the accumulations used by the adaptive accumulation
+    QStringList notes;
+    if (problems_ && !calibration_) {
+        notes << biomolecules::spexpert::core::FrameCheck::describe(problems_);
+        if (retries_ > 0) {
+            notes << QString("retried%1").arg(retries_);
+        }
+        if (aborted_) {
+            notes << "aborted";
+        }
+    }
+    if (stoppedSnr_ > 0.0) {
+        notes << QString("snr%1").arg(stoppedSnr_, 0, 'f', 1);
+    }
+    if (!notes.isEmpty() && pappState_->measurementLog()) {
+        pappState_->measurementLog()->setNote(notes.join(","));
+    }
+    if (aborted_) {
+        // the spoiled spectrum is neither processed nor plotted
+        hasSpectrum_ = false;
+    }
+    // the spectrum is written by SpeWriter if WinSpec does not save it, it is
+    // read out only once and shared with the conversion below
+    QVariantList raw;
+    int rawFrames = 0;
+    int rawX = 0;
+    int rawY = 0;
+    bool hasRaw = false;
+    if (hasSpectrum_ && pappState_->nativeSpe() && (writeSpe_ || !pwinSpec_->autoSaves())) {
+        double expo;
+        int acc;
+        int frm;
+        QString fileName;
+        pappState_->lastExpParams(&expo, &acc, &frm, &fileName);
+        hasRaw = pwinSpec_->getRawSpectrum(raw, &rawFrames, &rawX, &rawY);
+        if (hasRaw && !fileName.isEmpty()) {
+            pappState_->speWriter()->write(fileName, raw,
+                                           biomolecules::spexpert::core::SpeHeader{rawFrames, rawX, rawY, expo, acc});
+        }
+    }
+    writeSpe_ = false;
+    if (hasSpectrum_) {
+        // only take the data out of the detector, the conversion, processing
+        // and plotting overlaps with the next exposure in SpectrumPipeline,
+        // darks go there to be stored in the dark library
+        biomolecules::spexpert::core::SpectrumJob job;
+        int frm;
+        pappState_->lastExpParams(&job.exposure, &job.accumulations, &frm, &job.file_name);
+        job.dark = dark_;
+        job.calibration = calibration_;
+        // the calibrations are tracked per window by the drift monitor
+        if (!dark_ && pappState_->initWinSpecParams()->extRan.extendedRange
+                && pappState_->initWinSpecParams()->expe.size() > 1) {
+            job.window = pappState_->lastWindow();
+            job.windows = pappState_->initWinSpecParams()->expe.size();
+            job.gratingPosition = pappState_->lastGrPos();
+        }
+        if (hasRaw) {
+            job.raw = raw;
+            job.frames = rawFrames;
+            job.x = rawX;
+            job.y = rawY;
+        }
+        if (hasRaw || pwinSpec_->getRawSpectrum(job.raw, &job.frames, &job.x, &job.y)) {
+            pappState_->spectrumPipeline()->push(std::move(job));
+        }
         pappState_->setCurrExpParams(0, 0, AppStateTraits::WinSpecState::Ready);
         hasSpectrum_ = false;
     } else {
@@ -104,6 +220,95 @@ void WinSpecWaitTask::finish()
     WaitTask::finish();
 }
 
+/*!
+   \brief Takes the last readout of the running acquisition, at most once per
+   exposure, checks it by biomolecules::spexpert::core::FrameCheck and adds it
+   to biomolecules::spexpert::core::AdaptiveAccumulation.
+   \return false if the acquisition was aborted.
+ */
+bool WinSpecWaitTask::checkReadout()
+{
+    biomolecules::spexpert::core::FrameCheckParams *params = pappState_->frameCheckParams();
+    bool check = params->enabled && frameCheck_ && !dark_;
+    if ((!check && !adaptive_) || accumulationStopped_) {
+        return true;
+    }
+    double expo;
+    int acc;
+    int frm;
+    QString fileName;
+    pappState_->lastExpParams(&expo, &acc, &frm, &fileName);
+    qint64 elapsed = pappState_->getMeasurementStartedTime().msecsTo(QDateTime::currentDateTime());
+    int readout = static_cast<int>(elapsed / std::max<qint64>(1, static_cast<qint64>(1000 * expo)));
+    if (readout <= lastReadout_) {
+        return true;
+    }
+    lastReadout_ = readout;
+
+    QVariantList frame;
+    int currFrame;
+    int iX;
+    int iY;
+    if (!pwinSpec_->getRawLastFrame(frame, &currFrame, &iX, &iY)) {
+        return true;
+    }
+    int problems = check ? frameCheck_->check(frame, iX, iY) : biomolecules::spexpert::core::FrameCheck::None;
+    if (problems == biomolecules::spexpert::core::FrameCheck::None) {
+        if (adaptive_) {
+            // the readout is the running sum of the accumulations done so far
+            int accums = pwinSpec_->getAccum();
+            if (accums < 1) {
+                accums = std::min(readout, acc);
+            }
+            if (adaptive_->add(frame, iX, iY, accums) && accums < acc && adaptive_->targetReached(accums)) {
+                // the spectrum is saved when WinSpec stops, see running()
+                stoppedSnr_ = adaptive_->snr(accums);
+                qDebug() << "WinSpecWaitTask::checkReadout(): SNR" << stoppedSnr_
+                         << "reached after" << accums << "accumulations";
+                pwinSpec_->stop();
+                pappState_->setLastExpParams(expo, accums, frm, fileName);
+                accumulationStopped_ = true;
+            }
+        }
+        return true;
+    }
+    problems_ |= problems;
+    qDebug() << "WinSpecWaitTask::checkReadout(): readout" << readout << ":"
+             << biomolecules::spexpert::core::FrameCheck::describe(problems);
+
+    switch (params->action) {
+    case biomolecules::spexpert::core::FrameCheckAction::Flag :
+        return true;
+    case biomolecules::spexpert::core::FrameCheckAction::Retry :
+        if (retries_ < params->maxRetries) {
+            ++retries_;
+            pwinSpec_->stop();
+            if ((problems & biomolecules::spexpert::core::FrameCheck::Saturated) && expo >= 0.002) {
+                // the same total exposure in twice as many accumulations
+                expo = std::floor(500 * expo) / 1000;
+                acc *= 2;
+            }
+            qDebug() << "WinSpecWaitTask::checkReadout(): restarting with exposure" << expo << ", accumulations" << acc;
+            if (pwinSpec_->start(expo, acc, frm, fileName)) {
+                pappState_->setLastExpParams(expo, acc, frm, fileName);
+                pappState_->measurementStartedTime();
+                frameCheck_->reset();
+                if (adaptive_) {
+                    adaptive_->reset();
+                }
+                lastReadout_ = 0;
+                return true;
+            }
+        }
+        break;
+    case biomolecules::spexpert::core::FrameCheckAction::Abort :
+        break;
+    }
+    pwinSpec_->stop();
+    aborted_ = true;
+    return false;
+}
+
 WinSpecWaitTask::~WinSpecWaitTask()
 {
 }
@@ -1,6 +1,8 @@
 #ifndef WAITTASKS_H
 #define WAITTASKS_H
 
+#include <memory>
+
 #include "waittask.h"
 
 // forward declarations
@@ -10,6 +12,15 @@ class WinSpec;
 class StageControl;
 class TimeSpan;
 
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+class AdaptiveAccumulation;
+class FrameCheck;
+}
+}
+}
+
 class DelayWaitTask : public WaitTask
 {
     Q_OBJECT
@@ -38,6 +49,8 @@ public:
     WinSpecWaitTask(AppState * pappState, QObject * parent = 0);
     virtual ~WinSpecWaitTask();
     virtual bool running();
+    void setDarkAcquisition(bool dark) { dark_ = dark; }
+    void setCalibration(bool calibration) { calibration_ = calibration; }
 
 signals:
     void spectrumChanged(bool blSpectrumChanged);
@@ -49,9 +62,22 @@ public slots:
     virtual void finish();
 
 private:
+    bool checkReadout();
+
     AppState * pappState_;
     WinSpec * pwinSpec_;
     bool hasSpectrum_;
+    bool dark_;
+    bool calibration_;
+    std::unique_ptr<biomolecules::spexpert::core::FrameCheck> frameCheck_;
+    std::unique_ptr<biomolecules::spexpert::core::AdaptiveAccumulation> adaptive_;
+    int lastReadout_;
+    int retries_;
+    int problems_;
+    bool aborted_;
+    bool accumulationStopped_;
+    double stoppedSnr_;  // SNR of the adaptive accumulation stopped early
+    bool writeSpe_;
 };
 
 class StageControlWaitTask : public WaitTask
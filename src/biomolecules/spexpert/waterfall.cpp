@@ -0,0 +1,216 @@
+#include "waterfall.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+namespace {
+
+// black - blue - cyan - yellow - white
+QVector<QRgb> colorTable()
+{
+    static const int stops[][3] = {{0, 0, 64}, {0, 0, 255}, {0, 255, 255}, {255, 255, 0}, {255, 255, 255}};
+    static const int segments = 4;
+    QVector<QRgb> table(256);
+    for (int ii = 0; ii < 256; ++ii) {
+        double pos = ii / 255.0 * segments;
+        int seg = std::min(int(pos), segments - 1);
+        double t = pos - seg;
+        int rgb[3];
+        for (int cc = 0; cc < 3; ++cc) {
+            rgb[cc] = int(stops[seg][cc] + t * (stops[seg + 1][cc] - stops[seg][cc]) + 0.5);
+        }
+        table[ii] = qRgb(rgb[0], rgb[1], rgb[2]);
+    }
+    return table;
+}
+
+}  // namespace
+
+/*!
+   \class Waterfall
+   \brief Color coded history of the measured spectra, one image row per
+   spectrum, for the series which are too long to be plotted as graphs.
+
+   The spectra are binned to at most max_columns columns and written to the
+   preallocated image, so appending costs one row of pixels, not the redraw of
+   the whole history. When all max_rows rows are used, the neighbouring rows
+   are averaged, so the image keeps half of the rows, each of them showing
+   twice as many spectra as before (rowSpan()). The following spectra are
+   averaged into the last row until it shows rowSpan() spectra as well. The
+   halving touches the whole image, but it happens only once per max_rows / 2
+   rows.
+
+   The colors span the range of the values measured so far. The whole image is
+   remapped only when a new spectrum leaves this range, which is extended by a
+   margin to make it rare.
+
+   The object is not thread safe, it is used from the GUI thread by PlotProxy.
+ */
+
+Waterfall::Waterfall(int max_columns, int max_rows)
+    : max_columns_{std::max(max_columns, 1)},
+      max_rows_{std::max(max_rows + max_rows % 2, 2)},
+      points_{0},
+      columns_{0},
+      rows_{0},
+      row_span_{1},
+      row_count_{0},
+      spectra_{0},
+      lo_{0.0},
+      hi_{1.0}
+{}
+
+
+/*!
+   \brief Forgets all the spectra and releases the image.
+ */
+void Waterfall::clear()
+{
+    points_ = 0;
+    columns_ = 0;
+    rows_ = 0;
+    row_span_ = 1;
+    row_count_ = 0;
+    spectra_ = 0;
+    values_.clear();
+    row_sum_.clear();
+    image_ = QImage();
+}
+
+
+/*!
+   \brief Appends the spectrum \a y. The spectrum of a different size than the
+   previous ones starts a new history.
+ */
+void Waterfall::append(const QVector<double>& y)
+{
+    if (y.isEmpty()) {
+        return;
+    }
+    if (y.size() != points_) {
+        reset(y.size());
+    }
+    if (rows_ == 0 || row_count_ == row_span_) {
+        if (rows_ == max_rows_) {
+            decimate();
+        }
+        ++rows_;
+        row_count_ = 0;
+        row_sum_.fill(0.0);
+    }
+
+    float* row = values_.data() + (rows_ - 1) * columns_;
+    double lo = std::numeric_limits<double>::max();
+    double hi = std::numeric_limits<double>::lowest();
+    for (int cc = 0; cc < columns_; ++cc) {
+        int from = int(qint64(cc) * points_ / columns_);
+        int to = int(qint64(cc + 1) * points_ / columns_);
+        double sum = 0.0;
+        for (int ii = from; ii < to; ++ii) {
+            sum += y.at(ii);
+        }
+        row_sum_[cc] += sum / (to - from);
+        double value = row_sum_.at(cc) / (row_count_ + 1);
+        row[cc] = float(value);
+        lo = std::min(lo, value);
+        hi = std::max(hi, value);
+    }
+    ++row_count_;
+    ++spectra_;
+
+    if (spectra_ == 1) {
+        lo_ = lo;
+        hi_ = (hi > lo) ? hi : lo + 1.0;
+        mapRow(rows_ - 1);
+    } else if (lo < lo_ || hi > hi_) {
+        double margin = (std::max(hi, hi_) - std::min(lo, lo_)) / 10.0;
+        if (lo < lo_) {
+            lo_ = lo - margin;
+        }
+        if (hi > hi_) {
+            hi_ = hi + margin;
+        }
+        mapAll();
+    } else {
+        mapRow(rows_ - 1);
+    }
+}
+
+
+/*!
+   \brief Returns the used rows of the image, the first row is the oldest.
+
+   The returned image shares the data with the Waterfall, it is valid until the
+   next append() or clear().
+ */
+QImage Waterfall::image() const
+{
+    if (rows_ == 0) {
+        return QImage();
+    }
+    QImage view{image_.constBits(), columns_, rows_, image_.bytesPerLine(), QImage::Format_Indexed8};
+    view.setColorTable(image_.colorTable());
+    return view;
+}
+
+
+void Waterfall::reset(int points)
+{
+    points_ = points;
+    columns_ = std::min(points, max_columns_);
+    rows_ = 0;
+    row_span_ = 1;
+    row_count_ = 0;
+    spectra_ = 0;
+    values_.fill(0.0f, max_rows_ * columns_);
+    row_sum_.fill(0.0, columns_);
+    image_ = QImage{columns_, max_rows_, QImage::Format_Indexed8};
+    image_.setColorTable(colorTable());
+    image_.fill(0);
+}
+
+
+// halves the rows, it is called only when all the rows are complete
+void Waterfall::decimate()
+{
+    float* values = values_.data();
+    for (int rr = 0; rr < max_rows_ / 2; ++rr) {
+        float* to = values + rr * columns_;
+        const float* first = values + 2 * rr * columns_;
+        const float* second = first + columns_;
+        for (int cc = 0; cc < columns_; ++cc) {
+            to[cc] = (first[cc] + second[cc]) / 2.0f;
+        }
+    }
+    rows_ = max_rows_ / 2;
+    row_span_ *= 2;
+    mapAll();
+}
+
+
+void Waterfall::mapRow(int row)
+{
+    const float* values = values_.constData() + row * columns_;
+    uchar* pixels = image_.scanLine(row);
+    double scale = 255.0 / (hi_ - lo_);
+    for (int cc = 0; cc < columns_; ++cc) {
+        double index = (values[cc] - lo_) * scale;
+        pixels[cc] = uchar(std::min(std::max(index, 0.0), 255.0) + 0.5);
+    }
+}
+
+
+void Waterfall::mapAll()
+{
+    for (int rr = 0; rr < rows_; ++rr) {
+        mapRow(rr);
+    }
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
@@ -0,0 +1,53 @@
+#ifndef BIOMOLECULES_SPEXPERT_WATERFALL_H_
+#define BIOMOLECULES_SPEXPERT_WATERFALL_H_
+
+#include <QImage>
+#include <QVector>
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+class Waterfall
+{
+public:
+    explicit Waterfall(int max_columns = 1024, int max_rows = 512);
+    Waterfall(const Waterfall&) = delete;
+    Waterfall& operator=(const Waterfall&) = delete;
+
+    void clear();
+    void append(const QVector<double>& y);
+    QImage image() const;
+
+    int columns() const { return columns_; }
+    int rows() const { return rows_; }
+    int rowSpan() const { return row_span_; }
+    int spectra() const { return spectra_; }
+
+private:
+    void reset(int points);
+    void decimate();
+    void mapRow(int row);
+    void mapAll();
+
+    int max_columns_;
+    int max_rows_;
+    int points_;              // points of the appended spectra
+    int columns_;             // points binned to at most max_columns_
+    int rows_;                // used rows, the last one may be incomplete
+    int row_span_;            // spectra averaged in one row
+    int row_count_;           // spectra in the last row
+    int spectra_;
+    double lo_;               // value shown by the first color
+    double hi_;               // value shown by the last color
+    QVector<float> values_;   // max_rows_ x columns_ row averages
+    QVector<double> row_sum_; // sums of the last row
+    QImage image_;            // max_rows_ x columns_, preallocated
+};
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_WATERFALL_H_
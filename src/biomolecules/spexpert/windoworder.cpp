@@ -0,0 +1,50 @@
+#include "windoworder.h"
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+/*!
+   \brief The order of the extended range windows at the temperature \a step
+   counted from zero. In the serpentine order the odd temperatures walk the
+   windows backwards.
+ */
+WindowOrder windowOrder(bool serpentine, int step)
+{
+    if (!serpentine) {
+        return WindowOrder::Cyclic;
+    }
+    return (step % 2) ? WindowOrder::Descending : WindowOrder::Ascending;
+}
+
+
+/*!
+   \brief The step of the last temperature of the series of \a num_t_meas
+   temperatures, which is measured twice if \a loop is set.
+ */
+int lastTStep(int num_t_meas, bool loop)
+{
+    return loop ? 2 * num_t_meas - 2 : num_t_meas - 1;
+}
+
+
+/*!
+   \brief Where the extended range temperature series leaves the grating and
+   the experiment number.
+
+   The series ends in the last window, unless the last temperature walks the
+   windows backwards, then it ends in the first one. The series of a single
+   temperature is not walked at all and ends in the last window as the
+   experiment without the temperatures.
+ */
+SeriesEnd seriesEnd(int windows, int exp_number_step, int num_t_meas, bool loop, bool serpentine)
+{
+    if (num_t_meas > 1 && windowOrder(serpentine, lastTStep(num_t_meas, loop)) == WindowOrder::Descending) {
+        return SeriesEnd{0, 0};
+    }
+    return SeriesEnd{windows - 1, -(windows - 1) * exp_number_step};
+}
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
@@ -0,0 +1,29 @@
+#ifndef BIOMOLECULES_SPEXPERT_WINDOWORDER_H_
+#define BIOMOLECULES_SPEXPERT_WINDOWORDER_H_
+
+
+namespace biomolecules {
+namespace spexpert {
+namespace core {
+
+enum class WindowOrder {
+    Cyclic,      // ascending, the grating returns to the first window
+    Ascending,   // ascending, the next temperature starts at the last window
+    Descending   // descending, the next temperature starts at the first window
+};
+
+struct SeriesEnd
+{
+    int window;     // window measured last, where the grating stays
+    int backShift;  // experiment number shift from it to the first window
+};
+
+WindowOrder windowOrder(bool serpentine, int step);
+int lastTStep(int num_t_meas, bool loop);
+SeriesEnd seriesEnd(int windows, int exp_number_step, int num_t_meas, bool loop, bool serpentine);
+
+}  // namespace core
+}  // namespace spexpert
+}  // namespace biomolecules
+
+#endif  // BIOMOLECULES_SPEXPERT_WINDOWORDER_H_
@@ -6,94 +6,163 @@
 #include "winspecvb.h"
 #endif
 
+#include "devicethread.h"
 #include "lockableqvector.h"
 
 #include <QMutex>
 #include <QMutexLocker>
 #include <algorithm> // to provide copy on containers
 
+// WinSpec is created, called and destroyed only in its device thread, the
+// running state and the progress are read from the snapshot, which is polled
+// while the acquisition runs, so the GUI never waits for the COM calls
 WinSpec::WinSpec()
-    :
+    : mutex{new QMutex},
+      blRunning{false},
+      iAccum{0},
+      iFrame{0},
+      device{new biomolecules::spexpert::core::DeviceThread{"WinSpec"}}
+{
+    qDebug() << "Vytvarim WinSpec...";
+    device->invoke([this] {
 #if defined(SPEXPERT_MOCK_WINSPEC)
-      winSpec{new biomolecules::spexpert::core::MockWinSpec}
+        winSpec.reset(new biomolecules::spexpert::core::MockWinSpec);
 #else
-      winSpec{new WinSpecVB::WinSpecVB}
+        winSpec.reset(new WinSpecVB::WinSpecVB);
 #endif
-{
-    qDebug() << "Vytvarim WinSpec...";
-    mutex = new QMutex;
+    });
+    device->setPoll([this] { pollStatus(); }, 100);
 }
 
 bool WinSpec::start(double dblExpo_, int iAccums_, int iFrames_, const QString & strFileName_)
 {
-    QMutexLocker locker(mutex);
-    return winSpec->Start_2(dblExpo_, iAccums_, iFrames_, strFileName_);
+    return device->invoke([&] {
+        bool blStarted = winSpec->Start_2(dblExpo_, iAccums_, iFrames_, strFileName_);
+        if (blStarted) {
+            QMutexLocker locker(mutex);
+            blRunning = true;
+            iAccum = 0;
+            iFrame = 0;
+        }
+        return blStarted;
+    });
 }
 
 void WinSpec::stop()
 {
-    QMutexLocker locker(mutex);
-    winSpec->StopRunning();
+    device->post([this] {
+        winSpec->StopRunning();
+        QMutexLocker locker(mutex);
+        blRunning = true;
+        locker.unlock();
+        pollStatus();
+    });
 }
 
 bool WinSpec::running()
 {
     QMutexLocker locker(mutex);
-    return winSpec->Running();
+    return blRunning;
 }
 
 int WinSpec::getAccum()
 {
     QMutexLocker locker(mutex);
-    return winSpec->GetAccum();
+    return iAccum;
 }
 
 int WinSpec::getFrame()
 {
     QMutexLocker locker(mutex);
-    return winSpec->GetFrame();
+    return iFrame;
+}
+
+// called in the device thread, queries WinSpec only while the snapshot says
+// it runs
+void WinSpec::pollStatus()
+{
+    QMutexLocker locker(mutex);
+    if (!blRunning)
+        return;
+    locker.unlock();
+
+    bool blStillRunning = winSpec->Running();
+    int iCurrAccum = winSpec->GetAccum();
+    int iCurrFrame = winSpec->GetFrame();
+
+    locker.relock();
+    blRunning = blStillRunning;
+    iAccum = iCurrAccum;
+    iFrame = iCurrFrame;
 }
 
 bool WinSpec::getSpectrum(LockableSpectrum &spectrum_, int *iFrames_, int *iX_, int *iY_)
 {
     int iFr, iX, iY;
-    bool blStat;
     QVariantList outspec;
 
-    QMutexLocker locker(mutex);
-    outspec = winSpec->GetSpectrum(iFr, iX, iY, blStat);
-    locker.unlock();
+    if (!getRawSpectrum(outspec, &iFr, &iX, &iY))
+        return false;
+
+    if (!convertSpectrum(outspec, iFr, iX, iY, spectrum_))
+        return false;
+    //emit spectrumChanged(true);
+    *iFrames_ = iFr;
+    *iX_ = iX;
+    *iY_ = iY;
+    return true;
+}
+
+bool WinSpec::getRawSpectrum(QVariantList &rawSpectrum_, int *iFrames_, int *iX_, int *iY_)
+{
+    int iFr, iX, iY;
+    bool blStat;
+
+    rawSpectrum_ = device->invoke([&] { return winSpec->GetSpectrum(iFr, iX, iY, blStat); });
 
     qDebug() << "GetSpectrum status: " << blStat;
     if (!blStat)
         return blStat;
-    if (outspec.size() != iFr * iX * iY)
+    if (rawSpectrum_.size() != iFr * iX * iY)
+        return false;
+    *iFrames_ = iFr;
+    *iX_ = iX;
+    *iY_ = iY;
+    return true;
+}
+
+bool WinSpec::convertSpectrum(const QVariantList &rawSpectrum_, int iFrames_, int iX_, int iY_,
+                              QVector<QVector<double> > &spectrum_)
+{
+    if (rawSpectrum_.size() != iFrames_ * iX_ * iY_ || iFrames_ < 1)
         return false;
 
-    QMutexLocker specLocker(spectrum_.toMutexY());
-    spectrum_.toYQVector().resize(iFr);
+    spectrum_.resize(iFrames_);
+    FrameIterator fI;
+    QVariantList::ConstIterator oI = rawSpectrum_.constBegin();
+    for (SpectrumIterator sI = spectrum_.begin(); sI != spectrum_.end(); ++sI)
     {
-        FrameIterator fI;
-        QVariantList::Iterator oI = outspec.begin();
-        for (SpectrumIterator sI = spectrum_.toYQVector().begin(); sI != spectrum_.toYQVector().end(); ++sI)
+        sI->resize(iX_);
+        for (fI = sI->begin(); fI != sI->end(); ++fI)
         {
-            sI->resize(iX);
-            for (fI = sI->begin(); fI != sI->end(); ++fI)
-            {
-                *fI = std::accumulate(oI, oI + iY, 0, [] (const QVariant & a, const QVariant & b) ->double { return a.toInt() + b.toInt(); } );
-                oI += iY;
-            }
+            *fI = std::accumulate(oI, oI + iY_, 0, [] (const QVariant & a, const QVariant & b) ->double { return a.toInt() + b.toInt(); } );
+            oI += iY_;
         }
     }
+    return true;
+}
+
+bool WinSpec::convertSpectrum(const QVariantList &rawSpectrum_, int iFrames_, int iX_, int iY_,
+                              LockableSpectrum &spectrum_)
+{
+    QMutexLocker specLocker(spectrum_.toMutexY());
+    if (!convertSpectrum(rawSpectrum_, iFrames_, iX_, iY_, spectrum_.toYQVector()))
+        return false;
     QMutexLocker xLocker(spectrum_.toMutexX());
     if (spectrum_.toXQVector().size() != spectrum_.toYQVector().first().size())
         spectrum_.autoGenerateX();
     specLocker.unlock();
     xLocker.unlock();
-    //emit spectrumChanged(true);
-    *iFrames_ = iFr;
-    *iX_ = iX;
-    *iY_ = iY;
     return true;
 }
 
@@ -102,9 +171,7 @@ bool WinSpec::getLastFrame(LockableFrame &lastFrame_, int *iFrame_, int *iX_, in
     int iFr, iX, iY;
     bool blStat;
     QVariantList outFram;
-    QMutexLocker locker(mutex);
-    outFram = winSpec->GetLastFrame(iFr, iX, iY, blStat);
-    locker.unlock();
+    outFram = device->invoke([&] { return winSpec->GetLastFrame(iFr, iX, iY, blStat); });
 //    qDebug() << "WinSpec::getLastFrame(): status: " << blStat;
     if (!blStat)
         return blStat;
@@ -135,13 +202,28 @@ bool WinSpec::getLastFrame(LockableFrame &lastFrame_, int *iFrame_, int *iX_, in
 
 }
 
+bool WinSpec::getRawLastFrame(QVariantList &rawFrame_, int *iFrame_, int *iX_, int *iY_)
+{
+    int iFr, iX, iY;
+    bool blStat;
+
+    rawFrame_ = device->invoke([&] { return winSpec->GetLastFrame(iFr, iX, iY, blStat); });
+
+    if (!blStat)
+        return blStat;
+    if (rawFrame_.size() != iX * iY)
+        return false;
+    *iFrame_ = iFr;
+    *iX_ = iX;
+    *iY_ = iY;
+    return true;
+}
+
 void WinSpec::getAcqParams(double *dblExposure_, int *iAccums_, int *iFrames_)
 {
     double dblExposure;
     int iAccums, iFrames;
-    QMutexLocker locker(mutex);
-    winSpec->GetWinSpecAcqParams(dblExposure, iAccums, iFrames);
-    locker.unlock();
+    device->invoke([&] { winSpec->GetWinSpecAcqParams(dblExposure, iAccums, iFrames); });
     *dblExposure_ = dblExposure;
     *iAccums_ = iAccums;
     *iFrames_ = iFrames;
@@ -151,87 +233,85 @@ void WinSpec::getAcqParams(double *dblExposure_, int *iAccums_)
 {
     double dblExposure;
     int iAccums;
-    QMutexLocker locker(mutex);
-    winSpec->GetWinSpecAcqParams_2(dblExposure, iAccums);
-    locker.unlock();
+    device->invoke([&] { winSpec->GetWinSpecAcqParams_2(dblExposure, iAccums); });
     *dblExposure_ = dblExposure;
     *iAccums_ = iAccums;
 }
 
 void WinSpec::setAcqParams(double dblExposure_, int iAccums_, int iFrames_)
 {
-    QMutexLocker locker(mutex);
-    winSpec->SetWinSpecAcqParams(dblExposure_, iAccums_, iFrames_);
+    device->invoke([&] { winSpec->SetWinSpecAcqParams(dblExposure_, iAccums_, iFrames_); });
 }
 
 void WinSpec::setAcqParams(double dblExposure_, int iAccums_)
 {
-    QMutexLocker locker(mutex);
-    winSpec->SetWinSpecAcqParams_2(dblExposure_, iAccums_);
+    device->invoke([&] { winSpec->SetWinSpecAcqParams_2(dblExposure_, iAccums_); });
 }
 
 void WinSpec::getFilePath(QString &strFileName_)
 {
-    QMutexLocker locker(mutex);
-    winSpec->GetFilePath(strFileName_);
+    device->invoke([&] { winSpec->GetFilePath(strFileName_); });
 }
 
 void WinSpec::setFilePath(const QString &strFileName_)
 {
-    QMutexLocker locker(mutex);
-    winSpec->SetFilePath(strFileName_);
+    device->invoke([&] { winSpec->SetFilePath(strFileName_); });
 }
 
 bool WinSpec::save()
 {
-    QMutexLocker locker(mutex);
-    return winSpec->Save();
+    return device->invoke([&] { return winSpec->Save(); });
 }
 
 bool WinSpec::saveAs(const QString &strFileName_)
 {
-    QMutexLocker locker(mutex);
-    return winSpec->SaveAs(strFileName_);
+    return device->invoke([&] { return winSpec->SaveAs(strFileName_); });
+}
+
+// WinSpec saves the acquisition started by start() itself, the mock does not
+bool WinSpec::autoSaves() const
+{
+#if defined(SPEXPERT_MOCK_WINSPEC)
+    return false;
+#else
+    return true;
+#endif
 }
 
 bool WinSpec::activateWindow()
 {
-    QMutexLocker locker(mutex);
-    return winSpec->ActivateWindow();
+    return device->invoke([&] { return winSpec->ActivateWindow(); });
 }
 
 void WinSpec::closeWindow()
 {
-    QMutexLocker locker(mutex);
-    winSpec->CloseWindow();
+    device->invoke([&] { winSpec->CloseWindow(); });
 }
 
 void WinSpec::closeAllWindows()
 {
-    QMutexLocker locker(mutex);
-    winSpec->CloseAllWindows();
+    device->invoke([&] { winSpec->CloseAllWindows(); });
 }
 
 bool WinSpec::quitWinSpec()
 {
-    QMutexLocker locker(mutex);
-    return winSpec->QuitWinSpec();
+    return device->invoke([&] { return winSpec->QuitWinSpec(); });
 }
 
 bool WinSpec::showWinSpecWin()
 {
-    QMutexLocker locker(mutex);
-    return winSpec->ShowWinSpecWin();
+    return device->invoke([&] { return winSpec->ShowWinSpecWin(); });
 }
 
 bool WinSpec::winSpecConnectionFailed()
 {
-    QMutexLocker locker(mutex);
-    return winSpec->WinSpecConnectionFailed();
+    return device->invoke([&] { return winSpec->WinSpecConnectionFailed(); });
 }
 
 WinSpec::~WinSpec()
 {
     qDebug() << "Rusim WinSpec...";
+    device->invoke([this] { winSpec.reset(); });
+    device.reset();
     delete mutex;
 }
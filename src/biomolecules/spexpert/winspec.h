@@ -3,6 +3,7 @@
 
 #include <memory>
 
+#include <QVariantList>
 #include <QVector>
 
 #include <QDebug>
@@ -12,15 +13,17 @@ class QMutex;
 class LockableSpectrum;
 class LockableFrame;
 
-#if defined(SPEXPERT_MOCK_WINSPEC)
 namespace biomolecules {
 namespace spexpert {
 namespace core {
+class DeviceThread;
+#if defined(SPEXPERT_MOCK_WINSPEC)
 class MockWinSpec;
+#endif
 }
 }
 }
-#else
+#if !defined(SPEXPERT_MOCK_WINSPEC)
 namespace WinSpecVB
 {
     class WinSpecVB;
@@ -46,7 +49,13 @@ public:
     int getAccum();
     int getFrame();
     bool getSpectrum(LockableSpectrum & spectrum_, int * iFrames_, int * iX_, int * iY_);
+    bool getRawSpectrum(QVariantList & rawSpectrum_, int * iFrames_, int * iX_, int * iY_);
+    static bool convertSpectrum(const QVariantList & rawSpectrum_, int iFrames_, int iX_, int iY_,
+                                QVector<QVector<double> > & spectrum_);
+    static bool convertSpectrum(const QVariantList & rawSpectrum_, int iFrames_, int iX_, int iY_,
+                                LockableSpectrum & spectrum_);
     bool getLastFrame(LockableFrame &lastFrame_, int * iFrame_, int * iX_, int * iY_);
+    bool getRawLastFrame(QVariantList & rawFrame_, int * iFrame_, int * iX_, int * iY_);
     void getAcqParams(double * dblExposure_, int * iAccums_, int * iFrames_);
     void getAcqParams(double * dblExposure_, int * iAccums_);
     void setAcqParams(double dblExposure_, int iAccums_, int iFrames_);
@@ -55,6 +64,7 @@ public:
     void setFilePath(const QString & strFileName_);
     bool save();
     bool saveAs(const QString & strFileName_);
+    bool autoSaves() const;
     bool activateWindow();
     void closeWindow();
     void closeAllWindows();
@@ -66,7 +76,15 @@ public:
 public slots:
 
 private:
+    void pollStatus();
+
+    // status snapshot refreshed by the device thread, read without waiting for WinSpec
     QMutex *mutex;
+    bool blRunning;
+    int iAccum;
+    int iFrame;
+
+    std::unique_ptr<biomolecules::spexpert::core::DeviceThread> device;
 #if defined(SPEXPERT_MOCK_WINSPEC)
     std::unique_ptr<biomolecules::spexpert::core::MockWinSpec> winSpec;
 #else